@@ -0,0 +1,119 @@
+#include "Benchmark.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static std::atomic<size_t> allocations(0);
+static std::atomic<size_t> bytes(0);
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+size_t Benchmark::allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+size_t Benchmark::allocatedBytes() {
+    return bytes.load(std::memory_order_relaxed);
+}
+
+Benchmark::Benchmark(int argc, char** argv) : minSeconds(0.1), json(false) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0) json = true;
+        else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) filter = argv[++i];
+        else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) minSeconds = std::atof(argv[++i]);
+        else std::cerr << "Unknown argument " << argv[i] << std::endl;
+    }
+}
+
+void Benchmark::run(const std::string& name, const Body& body) {
+    if (!filter.empty() && name.find(filter) == std::string::npos) return;
+    typedef std::chrono::steady_clock Clock;
+
+    body(1); // warm up caches and lazily created state
+    size_t iterations = 1;
+    while (true) {
+        const size_t allocationsBefore = allocationCount();
+        const size_t bytesBefore = allocatedBytes();
+        const Clock::time_point start = Clock::now();
+        body(iterations);
+        const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (elapsed >= minSeconds || iterations >= ((size_t)1 << 40)) {
+            Result result;
+            result.name = name;
+            result.iterations = iterations;
+            result.nsPerOp = elapsed * 1e9 / iterations;
+            result.bytesPerOp = (double)(allocatedBytes() - bytesBefore) / iterations;
+            result.allocationsPerOp = (double)(allocationCount() - allocationsBefore) / iterations;
+            results.push_back(result);
+            if (!json)
+                std::cout << name << "\t" << iterations << " ops\t" << result.nsPerOp << " ns/op\t"
+                          << result.bytesPerOp << " B/op\t" << result.allocationsPerOp << " allocs/op" << std::endl;
+            return;
+        }
+
+        // Aim a little past the minimum so the next batch is usually the last
+        const double scale = elapsed > 0 ? 1.4 * minSeconds / elapsed : 100;
+        size_t next = (size_t)(iterations * (scale < 100 ? scale : 100));
+        iterations = next > iterations ? next : iterations + 1;
+    }
+}
+
+// Names are free text, so quotes, backslashes and control characters are escaped
+static void writeJsonString(std::ostream& out, const std::string& text) {
+    static const char HEX[] = "0123456789abcdef";
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (c == '\n') out << "\\n";
+        else if (c == '\t') out << "\\t";
+        else if ((unsigned char) c < 0x20) out << "\\u00" << HEX[(unsigned char) c >> 4] << HEX[c & 0xF];
+        else out << c;
+    }
+    out << '"';
+}
+
+int Benchmark::report() const {
+    if (!json) return 0;
+
+    std::cout << "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        std::cout << (i ? ",\n" : "\n") << "    {\"name\": ";
+        writeJsonString(std::cout, result.name);
+        std::cout << ", \"iterations\": " << result.iterations
+                  << ", \"ns_per_op\": " << result.nsPerOp
+                  << ", \"bytes_per_op\": " << result.bytesPerOp
+                  << ", \"allocs_per_op\": " << result.allocationsPerOp << "}";
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+    return 0;
+}
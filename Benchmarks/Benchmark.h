@@ -0,0 +1,48 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+
+// Minimal benchmark harness shared by the MultiSet and ModifiableIntegerFunction suites.
+// A benchmark body gets an iteration count and runs the measured operation that many
+// times; the runner grows the count until one batch lasts at least the minimum time.
+// Heap traffic is counted through the replaced global operator new in Benchmark.cpp.
+class Benchmark {
+public:
+    typedef std::function<void(size_t)> Body;
+
+    struct Result {
+        std::string name;
+        size_t iterations;
+        double nsPerOp;
+        double bytesPerOp;
+        double allocationsPerOp;
+    };
+
+    // Understands --json, --filter <substring> and --min-time <seconds>
+    Benchmark(int argc, char** argv);
+
+    void run(const std::string& name, const Body& body);
+    int report() const; // prints the table or the JSON document, returns the exit code
+
+    static size_t allocationCount();
+    static size_t allocatedBytes();
+
+    // Keeps the compiler from dropping a result that is otherwise unused
+    template <typename T>
+    static void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "g"(&value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+private:
+    std::vector<Result> results;
+    std::string filter;
+    double minSeconds;
+    bool json;
+};
@@ -0,0 +1,178 @@
+#include "Benchmark.h"
+#include "ModifiableIntegerFunction.h"
+#include "IterationIndex.h"
+#include "FunctionRegistry.h"
+#include "PiecewiseIntegerFunction.h"
+#include <cstdio>
+#include <vector>
+
+static const char* const FILE_NAME = "bench_function.bin";
+
+static int16_t doubleFunction(int16_t x) {
+    return 2 * x;
+}
+
+static int16_t shiftFunction(int16_t x) {
+    return x + 7;
+}
+
+// Stands in for a base function that costs microseconds per call
+static int16_t expensiveFunction(int16_t x) {
+    uint32_t state = (uint16_t)x;
+    for (int i = 0; i < 256; ++i)
+        state = state * 1664525u + 1013904223u;
+    return (int16_t)state;
+}
+
+int main(int argc, char** argv) {
+    Benchmark benchmark(argc, argv);
+
+    const ModifiableIntegerFunction f(doubleFunction);
+    const ModifiableIntegerFunction g(shiftFunction);
+
+    benchmark.run("ModifiableIntegerFunction::construct", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(ModifiableIntegerFunction(doubleFunction));
+    });
+
+    // Construction is lazy; the first whole-domain query computes every result
+    const size_t threadCounts[] = { 1, 2, 4 };
+    for (size_t threads : threadCounts)
+        benchmark.run("ModifiableIntegerFunction::materialize/threads=" + std::to_string(threads), [&](size_t iterations) {
+            ModifiableIntegerFunction::setThreadCount(threads);
+            for (size_t i = 0; i < iterations; ++i)
+                Benchmark::keep(ModifiableIntegerFunction(expensiveFunction).isInjective());
+            ModifiableIntegerFunction::setThreadCount(0);
+        });
+
+    benchmark.run("ModifiableIntegerFunction::copy", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(ModifiableIntegerFunction(f));
+    });
+
+    benchmark.run("ModifiableIntegerFunction::operator+", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(ModifiableIntegerFunction(f + g));
+    });
+
+    benchmark.run("ModifiableIntegerFunction::operator*", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(ModifiableIntegerFunction(f * g));
+    });
+
+    // Fused into one pass, no tables for f + g or (f + g) * g
+    benchmark.run("ModifiableIntegerFunction::pipeline/(f+g)*g-f", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(ModifiableIntegerFunction((f + g) * g - f));
+    });
+
+    const size_t powers[] = { 2, 16, 1000000 };
+    for (size_t power : powers)
+        benchmark.run("ModifiableIntegerFunction::operator^/power=" + std::to_string(power), [&](size_t iterations) {
+            for (size_t i = 0; i < iterations; ++i)
+                Benchmark::keep(g ^ power);
+        });
+
+    std::vector<int16_t> samples(1 << 20), results(samples.size());
+    std::vector<uint8_t> validMask(samples.size() / 8);
+    for (size_t i = 0; i < samples.size(); ++i)
+        samples[i] = (int16_t)(i * 2654435761u);
+    benchmark.run("ModifiableIntegerFunction::invokeBatch/n=1048576", [&](size_t iterations) {
+        size_t defined = 0;
+        for (size_t i = 0; i < iterations; ++i)
+            defined += f.invokeBatch(samples.data(), results.data(), validMask.data(), samples.size());
+        Benchmark::keep(defined);
+    });
+
+    benchmark.run("IterationIndex::build", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(IterationIndex(f));
+    });
+
+    const IterationIndex index(g);
+    benchmark.run("IterationIndex::invoke", [&](size_t iterations) {
+        int16_t total = 0;
+        for (size_t i = 0; i < iterations; ++i)
+            total += index.invoke((int16_t)i, i * 2654435761u);
+        Benchmark::keep(total);
+    });
+
+    benchmark.run("ModifiableIntegerFunction::isSurjective", [&](size_t iterations) {
+        bool surjective = false;
+        for (size_t i = 0; i < iterations; ++i)
+            surjective ^= g.isSurjective();
+        Benchmark::keep(surjective);
+    });
+
+    // Different functions with cached hashes are told apart without a scan
+    benchmark.run("ModifiableIntegerFunction::operator==/different", [&](size_t iterations) {
+        bool equal = false;
+        for (size_t i = 0; i < iterations; ++i)
+            equal ^= f == g;
+        Benchmark::keep(equal);
+    });
+
+    FunctionRegistry registry;
+    registry.compose(f, g);
+    benchmark.run("FunctionRegistry::compose/memoized", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(registry.compose(f, g));
+    });
+
+    // Counts are kept up to date, so each query after a change is O(1)
+    benchmark.run("ModifiableIntegerFunction::setCustomResult+isBijective", [&](size_t iterations) {
+        ModifiableIntegerFunction edited(shiftFunction);
+        bool bijective = false;
+        for (size_t i = 0; i < iterations; ++i) {
+            edited.setCustomResult((int16_t)i, (int16_t)(i * 31));
+            bijective ^= edited.isBijective();
+        }
+        Benchmark::keep(bijective);
+    });
+
+    benchmark.run("ModifiableIntegerFunction::serialize", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            f.serialize(FILE_NAME);
+    });
+
+    benchmark.run("ModifiableIntegerFunction::deserialize", [&](size_t iterations) {
+        f.serialize(FILE_NAME);
+        ModifiableIntegerFunction loaded(doubleFunction);
+        for (size_t i = 0; i < iterations; ++i)
+            loaded.deserialize(FILE_NAME);
+        Benchmark::keep(loaded);
+    });
+
+    benchmark.run("ModifiableIntegerFunction::map", [&](size_t iterations) {
+        f.serializeRaw(FILE_NAME);
+        ModifiableIntegerFunction mapped;
+        for (size_t i = 0; i < iterations; ++i)
+            mapped.map(FILE_NAME);
+        Benchmark::keep(mapped);
+    });
+
+    // A 32-bit domain: the cost follows the number of pieces, here about 20000 each
+    PiecewiseIntegerFunction<int32_t> wideShift(1, 7), wideFlip(-1, 0);
+    for (int32_t i = 0; i < 10000; ++i) {
+        wideShift.setCustomResult((int32_t)(i * 400000LL - 2000000000LL), i);
+        wideFlip.disableRange(i * 200000, i * 200000 + 10);
+    }
+
+    benchmark.run("PiecewiseIntegerFunction<int32_t>::operator+", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(wideShift + wideFlip);
+    });
+
+    benchmark.run("PiecewiseIntegerFunction<int32_t>::operator*", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(wideShift * wideFlip);
+    });
+
+    benchmark.run("PiecewiseIntegerFunction<int32_t>::isInjective", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(wideFlip.isInjective());
+    });
+
+    std::remove(FILE_NAME);
+    return benchmark.report();
+}
@@ -0,0 +1,86 @@
+#include "Benchmark.h"
+#include "MultiSet.h"
+#include <cstdio>
+#include <random>
+
+static const char* const FILE_NAME = "bench_multiset.bin";
+
+static MultiSet randomSet(unsigned int n, unsigned int k, size_t additions, unsigned int seed) {
+    std::mt19937 random(seed);
+    MultiSet set(n, k);
+    for (size_t i = 0; i < additions; ++i)
+        set.add(1 + random() % n);
+    return set;
+}
+
+static void benchmarkSize(Benchmark& benchmark, unsigned int n, unsigned int k) {
+    const std::string suffix = "/n=" + std::to_string(n) + "/k=" + std::to_string(k);
+    const MultiSet a = randomSet(n, k, n / 2, 1);
+    const MultiSet b = randomSet(n, k, n / 2, 2);
+
+    benchmark.run("MultiSet::add" + suffix, [&](size_t iterations) {
+        MultiSet set(n, k);
+        for (size_t i = 0; i < iterations; ++i)
+            set.add(1 + (unsigned int)((i * 2654435761u) % n));
+        Benchmark::keep(set);
+    });
+
+    benchmark.run("MultiSet::occurrenceCount" + suffix, [&](size_t iterations) {
+        unsigned int total = 0;
+        for (size_t i = 0; i < iterations; ++i)
+            total += a.occurrenceCount(1 + (unsigned int)((i * 2654435761u) % n));
+        Benchmark::keep(total);
+    });
+
+    benchmark.run("MultiSet::intersection" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(a.intersection(b));
+    });
+
+    benchmark.run("MultiSet::difference" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(a.difference(b));
+    });
+
+    benchmark.run("MultiSet::unite" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(a.unite(b));
+    });
+
+    benchmark.run("MultiSet::fillInMultiSet" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            Benchmark::keep(a.fillInMultiSet());
+    });
+
+    benchmark.run("MultiSet::serialize" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            a.serialize(FILE_NAME);
+    });
+
+    benchmark.run("MultiSet::deserialize" + suffix, [&](size_t iterations) {
+        a.serialize(FILE_NAME);
+        MultiSet set;
+        for (size_t i = 0; i < iterations; ++i)
+            set.deserialize(FILE_NAME);
+        Benchmark::keep(set);
+    });
+
+    benchmark.run("MultiSet::serializeCompressed" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i)
+            a.serializeCompressed(FILE_NAME);
+    });
+
+    std::remove(FILE_NAME);
+}
+
+int main(int argc, char** argv) {
+    Benchmark benchmark(argc, argv);
+
+    const unsigned int sizes[] = { 1 << 10, 1 << 16, 1 << 22 };
+    const unsigned int bucketSizes[] = { 1, 3, 8 };
+    for (unsigned int n : sizes)
+        for (unsigned int k : bucketSizes)
+            benchmarkSize(benchmark, n, k);
+
+    return benchmark.report();
+}
@@ -0,0 +1,277 @@
+#pragma once
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Counters and latency histograms shared by both tasks. Events names what gets recorded:
+// it declares enum Counter ending in COUNTER_COUNT, enum Histogram ending in HISTOGRAM_COUNT
+// and static name() for both. Every Events type gets its own registry.
+// Each thread updates its own block with plain relaxed stores, a snapshot sums all blocks.
+template <typename Events>
+class InstrumentationRegistry : public Events {
+public:
+    typedef typename Events::Counter Counter;
+    typedef typename Events::Histogram Histogram;
+    static const size_t COUNTERS = Events::COUNTER_COUNT;
+    static const size_t HISTOGRAMS = Events::HISTOGRAM_COUNT;
+
+    static const size_t BUCKETS = 40; // bucket b holds latencies in [2^b, 2^(b + 1)) ns, bucket 0 also 0 ns
+    static const uint64_t SAMPLE_PERIOD = 64; // hot calls time one call in this many per thread
+
+    struct Snapshot {
+        uint64_t counters[COUNTERS];
+        uint64_t histograms[HISTOGRAMS][BUCKETS];
+    };
+
+    // Records the time from construction to destruction, when active
+    class ScopedTimer {
+        Histogram histogram;
+        bool active;
+        std::chrono::steady_clock::time_point start;
+    public:
+        explicit ScopedTimer(Histogram histogram, bool active = true);
+        ScopedTimer(const ScopedTimer& other) = delete;
+        ScopedTimer& operator= (const ScopedTimer& other) = delete;
+        ~ScopedTimer();
+    };
+
+    static void count(Counter counter, uint64_t amount = 1);
+    static bool countSampled(Counter counter); // counts one call, true for every SAMPLE_PERIOD-th
+    static void record(Histogram histogram, uint64_t nanoseconds);
+
+    static Snapshot snapshot(); // everything since the last reset, threads that exited included
+    static void reset();
+
+    static void writeText(std::ostream& out, const Snapshot& snapshot);
+    static void writeJson(std::ostream& out, const Snapshot& snapshot);
+
+    // Writes a snapshot to out every interval from a background thread until stopped.
+    // out has to outlive the dump; starting again replaces the running one.
+    static void startPeriodicDump(std::ostream& out, std::chrono::milliseconds interval, bool json);
+    static void stopPeriodicDump();
+
+private:
+    struct ThreadBlock {
+        std::atomic<uint64_t> counters[COUNTERS];
+        std::atomic<uint64_t> histograms[HISTOGRAMS][BUCKETS];
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<ThreadBlock*> live;
+        Snapshot retired; // totals of threads that exited
+        Snapshot baseline; // totals at the last reset
+
+        std::mutex dumpMutex;
+        std::condition_variable dumpSignal;
+        std::thread dumper;
+        bool dumping;
+    };
+
+    struct ThreadSlot {
+        ThreadBlock* block;
+
+        ThreadSlot();
+        ~ThreadSlot();
+    };
+
+    static Registry& registry();
+    static ThreadBlock& threadBlock();
+    static void bump(std::atomic<uint64_t>& value, uint64_t amount);
+    static void addBlock(Snapshot& total, const ThreadBlock& block);
+    static Snapshot totals(Registry& shared);
+    static uint64_t percentile(const uint64_t* buckets, double share);
+};
+
+// Never destroyed, so threads that exit during shutdown can still fold their block in
+template <typename Events>
+typename InstrumentationRegistry<Events>::Registry& InstrumentationRegistry<Events>::registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+template <typename Events>
+InstrumentationRegistry<Events>::ThreadSlot::ThreadSlot() : block(new ThreadBlock()) {
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.live.push_back(block);
+}
+
+template <typename Events>
+InstrumentationRegistry<Events>::ThreadSlot::~ThreadSlot() {
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    addBlock(shared.retired, *block);
+    for (size_t i = 0; i < shared.live.size(); ++i) {
+        if (shared.live[i] == block) {
+            shared.live[i] = shared.live.back();
+            shared.live.pop_back();
+            break;
+        }
+    }
+    delete block;
+}
+
+template <typename Events>
+typename InstrumentationRegistry<Events>::ThreadBlock& InstrumentationRegistry<Events>::threadBlock() {
+    thread_local ThreadSlot slot;
+    return *slot.block;
+}
+
+// Only the owning thread writes a block, so a load and a store are enough
+template <typename Events>
+void InstrumentationRegistry<Events>::bump(std::atomic<uint64_t>& value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+template <typename Events>
+void InstrumentationRegistry<Events>::addBlock(Snapshot& total, const ThreadBlock& block) {
+    for (size_t i = 0; i < COUNTERS; ++i)
+        total.counters[i] += block.counters[i].load(std::memory_order_relaxed);
+    for (size_t i = 0; i < HISTOGRAMS; ++i)
+        for (size_t b = 0; b < BUCKETS; ++b)
+            total.histograms[i][b] += block.histograms[i][b].load(std::memory_order_relaxed);
+}
+
+template <typename Events>
+typename InstrumentationRegistry<Events>::Snapshot InstrumentationRegistry<Events>::totals(Registry& shared) {
+    Snapshot total = shared.retired;
+    for (size_t i = 0; i < shared.live.size(); ++i)
+        addBlock(total, *shared.live[i]);
+    return total;
+}
+
+// Upper bound of the bucket holding the given share of the samples, 0 without samples
+template <typename Events>
+uint64_t InstrumentationRegistry<Events>::percentile(const uint64_t* buckets, double share) {
+    uint64_t samples = 0;
+    for (size_t b = 0; b < BUCKETS; ++b)
+        samples += buckets[b];
+    if (!samples) return 0;
+
+    const uint64_t wanted = (uint64_t)(share * samples + 0.5);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKETS; ++b) {
+        seen += buckets[b];
+        if (seen >= wanted && seen) return (uint64_t)1 << (b + 1);
+    }
+    return (uint64_t)1 << BUCKETS;
+}
+
+template <typename Events>
+InstrumentationRegistry<Events>::ScopedTimer::ScopedTimer(Histogram histogram, bool active)
+        : histogram(histogram), active(active) {
+    if (active) start = std::chrono::steady_clock::now();
+}
+
+template <typename Events>
+InstrumentationRegistry<Events>::ScopedTimer::~ScopedTimer() {
+    if (!active) return;
+    const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+    record(histogram, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+template <typename Events>
+void InstrumentationRegistry<Events>::count(Counter counter, uint64_t amount) {
+    bump(threadBlock().counters[counter], amount);
+}
+
+template <typename Events>
+bool InstrumentationRegistry<Events>::countSampled(Counter counter) {
+    std::atomic<uint64_t>& calls = threadBlock().counters[counter];
+    const uint64_t previous = calls.load(std::memory_order_relaxed);
+    calls.store(previous + 1, std::memory_order_relaxed);
+    return previous % SAMPLE_PERIOD == 0;
+}
+
+template <typename Events>
+void InstrumentationRegistry<Events>::record(Histogram histogram, uint64_t nanoseconds) {
+    size_t bucket = 0;
+    while (nanoseconds >>= 1) ++bucket;
+    if (bucket >= BUCKETS) bucket = BUCKETS - 1;
+    bump(threadBlock().histograms[histogram][bucket], 1);
+}
+
+template <typename Events>
+typename InstrumentationRegistry<Events>::Snapshot InstrumentationRegistry<Events>::snapshot() {
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    Snapshot result = totals(shared);
+    for (size_t i = 0; i < COUNTERS; ++i)
+        result.counters[i] -= shared.baseline.counters[i];
+    for (size_t i = 0; i < HISTOGRAMS; ++i)
+        for (size_t b = 0; b < BUCKETS; ++b)
+            result.histograms[i][b] -= shared.baseline.histograms[i][b];
+    return result;
+}
+
+// Blocks are never written by other threads, so reset moves the baseline instead
+template <typename Events>
+void InstrumentationRegistry<Events>::reset() {
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.baseline = totals(shared);
+}
+
+template <typename Events>
+void InstrumentationRegistry<Events>::writeText(std::ostream& out, const Snapshot& snapshot) {
+    for (size_t i = 0; i < COUNTERS; ++i)
+        out << Events::name((Counter)i) << ' ' << snapshot.counters[i] << '\n';
+    for (size_t i = 0; i < HISTOGRAMS; ++i) {
+        uint64_t samples = 0;
+        for (size_t b = 0; b < BUCKETS; ++b)
+            samples += snapshot.histograms[i][b];
+        out << Events::name((Histogram)i) << " samples=" << samples
+            << " p50<" << percentile(snapshot.histograms[i], 0.5)
+            << " p99<" << percentile(snapshot.histograms[i], 0.99) << '\n';
+    }
+}
+
+template <typename Events>
+void InstrumentationRegistry<Events>::writeJson(std::ostream& out, const Snapshot& snapshot) {
+    out << "{\"counters\":{";
+    for (size_t i = 0; i < COUNTERS; ++i)
+        out << (i ? "," : "") << '"' << Events::name((Counter)i) << "\":" << snapshot.counters[i];
+    out << "},\"histograms\":{";
+    for (size_t i = 0; i < HISTOGRAMS; ++i) {
+        out << (i ? "," : "") << '"' << Events::name((Histogram)i) << "\":[";
+        for (size_t b = 0; b < BUCKETS; ++b)
+            out << (b ? "," : "") << snapshot.histograms[i][b];
+        out << ']';
+    }
+    out << "}}\n";
+}
+
+template <typename Events>
+void InstrumentationRegistry<Events>::startPeriodicDump(std::ostream& out, std::chrono::milliseconds interval,
+                                                        bool json) {
+    stopPeriodicDump();
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.dumpMutex);
+    shared.dumping = true;
+    shared.dumper = std::thread([&out, interval, json, &shared] {
+        std::unique_lock<std::mutex> dumpLock(shared.dumpMutex);
+        while (!shared.dumpSignal.wait_for(dumpLock, interval, [&shared] { return !shared.dumping; })) {
+            const Snapshot current = snapshot();
+            if (json) writeJson(out, current);
+            else writeText(out, current);
+            out.flush();
+        }
+    });
+}
+
+template <typename Events>
+void InstrumentationRegistry<Events>::stopPeriodicDump() {
+    Registry& shared = registry();
+    {
+        std::lock_guard<std::mutex> lock(shared.dumpMutex);
+        if (!shared.dumper.joinable()) return;
+        shared.dumping = false;
+    }
+    shared.dumpSignal.notify_all();
+    shared.dumper.join();
+}
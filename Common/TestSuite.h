@@ -0,0 +1,61 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <exception>
+
+// Minimal test runner shared by the MultiSet and ModifiableIntegerFunction suites.
+// A test body checks its conditions with CHECK, which records the failing expression
+// and keeps going; an exception escaping the body fails the test as well.
+class TestSuite {
+public:
+    typedef std::function<void()> Body;
+
+    // Understands --filter <substring>
+    TestSuite(int argc, char** argv) {
+        for (int i = 1; i + 1 < argc; ++i)
+            if (std::string(argv[i]) == "--filter") filter = argv[++i];
+    }
+
+    void run(const std::string& name, const Body& body) {
+        if (name.find(filter) == std::string::npos) return;
+        const size_t before = failures();
+        try {
+            body();
+        }
+        catch (const std::exception& error) {
+            fail(error.what(), name.c_str(), 0);
+        }
+        catch (...) {
+            fail("unknown exception", name.c_str(), 0);
+        }
+        const bool passed = failures() == before;
+        std::cout << (passed ? "PASS " : "FAIL ") << name << std::endl;
+        if (!passed) failed.push_back(name);
+        ++ran;
+    }
+
+    // Prints the summary, returns the exit code
+    int report() const {
+        std::cout << ran - failed.size() << '/' << ran << " tests passed" << std::endl;
+        return failed.empty() ? 0 : 1;
+    }
+
+    static void fail(const char* what, const char* where, int line) {
+        std::cout << "  " << where << ':' << line << ": " << what << std::endl;
+        ++failures();
+    }
+
+private:
+    static size_t& failures() {
+        static size_t count = 0;
+        return count;
+    }
+
+    std::string filter;
+    std::vector<std::string> failed;
+    size_t ran = 0;
+};
+
+#define CHECK(condition) ((condition) ? (void)0 : TestSuite::fail(#condition, __FILE__, __LINE__))
@@ -0,0 +1,109 @@
+#include "ThreadPool.h"
+#include <exception>
+
+ThreadPool::ThreadPool(size_t threads) : stopping(false) {
+    for (size_t i = 0; i < threads; ++i)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+
+void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+bool ThreadPool::runPendingTask() {
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.empty()) return false;
+        task = std::move(tasks.front());
+        tasks.pop();
+    }
+    task();
+    return true;
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t, size_t)>& body) {
+    size_t parts = workers.size() + 1;
+    if (parts > count) parts = count;
+    if (parts <= 1) {
+        if (count) body(0, count);
+        return;
+    }
+
+    std::mutex doneMutex;
+    std::condition_variable doneSignal;
+    size_t remaining = parts - 1;
+    std::exception_ptr failure; // the first exception of any range
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t part = 1; part < parts; ++part) {
+            const size_t begin = count * part / parts, end = count * (part + 1) / parts;
+            tasks.push([&, begin, end] {
+                std::exception_ptr error;
+                try {
+                    body(begin, end);
+                }
+                catch (...) {
+                    error = std::current_exception();
+                }
+                std::lock_guard<std::mutex> doneLock(doneMutex);
+                if (error && !failure) failure = error;
+                if (--remaining == 0) doneSignal.notify_one();
+            });
+        }
+    }
+    available.notify_all();
+
+    try {
+        body(0, count / parts);
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (!failure) failure = std::current_exception();
+    }
+
+    // Help with queued work instead of blocking, so nested calls cannot starve the pool.
+    // The queued ranges refer to this frame, so even a failed call waits for all of them.
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (remaining == 0) break;
+        }
+        if (!runPendingTask()) {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            doneSignal.wait(lock, [&] { return remaining == 0; });
+            break;
+        }
+    }
+    if (failure) std::rethrow_exception(failure);
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+    return pool;
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads for splitting one loop into contiguous ranges.
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping;
+
+    void work();
+    bool runPendingTask();
+public:
+    explicit ThreadPool(size_t threads);
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool& operator= (const ThreadPool& other) = delete;
+
+    size_t size() const; // worker threads, the caller of parallelFor works too
+
+    // Splits [0, count) into at most size() + 1 contiguous ranges, runs body(begin, end)
+    // on each and returns when all of them are done. If body throws, the other ranges
+    // still finish and the first exception is rethrown here.
+    void parallelFor(size_t count, const std::function<void(size_t, size_t)>& body);
+
+    static ThreadPool& shared(); // one worker per hardware thread beyond the caller
+
+    ~ThreadPool();
+};
@@ -0,0 +1,517 @@
+#include "AdaptiveMultiSet.h"
+#include "PackedKernels.h"
+#include <fstream>
+#include <exception>
+#include <cstring>
+#include <utility>
+
+const size_t AdaptiveMultiSet::CHUNK_SIZE = 1 << 16;
+
+struct AdaptiveFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t endianness;
+    uint32_t bucketSize;
+    uint64_t maxNumber;
+    uint64_t chunkCount;
+};
+
+static const char ADAPTIVE_FILE_MAGIC[4] = {'M', 'S', 'A', 'D'};
+static const uint16_t ADAPTIVE_FILE_VERSION = 1;
+static const uint32_t ADAPTIVE_ENDIANNESS_TAG = 0x01020304;
+
+static uint8_t saturatingAdd(uint8_t current, unsigned int count, uint8_t maxCount) {
+    return count >= (unsigned int)(maxCount - current) ? maxCount : (uint8_t)(current + count);
+}
+
+static uint8_t absoluteDifference(uint8_t a, uint8_t b) {
+    return a > b ? a - b : b - a;
+}
+
+AdaptiveMultiSet::AdaptiveMultiSet() : chunks(nullptr), chunkCount(0), bucketSize(0), maxNumber(0) {}
+
+AdaptiveMultiSet::AdaptiveMultiSet(unsigned int n, unsigned int k) : maxNumber(n) {
+    if(k < 1 || k > 8) throw std::out_of_range("K out of bounds!");
+    bucketSize = k;
+    allocateChunks();
+}
+
+AdaptiveMultiSet::AdaptiveMultiSet(const AdaptiveMultiSet& other) {
+    copyFrom(other);
+}
+
+AdaptiveMultiSet& AdaptiveMultiSet::operator=(const AdaptiveMultiSet& other) {
+    if(this != &other){
+        free();
+        copyFrom(other);
+    }
+    return *this;
+}
+
+AdaptiveMultiSet::AdaptiveMultiSet(AdaptiveMultiSet&& other) noexcept {
+    moveFrom(std::move(other));
+}
+
+AdaptiveMultiSet& AdaptiveMultiSet::operator=(AdaptiveMultiSet&& other) noexcept {
+    if(this != &other){
+        free();
+        moveFrom(std::move(other));
+    }
+    return *this;
+}
+
+void AdaptiveMultiSet::moveFrom(AdaptiveMultiSet&& other) {
+    chunks = other.chunks;
+    chunkCount = other.chunkCount;
+    bucketSize = other.bucketSize;
+    maxNumber = other.maxNumber;
+
+    other.chunks = nullptr;
+    other.chunkCount = 0;
+    other.bucketSize = 0;
+    other.maxNumber = 0;
+}
+
+void AdaptiveMultiSet::copyFrom(const AdaptiveMultiSet& other) {
+    bucketSize = other.bucketSize;
+    maxNumber = other.maxNumber;
+    allocateChunks();
+    for (size_t i = 0; i < chunkCount; ++i)
+        copyChunk(chunks[i], other.chunks[i], i);
+}
+
+void AdaptiveMultiSet::free() {
+    for (size_t i = 0; i < chunkCount; ++i)
+        clearChunk(chunks[i]);
+    delete[] chunks;
+    chunks = nullptr;
+    chunkCount = 0;
+    maxNumber = 0;
+    bucketSize = 0;
+}
+
+void AdaptiveMultiSet::allocateChunks() {
+    chunkCount = ((size_t)maxNumber + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunks = new Chunk[chunkCount](); // every chunk starts EMPTY
+}
+
+uint8_t AdaptiveMultiSet::getMaxCount() const {
+    return (uint8_t)((1u << bucketSize) - 1);
+}
+
+size_t AdaptiveMultiSet::chunkLength(size_t chunkIndex) const {
+    const size_t first = chunkIndex * CHUNK_SIZE;
+    return maxNumber - first < CHUNK_SIZE ? maxNumber - first : CHUNK_SIZE;
+}
+
+size_t AdaptiveMultiSet::denseSize(size_t chunkIndex) const {
+    return PackedKernels::bufferSize(chunkLength(chunkIndex), bucketSize);
+}
+
+size_t AdaptiveMultiSet::sparseLimit(size_t chunkIndex) const {
+    // A sparse entry takes 3 bytes, past this point the dense layout is smaller
+    return denseSize(chunkIndex) / (sizeof(uint16_t) + sizeof(uint8_t));
+}
+
+void AdaptiveMultiSet::clearChunk(Chunk& chunk) {
+    delete[] chunk.offsets;
+    delete[] chunk.counts;
+    delete[] chunk.counters;
+    chunk = Chunk();
+}
+
+void AdaptiveMultiSet::reserveSparse(Chunk& chunk, uint32_t capacity) {
+    if (capacity <= chunk.capacity) return;
+
+    uint16_t* offsets = new uint16_t[capacity];
+    uint8_t* counts = new uint8_t[capacity];
+    if (chunk.size) {
+        std::memcpy(offsets, chunk.offsets, chunk.size * sizeof(uint16_t));
+        std::memcpy(counts, chunk.counts, chunk.size * sizeof(uint8_t));
+    }
+    delete[] chunk.offsets;
+    delete[] chunk.counts;
+    chunk.offsets = offsets;
+    chunk.counts = counts;
+    chunk.capacity = capacity;
+}
+
+void AdaptiveMultiSet::appendSparse(Chunk& chunk, uint16_t offset, uint8_t count) {
+    if (chunk.size == chunk.capacity)
+        reserveSparse(chunk, chunk.capacity ? chunk.capacity * 2 : 4);
+    chunk.offsets[chunk.size] = offset;
+    chunk.counts[chunk.size] = count;
+    ++chunk.size;
+    chunk.kind = SPARSE;
+}
+
+bool AdaptiveMultiSet::findSparse(const Chunk& chunk, uint16_t offset, uint32_t& position) {
+    uint32_t low = 0, high = chunk.size;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (chunk.offsets[middle] < offset) low = middle + 1;
+        else high = middle;
+    }
+    position = low;
+    return low < chunk.size && chunk.offsets[low] == offset;
+}
+
+uint8_t AdaptiveMultiSet::countInChunk(const Chunk& chunk, uint16_t offset, unsigned int bucketSize) {
+    if (chunk.kind == DENSE)
+        return PackedKernels::counterAt(chunk.counters, offset, bucketSize);
+
+    uint32_t position;
+    return chunk.kind == SPARSE && findSparse(chunk, offset, position) ? chunk.counts[position] : 0;
+}
+
+void AdaptiveMultiSet::copyChunk(Chunk& destination, const Chunk& source, size_t chunkIndex) const {
+    clearChunk(destination);
+    if (source.kind == SPARSE) {
+        reserveSparse(destination, source.size);
+        std::memcpy(destination.offsets, source.offsets, source.size * sizeof(uint16_t));
+        std::memcpy(destination.counts, source.counts, source.size * sizeof(uint8_t));
+        destination.size = source.size;
+    }
+    else if (source.kind == DENSE) {
+        const size_t size = denseSize(chunkIndex);
+        destination.counters = new uint8_t[size];
+        std::memcpy(destination.counters, source.counters, size);
+    }
+    destination.kind = source.kind;
+}
+
+void AdaptiveMultiSet::makeDense(size_t chunkIndex) {
+    Chunk& chunk = chunks[chunkIndex];
+    uint8_t* counters = new uint8_t[denseSize(chunkIndex)]();
+    for (uint32_t i = 0; i < chunk.size; ++i)
+        PackedKernels::setCounter(counters, chunk.offsets[i], bucketSize, chunk.counts[i]);
+
+    clearChunk(chunk);
+    chunk.counters = counters;
+    chunk.kind = DENSE;
+}
+
+void AdaptiveMultiSet::normalize(size_t chunkIndex) {
+    Chunk& chunk = chunks[chunkIndex];
+    if (chunk.kind == SPARSE && chunk.size == 0) {
+        clearChunk(chunk);
+        return;
+    }
+    if (chunk.kind != DENSE) return;
+
+    const size_t length = chunkLength(chunkIndex);
+    const size_t nonZero = PackedKernels::countNonZero(chunk.counters, length, bucketSize);
+    if (nonZero > sparseLimit(chunkIndex)) return;
+
+    Chunk sparse = Chunk();
+    reserveSparse(sparse, (uint32_t)nonZero);
+    for (size_t offset = PackedKernels::nextNonZero(chunk.counters, length, 0, bucketSize); offset < length;
+         offset = PackedKernels::nextNonZero(chunk.counters, length, offset + 1, bucketSize))
+        appendSparse(sparse, (uint16_t)offset, PackedKernels::counterAt(chunk.counters, offset, bucketSize));
+
+    clearChunk(chunk);
+    chunk = sparse;
+}
+
+void AdaptiveMultiSet::add(unsigned int number) {
+    add(number, 1);
+}
+
+void AdaptiveMultiSet::add(unsigned int number, unsigned int count) {
+    if(number < 1 || number > maxNumber) throw std::out_of_range("Out of bounds!");
+    if(count == 0) return;
+
+    const size_t chunkIndex = (number - 1) / CHUNK_SIZE;
+    const uint16_t offset = (uint16_t)((number - 1) % CHUNK_SIZE);
+    const uint8_t maxCount = getMaxCount();
+    Chunk& chunk = chunks[chunkIndex];
+
+    if (chunk.kind == DENSE) {
+        PackedKernels::addToCounter(chunk.counters, offset, bucketSize, count);
+        return;
+    }
+
+    uint32_t position;
+    if (findSparse(chunk, offset, position)) {
+        chunk.counts[position] = saturatingAdd(chunk.counts[position], count, maxCount);
+        return;
+    }
+
+    if (chunk.size + 1 > sparseLimit(chunkIndex)) {
+        makeDense(chunkIndex);
+        PackedKernels::addToCounter(chunk.counters, offset, bucketSize, count);
+        return;
+    }
+
+    if (chunk.size == chunk.capacity)
+        reserveSparse(chunk, chunk.capacity ? chunk.capacity * 2 : 4);
+    std::memmove(chunk.offsets + position + 1, chunk.offsets + position, (chunk.size - position) * sizeof(uint16_t));
+    std::memmove(chunk.counts + position + 1, chunk.counts + position, (chunk.size - position) * sizeof(uint8_t));
+    chunk.offsets[position] = offset;
+    chunk.counts[position] = saturatingAdd(0, count, maxCount);
+    ++chunk.size;
+    chunk.kind = SPARSE;
+}
+
+uint8_t AdaptiveMultiSet::occurrenceCount(unsigned int number) const {
+    if(number < 1 || number > maxNumber) return 0;
+    return countInChunk(chunks[(number - 1) / CHUNK_SIZE], (uint16_t)((number - 1) % CHUNK_SIZE), bucketSize);
+}
+
+void AdaptiveMultiSet::printNumbers() const {
+    for (size_t i = 0; i < chunkCount; ++i) {
+        const Chunk& chunk = chunks[i];
+        const size_t first = i * CHUNK_SIZE + 1;
+
+        if (chunk.kind == SPARSE) {
+            for (uint32_t j = 0; j < chunk.size; ++j)
+                std::cout << first + chunk.offsets[j] << " occurs " << (int)chunk.counts[j] << " times." << std::endl;
+        }
+        else if (chunk.kind == DENSE) {
+            const size_t length = chunkLength(i);
+            for (size_t offset = PackedKernels::nextNonZero(chunk.counters, length, 0, bucketSize); offset < length;
+                 offset = PackedKernels::nextNonZero(chunk.counters, length, offset + 1, bucketSize)) {
+                uint8_t occurrences = PackedKernels::counterAt(chunk.counters, offset, bucketSize);
+                std::cout << first + offset << " occurs " << (int)occurrences << " times." << std::endl;
+            }
+        }
+    }
+}
+
+size_t AdaptiveMultiSet::memoryUsage() const {
+    size_t bytes = chunkCount * sizeof(Chunk);
+    for (size_t i = 0; i < chunkCount; ++i) {
+        if (chunks[i].kind == SPARSE)
+            bytes += chunks[i].capacity * (sizeof(uint16_t) + sizeof(uint8_t));
+        else if (chunks[i].kind == DENSE)
+            bytes += denseSize(i);
+    }
+    return bytes;
+}
+
+void AdaptiveMultiSet::serialize(const char* fileName) const {
+    std::ofstream file(fileName, std::ios::binary);
+    if(!file){
+        std::cout<<"Error opening output file!\n";
+        return;
+    }
+
+    AdaptiveFileHeader header = {};
+    std::memcpy(header.magic, ADAPTIVE_FILE_MAGIC, sizeof(ADAPTIVE_FILE_MAGIC));
+    header.version = ADAPTIVE_FILE_VERSION;
+    header.headerSize = sizeof(AdaptiveFileHeader);
+    header.endianness = ADAPTIVE_ENDIANNESS_TAG;
+    header.bucketSize = (uint32_t) bucketSize;
+    header.maxNumber = maxNumber;
+    header.chunkCount = chunkCount;
+    file.write((const char*) &header, sizeof(AdaptiveFileHeader));
+
+    // Every chunk is written in its own representation: a kind byte,
+    // then nothing, the sparse entries or the packed counters
+    for (size_t i = 0; i < chunkCount; ++i) {
+        const Chunk& chunk = chunks[i];
+        file.write((const char*) &chunk.kind, sizeof(uint8_t));
+        if (chunk.kind == SPARSE) {
+            file.write((const char*) &chunk.size, sizeof(uint32_t));
+            file.write((const char*) chunk.offsets, chunk.size * sizeof(uint16_t));
+            file.write((const char*) chunk.counts, chunk.size * sizeof(uint8_t));
+        }
+        else if (chunk.kind == DENSE) {
+            file.write((const char*) chunk.counters, denseSize(i));
+        }
+    }
+    file.close();
+}
+
+void AdaptiveMultiSet::deserialize(const char* fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    if(!file){
+        std::cout<<"Error opening input file!\n";
+        return;
+    }
+
+    AdaptiveFileHeader header;
+    // Sparse offsets are stored in the writer's byte order, so foreign files are rejected
+    if(!file.read((char*) &header, sizeof(AdaptiveFileHeader)) ||
+       std::memcmp(header.magic, ADAPTIVE_FILE_MAGIC, sizeof(ADAPTIVE_FILE_MAGIC)) != 0 ||
+       header.version != ADAPTIVE_FILE_VERSION || header.endianness != ADAPTIVE_ENDIANNESS_TAG ||
+       header.bucketSize < 1 || header.bucketSize > 8 || header.maxNumber > UINT32_MAX ||
+       header.chunkCount != (header.maxNumber + CHUNK_SIZE - 1) / CHUNK_SIZE){
+        std::cout<<"Invalid MultiSet file!\n";
+        return;
+    }
+
+    free();
+    maxNumber = (unsigned int) header.maxNumber;
+    bucketSize = header.bucketSize;
+    allocateChunks();
+
+    for (size_t i = 0; i < chunkCount && file; ++i) {
+        Chunk& chunk = chunks[i];
+        uint8_t kind = EMPTY;
+        file.read((char*) &kind, sizeof(uint8_t));
+
+        if (kind == SPARSE) {
+            uint32_t size = 0;
+            file.read((char*) &size, sizeof(uint32_t));
+            if (!file || size == 0 || size > chunkLength(i)) {
+                file.setstate(std::ios::failbit);
+                break;
+            }
+            reserveSparse(chunk, size);
+            file.read((char*) chunk.offsets, size * sizeof(uint16_t));
+            file.read((char*) chunk.counts, size * sizeof(uint8_t));
+            chunk.size = size;
+            chunk.kind = SPARSE;
+
+            // Lookups binary search the offsets and promotion writes a counter per offset,
+            // so they have to be sorted, unique and inside the chunk with counts that fit k bits
+            for (uint32_t entry = 0; entry < size && file; ++entry) {
+                if ((entry > 0 && chunk.offsets[entry] <= chunk.offsets[entry - 1]) ||
+                    chunk.offsets[entry] >= chunkLength(i) ||
+                    chunk.counts[entry] == 0 || chunk.counts[entry] > getMaxCount())
+                    file.setstate(std::ios::failbit);
+            }
+        }
+        else if (kind == DENSE) {
+            chunk.counters = new uint8_t[denseSize(i)];
+            chunk.kind = DENSE;
+            file.read((char*) chunk.counters, denseSize(i));
+        }
+        else if (kind != EMPTY) {
+            file.setstate(std::ios::failbit);
+        }
+    }
+
+    if(!file){
+        std::cout<<"Corrupted MultiSet file!\n";
+        free();
+    }
+}
+
+void AdaptiveMultiSet::intersectChunks(Chunk& result, const Chunk& a, size_t aLength,
+                                       const Chunk& b, size_t bLength, size_t length) const {
+    if (a.kind == EMPTY || b.kind == EMPTY) return;
+
+    if (a.kind == DENSE && b.kind == DENSE) {
+        result.counters = new uint8_t[PackedKernels::bufferSize(length, bucketSize)];
+        result.kind = DENSE;
+        PackedKernels::intersection(a.counters, aLength, b.counters, bLength, result.counters, length, bucketSize);
+        return;
+    }
+
+    if (a.kind == SPARSE && b.kind == SPARSE) {
+        uint32_t i = 0, j = 0;
+        while (i < a.size && j < b.size) {
+            if (a.offsets[i] < b.offsets[j]) ++i;
+            else if (a.offsets[i] > b.offsets[j]) ++j;
+            else {
+                if (a.offsets[i] < length)
+                    appendSparse(result, a.offsets[i], a.counts[i] < b.counts[j] ? a.counts[i] : b.counts[j]);
+                ++i;
+                ++j;
+            }
+        }
+        return;
+    }
+
+    // One sparse, one dense: only the sparse entries can survive
+    const Chunk& sparse = a.kind == SPARSE ? a : b;
+    const Chunk& dense = a.kind == SPARSE ? b : a;
+    const size_t denseLength = a.kind == SPARSE ? bLength : aLength;
+    for (uint32_t i = 0; i < sparse.size && sparse.offsets[i] < length; ++i) {
+        if (sparse.offsets[i] >= denseLength) break;
+        uint8_t other = PackedKernels::counterAt(dense.counters, sparse.offsets[i], bucketSize);
+        uint8_t count = sparse.counts[i] < other ? sparse.counts[i] : other;
+        if (count) appendSparse(result, sparse.offsets[i], count);
+    }
+}
+
+void AdaptiveMultiSet::subtractChunks(Chunk& result, const Chunk& a, size_t aLength,
+                                      const Chunk& b, size_t bLength, size_t length) const {
+    if (a.kind != SPARSE && b.kind != SPARSE) {
+        if (a.kind == EMPTY && b.kind == EMPTY) return;
+        // An empty side reads as all zeroes
+        result.counters = new uint8_t[PackedKernels::bufferSize(length, bucketSize)];
+        result.kind = DENSE;
+        PackedKernels::difference(a.counters, a.kind == DENSE ? aLength : 0, b.counters, b.kind == DENSE ? bLength : 0,
+                                  result.counters, length, bucketSize);
+        return;
+    }
+
+    if (a.kind != DENSE && b.kind != DENSE) {
+        // Sparse against sparse or empty: merge the sorted entries
+        const uint32_t aSize = a.kind == SPARSE ? a.size : 0;
+        const uint32_t bSize = b.kind == SPARSE ? b.size : 0;
+        uint32_t i = 0, j = 0;
+        while (i < aSize || j < bSize) {
+            if (j == bSize || (i < aSize && a.offsets[i] < b.offsets[j])) {
+                appendSparse(result, a.offsets[i], a.counts[i]);
+                ++i;
+            }
+            else if (i == aSize || b.offsets[j] < a.offsets[i]) {
+                appendSparse(result, b.offsets[j], b.counts[j]);
+                ++j;
+            }
+            else {
+                uint8_t count = absoluteDifference(a.counts[i], b.counts[j]);
+                if (count) appendSparse(result, a.offsets[i], count);
+                ++i;
+                ++j;
+            }
+        }
+        return;
+    }
+
+    // One sparse, one dense: start from the dense counters and patch in the sparse entries
+    const Chunk& sparse = a.kind == SPARSE ? a : b;
+    const Chunk& dense = a.kind == SPARSE ? b : a;
+    const size_t denseLength = a.kind == SPARSE ? bLength : aLength;
+    result.counters = new uint8_t[PackedKernels::bufferSize(length, bucketSize)];
+    result.kind = DENSE;
+    PackedKernels::difference(dense.counters, denseLength, nullptr, 0, result.counters, length, bucketSize);
+    for (uint32_t i = 0; i < sparse.size; ++i) {
+        uint8_t current = PackedKernels::counterAt(result.counters, sparse.offsets[i], bucketSize);
+        PackedKernels::setCounter(result.counters, sparse.offsets[i], bucketSize, absoluteDifference(current, sparse.counts[i]));
+    }
+}
+
+AdaptiveMultiSet AdaptiveMultiSet::intersection(const AdaptiveMultiSet& other) const {
+    if(bucketSize != other.bucketSize)
+        throw std::invalid_argument("Incompatible Set!");
+
+    unsigned int minMaxNumber = maxNumber > other.maxNumber ? other.maxNumber : maxNumber;
+    AdaptiveMultiSet intersection(minMaxNumber, bucketSize);
+
+    for (size_t i = 0; i < intersection.chunkCount; ++i) {
+        intersectChunks(intersection.chunks[i], chunks[i], chunkLength(i),
+                        other.chunks[i], other.chunkLength(i), intersection.chunkLength(i));
+        intersection.normalize(i);
+    }
+
+    return intersection;
+}
+
+AdaptiveMultiSet AdaptiveMultiSet::difference(const AdaptiveMultiSet& other) const {
+    if(bucketSize != other.bucketSize)
+        throw std::invalid_argument("Incompatible Set!");
+
+    unsigned int maxMaxNumber = maxNumber < other.maxNumber ? other.maxNumber : maxNumber;
+    AdaptiveMultiSet difference(maxMaxNumber, bucketSize);
+    const Chunk empty = Chunk();
+
+    for (size_t i = 0; i < difference.chunkCount; ++i) {
+        const bool inThis = i < chunkCount, inOther = i < other.chunkCount;
+        subtractChunks(difference.chunks[i], inThis ? chunks[i] : empty, inThis ? chunkLength(i) : 0,
+                       inOther ? other.chunks[i] : empty, inOther ? other.chunkLength(i) : 0,
+                       difference.chunkLength(i));
+        difference.normalize(i);
+    }
+
+    return difference;
+}
+
+AdaptiveMultiSet::~AdaptiveMultiSet() {
+    free();
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <iostream>
+
+// Multiset over [1, n] for very large n with few distinct values.
+// The range is split into chunks of CHUNK_SIZE numbers and every chunk is stored
+// as empty, as a sorted (offset, count) list or as the dense k-bit layout of MultiSet,
+// whichever is smaller for the number of distinct values it holds.
+class AdaptiveMultiSet {
+    static const size_t CHUNK_SIZE;
+
+    enum ChunkKind : uint8_t { EMPTY, SPARSE, DENSE };
+
+    struct Chunk {
+        ChunkKind kind;
+        uint32_t size; // number of entries in a sparse chunk
+        uint32_t capacity;
+        uint16_t* offsets;
+        uint8_t* counts;
+        uint8_t* counters; // packed counters of a dense chunk
+    };
+
+    Chunk* chunks;
+    size_t chunkCount;
+    size_t bucketSize;
+    unsigned int maxNumber;
+
+    void copyFrom(const AdaptiveMultiSet& other);
+    void moveFrom(AdaptiveMultiSet&& other);
+    void free();
+    void allocateChunks();
+
+    uint8_t getMaxCount() const;
+    size_t chunkLength(size_t chunkIndex) const;
+    size_t denseSize(size_t chunkIndex) const;
+    size_t sparseLimit(size_t chunkIndex) const;
+
+    static void clearChunk(Chunk& chunk);
+    static void reserveSparse(Chunk& chunk, uint32_t capacity);
+    static void appendSparse(Chunk& chunk, uint16_t offset, uint8_t count);
+    static bool findSparse(const Chunk& chunk, uint16_t offset, uint32_t& position);
+    static uint8_t countInChunk(const Chunk& chunk, uint16_t offset, unsigned int bucketSize);
+
+    void copyChunk(Chunk& destination, const Chunk& source, size_t chunkIndex) const;
+    void makeDense(size_t chunkIndex);
+    void normalize(size_t chunkIndex);
+
+    void intersectChunks(Chunk& result, const Chunk& a, size_t aLength, const Chunk& b, size_t bLength, size_t length) const;
+    void subtractChunks(Chunk& result, const Chunk& a, size_t aLength, const Chunk& b, size_t bLength, size_t length) const;
+public:
+    AdaptiveMultiSet();
+    AdaptiveMultiSet(unsigned int n, unsigned int k);
+    AdaptiveMultiSet(const AdaptiveMultiSet& other);
+    AdaptiveMultiSet& operator= (const AdaptiveMultiSet& other);
+    AdaptiveMultiSet(AdaptiveMultiSet&& other) noexcept;
+    AdaptiveMultiSet& operator= (AdaptiveMultiSet&& other) noexcept;
+
+    void add(unsigned int number);
+    void add(unsigned int number, unsigned int count);
+    uint8_t occurrenceCount(unsigned int number) const;
+
+    void printNumbers() const;
+    size_t memoryUsage() const; // bytes held by the chunks
+
+    void serialize(const char* fileName) const; // out
+    void deserialize(const char* fileName); // in
+
+    AdaptiveMultiSet intersection(const AdaptiveMultiSet& other) const;
+    AdaptiveMultiSet difference(const AdaptiveMultiSet& other) const;
+
+    ~AdaptiveMultiSet();
+};
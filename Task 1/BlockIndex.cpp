@@ -0,0 +1,114 @@
+#include "BlockIndex.h"
+#include "PackedKernels.h"
+
+const size_t BlockIndex::BLOCK_SIZE = 64;
+
+size_t BlockIndex::blockCountOf(size_t count) {
+    return (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+BlockIndex::BlockIndex(const uint8_t* buffer, size_t count, unsigned int bucketSize) : total(0) {
+    blockCount = blockCountOf(count);
+    tree = new uint64_t[blockCount + 1]();
+
+    // Linear-time construction: every node pushes its sum to its parent
+    for (size_t i = 1; i <= blockCount; ++i) {
+        const uint64_t sum = PackedKernels::sumRange(buffer, count, (i - 1) * BLOCK_SIZE, i * BLOCK_SIZE, bucketSize);
+        total += sum;
+        tree[i] += sum;
+        const size_t parent = i + (i & (0 - i));
+        if (parent <= blockCount)
+            tree[parent] += tree[i];
+    }
+}
+
+BlockIndex::BlockIndex(const uint64_t* blockSums, size_t blockCount) : blockCount(blockCount) {
+    tree = new uint64_t[blockCount + 1]();
+    build(blockSums);
+}
+
+void BlockIndex::rebuild(const uint64_t* blockSums, size_t blockCount) {
+    if (blockCount != this->blockCount) {
+        delete[] tree;
+        tree = new uint64_t[blockCount + 1];
+        this->blockCount = blockCount;
+    }
+    for (size_t i = 0; i <= blockCount; ++i)
+        tree[i] = 0;
+    build(blockSums);
+}
+
+// Linear-time construction: every node pushes its sum to its parent
+void BlockIndex::build(const uint64_t* blockSums) {
+    total = 0;
+    for (size_t i = 1; i <= blockCount; ++i) {
+        total += blockSums[i - 1];
+        tree[i] += blockSums[i - 1];
+        const size_t parent = i + (i & (0 - i));
+        if (parent <= blockCount)
+            tree[parent] += tree[i];
+    }
+}
+
+BlockIndex::BlockIndex(const BlockIndex& other) {
+    copyFrom(other);
+}
+
+BlockIndex& BlockIndex::operator=(const BlockIndex& other) {
+    if(this != &other){
+        free();
+        copyFrom(other);
+    }
+    return *this;
+}
+
+void BlockIndex::copyFrom(const BlockIndex& other) {
+    blockCount = other.blockCount;
+    total = other.total;
+    tree = new uint64_t[blockCount + 1];
+    for (size_t i = 0; i <= blockCount; ++i)
+        tree[i] = other.tree[i];
+}
+
+void BlockIndex::free() {
+    delete[] tree;
+    tree = nullptr;
+    blockCount = 0;
+    total = 0;
+}
+
+void BlockIndex::update(size_t index, int64_t delta) {
+    total += delta;
+    for (size_t i = index / BLOCK_SIZE + 1; i <= blockCount; i += i & (0 - i))
+        tree[i] += delta;
+}
+
+uint64_t BlockIndex::prefix(size_t blocks) const {
+    uint64_t sum = 0;
+    for (size_t i = blocks < blockCount ? blocks : blockCount; i > 0; i -= i & (0 - i))
+        sum += tree[i];
+    return sum;
+}
+
+size_t BlockIndex::findBlock(uint64_t& rank) const {
+    size_t step = 1;
+    while (step * 2 <= blockCount)
+        step *= 2;
+
+    size_t position = 0;
+    for (; step; step /= 2) {
+        if (position + step <= blockCount && tree[position + step] <= rank) {
+            position += step;
+            rank -= tree[position];
+        }
+    }
+    return position;
+}
+
+uint64_t BlockIndex::size() const {
+    return total;
+}
+
+BlockIndex::~BlockIndex() {
+    free();
+}
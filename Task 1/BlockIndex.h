@@ -0,0 +1,34 @@
+#pragma once
+#include <iostream>
+
+// Fenwick tree over the sums of blocks of BLOCK_SIZE consecutive counters of a
+// packed buffer. Answers prefix sums and "which block holds the i-th element"
+// in O(log(n / BLOCK_SIZE)); the part inside a block is summed word-parallel.
+class BlockIndex {
+    uint64_t* tree; // 1-based
+    size_t blockCount;
+    uint64_t total;
+
+    void copyFrom(const BlockIndex& other);
+    void free();
+    void build(const uint64_t* blockSums); // tree zeroed and blockCount set
+public:
+    static const size_t BLOCK_SIZE;
+
+    static size_t blockCountOf(size_t count);
+
+    BlockIndex(const uint8_t* buffer, size_t count, unsigned int bucketSize);
+    BlockIndex(const uint64_t* blockSums, size_t blockCount); // from the sum of every block
+    BlockIndex(const BlockIndex& other);
+    BlockIndex& operator= (const BlockIndex& other);
+
+    void update(size_t index, int64_t delta); // counter at 0-based index changed by delta
+    // Replaces the whole index in O(blockCount), for callers that summed the blocks
+    // while writing them anyway
+    void rebuild(const uint64_t* blockSums, size_t blockCount);
+    uint64_t prefix(size_t blocks) const; // sum of the first blocks blocks
+    size_t findBlock(uint64_t& rank) const; // block holding the rank-th element, rank becomes the offset in it
+    uint64_t size() const;
+
+    ~BlockIndex();
+};
@@ -0,0 +1,142 @@
+#include "ConcurrentMultiSet.h"
+#include "MultiSet.h"
+#include <exception>
+#include <thread>
+
+static const size_t WORDS_PER_CACHE_LINE = 8;
+const size_t ConcurrentMultiSet::MAX_AUTO_SHARD_BYTES = (size_t)64 << 20;
+
+ConcurrentMultiSet::ConcurrentMultiSet(unsigned int n, unsigned int k, size_t shards) : maxNumber(n) {
+    if(k < 1 || k > 8) throw std::out_of_range("K out of bounds!");
+    bucketSize = k;
+    countersPerWord = 64 / bucketSize;
+
+    // Shards start on their own cache line so writers to different shards never share one
+    const size_t wordCount = ((size_t)maxNumber + countersPerWord - 1) / countersPerWord;
+    wordsPerShard = (wordCount + WORDS_PER_CACHE_LINE - 1) / WORDS_PER_CACHE_LINE * WORDS_PER_CACHE_LINE;
+
+    // One shard per hardware thread, fewer when that many copies would not fit
+    // MAX_AUTO_SHARD_BYTES, but never a single shard on a multi-core machine
+    if (shards == AUTO_SHARDS) {
+        const size_t threads = std::thread::hardware_concurrency();
+        const size_t shardBytes = wordsPerShard * sizeof(uint64_t) + 1;
+        const size_t affordable = MAX_AUTO_SHARD_BYTES / shardBytes;
+        shards = threads < 2 ? 1 : threads < affordable ? threads : affordable < 2 ? 2 : affordable;
+    }
+    shardCount = shards;
+    const size_t totalWords = wordsPerShard * shardCount;
+    words = new std::atomic<uint64_t>[totalWords];
+    for (size_t i = 0; i < totalWords; ++i)
+        words[i].store(0, std::memory_order_relaxed);
+}
+
+size_t ConcurrentMultiSet::shardOfCurrentThread() const {
+    static std::atomic<size_t> nextThread(0);
+    thread_local size_t threadIndex = nextThread.fetch_add(1, std::memory_order_relaxed);
+    return threadIndex % shardCount;
+}
+
+uint8_t ConcurrentMultiSet::getMaxCount() const {
+    return (uint8_t)((1u << bucketSize) - 1);
+}
+
+void ConcurrentMultiSet::add(unsigned int number) {
+    add(number, 1);
+}
+
+void ConcurrentMultiSet::add(unsigned int number, unsigned int count) {
+    if(number < 1 || number > maxNumber) throw std::out_of_range("Out of bounds!");
+    if(count == 0) return;
+
+    const size_t wordIndex = (number - 1) / countersPerWord;
+    const size_t shift = ((number - 1) % countersPerWord) * bucketSize;
+    const uint64_t maxCount = getMaxCount();
+    std::atomic<uint64_t>& word = words[shardOfCurrentThread() * wordsPerShard + wordIndex];
+
+    // Counters only ever grow, so relaxed ordering is enough: a reader sees some
+    // value between the one before and the one after the concurrent adds
+    uint64_t expected = word.load(std::memory_order_relaxed);
+    uint64_t desired;
+    do {
+        const uint64_t current = (expected >> shift) & maxCount;
+        if (current == maxCount) return;
+
+        const uint64_t updated = count >= maxCount - current ? maxCount : current + count;
+        desired = (expected & ~(maxCount << shift)) | (updated << shift);
+    } while (!word.compare_exchange_weak(expected, desired, std::memory_order_relaxed));
+}
+
+uint8_t ConcurrentMultiSet::occurrenceCount(unsigned int number) const {
+    if(number < 1 || number > maxNumber) return 0;
+
+    const size_t wordIndex = (number - 1) / countersPerWord;
+    const size_t shift = ((number - 1) % countersPerWord) * bucketSize;
+    const unsigned int maxCount = getMaxCount();
+
+    unsigned int total = 0;
+    for (size_t shard = 0; shard < shardCount && total < maxCount; ++shard)
+        total += (words[shard * wordsPerShard + wordIndex].load(std::memory_order_relaxed) >> shift) & maxCount;
+
+    return (uint8_t)(total < maxCount ? total : maxCount);
+}
+
+// Saturating add of every k-bit counter in two words. Even and odd counters are added
+// separately, so a carry out of one counter lands in the empty neighbour instead of the
+// next counter; counters that carried are then filled up to 2^k - 1.
+static uint64_t saturatingAddWords(uint64_t a, uint64_t b, const uint64_t* counterMasks, size_t bucketSize) {
+    const uint64_t maxCount = (1u << bucketSize) - 1;
+    uint64_t result = 0;
+    for (size_t parity = 0; parity < 2; ++parity) {
+        const uint64_t counters = counterMasks[parity];
+        const uint64_t x = a & counters, y = b & counters, sum = x + y;
+        // carry out of the top bit of every counter
+        const uint64_t carried = ((x & y) | ((x | y) & ~sum)) & (counters & ~(counters >> 1));
+        result |= (sum & counters) | (carried >> (bucketSize - 1)) * maxCount;
+    }
+    return result;
+}
+
+uint64_t ConcurrentMultiSet::mergedWord(size_t wordIndex, const uint64_t* counterMasks) const {
+    uint64_t merged = words[wordIndex].load(std::memory_order_relaxed);
+    for (size_t shard = 1; shard < shardCount; ++shard)
+        merged = saturatingAddWords(merged, words[shard * wordsPerShard + wordIndex].load(std::memory_order_relaxed),
+                                    counterMasks, bucketSize);
+    return merged;
+}
+
+// Both layouts store counter i at bit i * k; the words just leave 64 mod k bits unused
+// at their top. Whole words are merged and appended to the packed buffer as bit strings.
+MultiSet ConcurrentMultiSet::toMultiSet() const {
+    MultiSet snapshot(maxNumber, bucketSize);
+    uint8_t* out = snapshot.numberSet;
+    const size_t outSize = snapshot.getArraySize();
+    const size_t wordCount = ((size_t)maxNumber + countersPerWord - 1) / countersPerWord;
+    const size_t usedBits = countersPerWord * bucketSize;
+
+    // The bits of the even and of the odd counters of a word
+    uint64_t counterMasks[2] = { 0, 0 };
+    for (size_t i = 0; i < countersPerWord; ++i)
+        counterMasks[i % 2] |= (uint64_t)getMaxCount() << (i * bucketSize);
+
+    uint64_t pending = 0; // bits not written yet, the lowest first
+    size_t pendingBits = 0, written = 0;
+    for (size_t w = 0; w < wordCount; ++w) {
+        const uint64_t word = mergedWord(w, counterMasks);
+        pending |= word << pendingBits;
+        if (pendingBits + usedBits < 64) {
+            pendingBits += usedBits;
+            continue;
+        }
+        for (size_t byte = 0; byte < 8 && written < outSize; ++byte)
+            out[written++] = (uint8_t)(pending >> (8 * byte));
+        pendingBits = pendingBits + usedBits - 64;
+        pending = pendingBits ? word >> (usedBits - pendingBits) : 0;
+    }
+    for (size_t byte = 0; byte * 8 < pendingBits && written < outSize; ++byte)
+        out[written++] = (uint8_t)(pending >> (8 * byte));
+    return snapshot;
+}
+
+ConcurrentMultiSet::~ConcurrentMultiSet() {
+    delete[] words;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <iostream>
+#include <atomic>
+
+class MultiSet;
+
+// MultiSet variant that many threads can add to at the same time.
+// Counters never straddle a 64-bit word (64 / k of them share one word), so every
+// update is a single compare-and-swap on one std::atomic<uint64_t>. Writers are
+// spread over several shards to reduce contention; reads sum the shards, saturating.
+// By default there is a shard per hardware thread, as long as the copies stay small.
+class ConcurrentMultiSet {
+    static const size_t AUTO_SHARDS = 0;
+    static const size_t MAX_AUTO_SHARD_BYTES; // all shards together, when picked automatically
+
+    std::atomic<uint64_t>* words;
+    size_t wordsPerShard;
+    size_t shardCount;
+    size_t bucketSize;
+    size_t countersPerWord;
+    unsigned int maxNumber;
+
+    size_t shardOfCurrentThread() const;
+    uint8_t getMaxCount() const;
+    uint64_t mergedWord(size_t wordIndex, const uint64_t* counterMasks) const; // summed over all shards
+public:
+    ConcurrentMultiSet(unsigned int n, unsigned int k, size_t shards = AUTO_SHARDS);
+    ConcurrentMultiSet(const ConcurrentMultiSet& other) = delete;
+    ConcurrentMultiSet& operator= (const ConcurrentMultiSet& other) = delete;
+
+    void add(unsigned int number);
+    void add(unsigned int number, unsigned int count);
+    uint8_t occurrenceCount(unsigned int number) const; // safe while other threads add
+
+    MultiSet toMultiSet() const;
+
+    ~ConcurrentMultiSet();
+};
@@ -0,0 +1,145 @@
+#pragma once
+#include <iostream>
+#include <exception>
+#include "PackedKernels.h"
+
+// MultiSet with the bucket size fixed at compile time. Uses the same packed layout
+// as MultiSet, but every access goes straight to PackedLayout<K> without dispatching
+// on a runtime k. MultiSet stays the runtime-k front end over the same kernels.
+template <unsigned int K>
+class FixedMultiSet {
+    typedef PackedLayout<K> Layout;
+
+    uint8_t* numberSet;
+    unsigned int maxNumber;
+
+    void copyFrom(const FixedMultiSet& other);
+    void free();
+    size_t getArraySize() const;
+public:
+    FixedMultiSet();
+    explicit FixedMultiSet(unsigned int n);
+    FixedMultiSet(const FixedMultiSet& other);
+    FixedMultiSet& operator= (const FixedMultiSet& other);
+
+    void add(unsigned int number);
+    void add(unsigned int number, unsigned int count);
+    uint8_t occurrenceCount(unsigned int number) const;
+
+    template <typename Visitor>
+    void forEach(Visitor visit) const;
+    void printNumbers() const;
+
+    FixedMultiSet intersection(const FixedMultiSet& other) const;
+    FixedMultiSet difference(const FixedMultiSet& other) const;
+    FixedMultiSet fillInMultiSet() const;
+
+    ~FixedMultiSet();
+};
+
+template <unsigned int K>
+FixedMultiSet<K>::FixedMultiSet() : numberSet(nullptr), maxNumber(0) {}
+
+template <unsigned int K>
+FixedMultiSet<K>::FixedMultiSet(unsigned int n) : maxNumber(n) {
+    numberSet = new uint8_t[getArraySize()]();
+}
+
+template <unsigned int K>
+FixedMultiSet<K>::FixedMultiSet(const FixedMultiSet& other) {
+    copyFrom(other);
+}
+
+template <unsigned int K>
+FixedMultiSet<K>& FixedMultiSet<K>::operator=(const FixedMultiSet& other) {
+    if(this != &other){
+        free();
+        copyFrom(other);
+    }
+    return *this;
+}
+
+template <unsigned int K>
+void FixedMultiSet<K>::copyFrom(const FixedMultiSet& other) {
+    maxNumber = other.maxNumber;
+    numberSet = nullptr;
+    if (!other.numberSet)
+        return;
+    const size_t arraySize = getArraySize();
+    numberSet = new uint8_t[arraySize];
+    for (size_t i = 0; i < arraySize; ++i)
+        numberSet[i] = other.numberSet[i];
+}
+
+template <unsigned int K>
+void FixedMultiSet<K>::free() {
+    delete[] numberSet;
+    numberSet = nullptr;
+    maxNumber = 0;
+}
+
+template <unsigned int K>
+size_t FixedMultiSet<K>::getArraySize() const {
+    return PackedKernels::bufferSize(maxNumber, K);
+}
+
+template <unsigned int K>
+void FixedMultiSet<K>::add(unsigned int number) {
+    add(number, 1);
+}
+
+template <unsigned int K>
+void FixedMultiSet<K>::add(unsigned int number, unsigned int count) {
+    if(number < 1 || number > maxNumber) throw std::out_of_range("Out of bounds!");
+    Layout::setCounter(numberSet, number - 1, Layout::saturatingAdd(Layout::counterAt(numberSet, number - 1), count));
+}
+
+template <unsigned int K>
+uint8_t FixedMultiSet<K>::occurrenceCount(unsigned int number) const {
+    return Layout::counterAt(numberSet, number - 1);
+}
+
+template <unsigned int K>
+template <typename Visitor>
+void FixedMultiSet<K>::forEach(Visitor visit) const {
+    for (size_t i = PackedKernels::nextNonZero(numberSet, maxNumber, 0, K); i < maxNumber;
+         i = PackedKernels::nextNonZero(numberSet, maxNumber, i + 1, K))
+        visit((unsigned int)(i + 1), Layout::counterAt(numberSet, i));
+}
+
+template <unsigned int K>
+void FixedMultiSet<K>::printNumbers() const {
+    forEach([](unsigned int number, uint8_t occurrences) {
+        std::cout << number << " occurs "<< (int)occurrences << " times." <<std::endl;
+    });
+}
+
+template <unsigned int K>
+FixedMultiSet<K> FixedMultiSet<K>::intersection(const FixedMultiSet& other) const {
+    unsigned int minMaxNumber = maxNumber > other.maxNumber ? other.maxNumber : maxNumber;
+    FixedMultiSet intersection(minMaxNumber);
+    PackedKernels::intersection(numberSet, maxNumber, other.numberSet, other.maxNumber,
+                                intersection.numberSet, minMaxNumber, K);
+    return intersection;
+}
+
+template <unsigned int K>
+FixedMultiSet<K> FixedMultiSet<K>::difference(const FixedMultiSet& other) const {
+    unsigned int maxMaxNumber = maxNumber < other.maxNumber ? other.maxNumber : maxNumber;
+    FixedMultiSet difference(maxMaxNumber);
+    PackedKernels::difference(numberSet, maxNumber, other.numberSet, other.maxNumber,
+                              difference.numberSet, maxMaxNumber, K);
+    return difference;
+}
+
+template <unsigned int K>
+FixedMultiSet<K> FixedMultiSet<K>::fillInMultiSet() const {
+    FixedMultiSet filledIn(maxNumber);
+    PackedKernels::complement(numberSet, maxNumber, filledIn.numberSet, K);
+    return filledIn;
+}
+
+template <unsigned int K>
+FixedMultiSet<K>::~FixedMultiSet() {
+    free();
+}
@@ -0,0 +1,17 @@
+#include "Instrumentation.h"
+
+const char* MultiSetEvents::name(Counter counter) {
+    static const char* const NAMES[COUNTER_COUNT] = {
+        "add_calls", "add_saturated", "add_straddling", "occurrence_count_calls", "set_operations",
+        "serialize_calls", "deserialize_calls", "bytes_serialized", "bytes_deserialized"
+    };
+    return NAMES[counter];
+}
+
+const char* MultiSetEvents::name(Histogram histogram) {
+    static const char* const NAMES[HISTOGRAM_COUNT] = {
+        "add_latency_ns", "occurrence_count_latency_ns", "set_operation_latency_ns", "serialize_latency_ns",
+        "deserialize_latency_ns"
+    };
+    return NAMES[histogram];
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "InstrumentationRegistry.h"
+
+// What MultiSet records. The INSTRUMENT_* macros below only record anything when
+// MULTISET_INSTRUMENTATION is defined (cmake -DMULTISET_INSTRUMENTATION=ON);
+// otherwise they expand to nothing and every snapshot is empty.
+struct MultiSetEvents {
+    enum Counter {
+        ADD_CALLS,
+        ADD_SATURATED, // adds that hit the 2^k - 1 cap
+        ADD_STRADDLING, // adds to a counter split across two bytes
+        OCCURRENCE_COUNT_CALLS,
+        SET_OPERATIONS, // passes over the counters by set operations and their in-place forms
+        SERIALIZE_CALLS,
+        DESERIALIZE_CALLS, // including map and the compressed format
+        BYTES_SERIALIZED, // packed counter bytes
+        BYTES_DESERIALIZED,
+        COUNTER_COUNT
+    };
+
+    enum Histogram {
+        ADD_LATENCY, // sampled
+        OCCURRENCE_COUNT_LATENCY, // sampled
+        SET_OPERATION_LATENCY,
+        SERIALIZE_LATENCY,
+        DESERIALIZE_LATENCY,
+        HISTOGRAM_COUNT
+    };
+
+    static const char* name(Counter counter);
+    static const char* name(Histogram histogram);
+};
+
+typedef InstrumentationRegistry<MultiSetEvents> Instrumentation;
+
+#ifdef MULTISET_INSTRUMENTATION
+#define INSTRUMENT_COUNT(counter, amount) Instrumentation::count(Instrumentation::counter, amount)
+// Counts a hot call and times a sample of them
+#define INSTRUMENT_CALL(counter, histogram) \
+    Instrumentation::ScopedTimer instrumentationTimer(Instrumentation::histogram, \
+                                                      Instrumentation::countSampled(Instrumentation::counter))
+// Counts and times every call
+#define INSTRUMENT_SCOPE(counter, histogram) \
+    Instrumentation::count(Instrumentation::counter); \
+    Instrumentation::ScopedTimer instrumentationTimer(Instrumentation::histogram)
+#else
+#define INSTRUMENT_COUNT(counter, amount) ((void)0)
+#define INSTRUMENT_CALL(counter, histogram) ((void)0)
+#define INSTRUMENT_SCOPE(counter, histogram) ((void)0)
+#endif
@@ -1,6 +1,20 @@
 #include "MultiSet.h"
+#include "PackedKernels.h"
+#include "ThreadPool.h"
+#include "MultiSetStream.h"
+#include "Instrumentation.h"
 #include <fstream>
 #include <exception>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define MULTISET_HAS_MMAP
+#endif
 
 uint8_t MultiSet::MAX_VALUES[8] = {
     0b11111111,
@@ -14,14 +28,81 @@ uint8_t MultiSet::MAX_VALUES[8] = {
 };
 size_t MultiSet::NUMBER_OF_BITS = 8;
 
-MultiSet::MultiSet(): numberSet(nullptr), bucketSize(0), maxNumber(0){}
+// Set operations below this many groups of 8 counters are not worth splitting across threads
+static const size_t PARALLEL_THRESHOLD = 1 << 16;
+// Groups merged from every input before moving on, so the output range stays in cache
+static const size_t MERGE_BLOCK = 1 << 12;
+
+// On-disk layout: a 64 byte header followed by the packed counters, so the payload
+// stays aligned when the file is mapped. Header fields are stored in the writer's
+// byte order; the endianness tag tells the reader whether to swap them.
+struct MultiSetFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t endianness;
+    uint32_t bucketSize;
+    uint64_t maxNumber;
+    uint64_t payloadSize;
+    uint64_t checksum;
+    uint8_t reserved[24];
+};
+
+static const char FILE_MAGIC[4] = {'M', 'S', 'E', 'T'};
+static const uint16_t FILE_VERSION = 1;
+static const uint32_t ENDIANNESS_TAG = 0x01020304;
+
+static uint16_t swapBytes(uint16_t value) {
+    return (uint16_t)((value >> 8) | (value << 8));
+}
+
+static uint32_t swapBytes(uint32_t value) {
+    return ((uint32_t)swapBytes((uint16_t)value) << 16) | swapBytes((uint16_t)(value >> 16));
+}
+
+static uint64_t swapBytes(uint64_t value) {
+    return ((uint64_t)swapBytes((uint32_t)value) << 32) | swapBytes((uint32_t)(value >> 32));
+}
+
+static uint64_t checksumOf(const uint8_t* data, size_t size) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Validates the header and converts it to the host byte order
+static bool readHeader(MultiSetFileHeader& header) {
+    if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+        return false;
+    if (header.endianness != ENDIANNESS_TAG) {
+        if (header.endianness != swapBytes(ENDIANNESS_TAG))
+            return false;
+        header.version = swapBytes(header.version);
+        header.headerSize = swapBytes(header.headerSize);
+        header.bucketSize = swapBytes(header.bucketSize);
+        header.maxNumber = swapBytes(header.maxNumber);
+        header.payloadSize = swapBytes(header.payloadSize);
+        header.checksum = swapBytes(header.checksum);
+    }
+    return header.version == FILE_VERSION &&
+           header.headerSize == sizeof(MultiSetFileHeader) &&
+           header.bucketSize >= 1 && header.bucketSize <= 8 &&
+           header.maxNumber <= UINT32_MAX &&
+           header.payloadSize == ((header.maxNumber * header.bucketSize) / 8) + 1;
+}
+
+MultiSet::MultiSet(): numberSet(nullptr), bucketSize(0), maxNumber(0), mappedFile(nullptr), mappedSize(0), index(nullptr){}
 
-MultiSet::MultiSet(unsigned int n, unsigned int k) : maxNumber(n) {
+MultiSet::MultiSet(unsigned int n, unsigned int k) : maxNumber(n), mappedFile(nullptr), mappedSize(0), index(nullptr) {
     if(k < 1 || k > 8) throw std::out_of_range("K out of bounds!");
     // No need to free up memory
     else bucketSize = k;
     const size_t arraySize = getArraySize(); // 8 bit rounded up
-    numberSet = new uint8_t[arraySize]; // round up
+    numberSet = new uint8_t[arraySize](); // round up, all counters start at 0
 }
 
 MultiSet::MultiSet(const MultiSet& other) {
@@ -36,66 +117,235 @@ MultiSet& MultiSet::operator=(const MultiSet& other) {
     return *this;
 }
 
+MultiSet::MultiSet(MultiSet&& other) noexcept {
+    moveFrom(std::move(other));
+}
+
+MultiSet& MultiSet::operator=(MultiSet&& other) noexcept {
+    if(this != &other){
+        free();
+        moveFrom(std::move(other));
+    }
+    return *this;
+}
+
+void MultiSet::moveFrom(MultiSet&& other) {
+    numberSet = other.numberSet;
+    bucketSize = other.bucketSize;
+    maxNumber = other.maxNumber;
+    mappedFile = other.mappedFile;
+    mappedSize = other.mappedSize;
+    index = other.index;
+
+    other.numberSet = nullptr;
+    other.bucketSize = 0;
+    other.maxNumber = 0;
+    other.mappedFile = nullptr;
+    other.mappedSize = 0;
+    other.index = nullptr;
+}
+
 void MultiSet::copyFrom(const MultiSet &other) {
     bucketSize = other.bucketSize;
     maxNumber = other.maxNumber;
-    const size_t arraySize = getArraySize();
-    numberSet = new uint8_t[arraySize];
-    for (int i = 0; i <= arraySize; ++i)
-        numberSet[i] = other.numberSet[i];
+    mappedFile = nullptr;
+    mappedSize = 0;
+    numberSet = nullptr;
+    if (other.numberSet) {
+        const size_t arraySize = getArraySize();
+        numberSet = new uint8_t[arraySize];
+        for (size_t i = 0; i < arraySize; ++i)
+            numberSet[i] = other.numberSet[i];
+    }
+    index = other.index ? new BlockIndex(*other.index) : nullptr;
 }
 
 void MultiSet::free() {
     maxNumber = 0;
     bucketSize = 0;
-    delete[] numberSet;
+    if (mappedFile) {
+#ifdef MULTISET_HAS_MMAP
+        munmap(mappedFile, mappedSize);
+#endif
+        mappedFile = nullptr;
+        mappedSize = 0;
+    }
+    else delete[] numberSet;
+    numberSet = nullptr;
+    delete index;
+    index = nullptr;
 }
 
 size_t MultiSet::getArraySize() const {
     return ((maxNumber * bucketSize) / 8) + 1;
 }
 
+uint8_t MultiSet::getMaxCount() const {
+    return MultiSet::MAX_VALUES[MultiSet::NUMBER_OF_BITS - bucketSize];
+}
+
 void MultiSet::add(unsigned int number) {
-    if(number > maxNumber) throw std::out_of_range("Out of bounds!");
-    if(occurrenceCount(number) == MultiSet::MAX_VALUES[MultiSet::NUMBER_OF_BITS - bucketSize]) return;
+    add(number, 1);
+}
 
-    size_t clusterIndex = ((number - 1) * bucketSize) / MultiSet::NUMBER_OF_BITS;
-    size_t bitIndex = ((number - 1) * bucketSize) % MultiSet::NUMBER_OF_BITS;
+void MultiSet::add(unsigned int number, unsigned int count) {
+    INSTRUMENT_CALL(ADD_CALLS, ADD_LATENCY);
+    if(number < 1 || number > maxNumber) throw std::out_of_range("Out of bounds!");
+    if(isReadOnly()) throw std::logic_error("Read-only MultiSet!");
+
+    if(count == 0) return;
+#ifdef MULTISET_INSTRUMENTATION
+    const size_t firstBit = (size_t)(number - 1) * bucketSize;
+    INSTRUMENT_COUNT(ADD_STRADDLING, firstBit / 8 != (firstBit + bucketSize - 1) / 8);
+    INSTRUMENT_COUNT(ADD_SATURATED,
+                     PackedKernels::counterAt(numberSet, number - 1, bucketSize) + count > getMaxCount());
+#endif
+
+    if (!index) {
+        PackedKernels::addToCounter(numberSet, number - 1, bucketSize, count);
+        return;
+    }
+    const uint8_t current = PackedKernels::counterAt(numberSet, number - 1, bucketSize);
+    index->update(number - 1, PackedKernels::addToCounter(numberSet, number - 1, bucketSize, count) - current);
+}
 
-    if((numberSet[clusterIndex] >> bitIndex) == MultiSet::MAX_VALUES[MultiSet::NUMBER_OF_BITS - bitIndex]){
-        numberSet[clusterIndex] &= ~(MultiSet::MAX_VALUES[MultiSet::NUMBER_OF_BITS - bitIndex] << bitIndex);
-        //clear the last bits
-        numberSet[clusterIndex + 1] += 1;
+void MultiSet::addAll(const unsigned int* values, size_t len) {
+    for (size_t i = 0; i < len; ++i)
+        if(values[i] < 1 || values[i] > maxNumber) throw std::out_of_range("Out of bounds!");
+    if(isReadOnly()) throw std::logic_error("Read-only MultiSet!");
+    INSTRUMENT_COUNT(ADD_CALLS, len);
+
+    // Sorting puts all values of one group of 8 counters next to each other,
+    // so every group is unpacked and written back once per batch
+    unsigned int* sorted = new unsigned int[len];
+    std::copy(values, values + len, sorted);
+    std::sort(sorted, sorted + len);
+
+    const uint8_t maxCount = getMaxCount();
+    size_t i = 0;
+    while (i < len) {
+        const size_t group = (sorted[i] - 1) / 8;
+        uint64_t lanes = PackedKernels::loadLanes(numberSet, maxNumber, group, bucketSize);
+        const unsigned int before = PackedKernels::laneSum(lanes);
+
+        while (i < len && (sorted[i] - 1) / 8 == group) {
+            const unsigned int number = sorted[i];
+            size_t run = 0;
+            while (i < len && sorted[i] == number) {
+                ++run;
+                ++i;
+            }
+
+            const unsigned int shift = ((number - 1) % 8) * 8;
+            const unsigned int current = (lanes >> shift) & 0xFF;
+            const unsigned int updated = run >= (size_t)(maxCount - current) ? maxCount : current + run;
+            INSTRUMENT_COUNT(ADD_SATURATED, run > (size_t)(maxCount - current));
+            lanes = (lanes & ~(0xFFULL << shift)) | ((uint64_t)updated << shift);
+        }
 
+        PackedKernels::storeLanes(numberSet, maxNumber, group, bucketSize, lanes);
+        if (index)
+            index->update(group * 8, (int64_t)PackedKernels::laneSum(lanes) - before);
     }
-    else{
-        uint8_t mask = 1 << bitIndex;
-        numberSet[clusterIndex] += mask;
-    }
+
+    delete[] sorted;
 }
 
 uint8_t MultiSet::occurrenceCount(unsigned int number) const {
-    size_t clusterIndex = ((number - 1) * bucketSize) / MultiSet::NUMBER_OF_BITS;
-    size_t bitIndex = ((number - 1) * bucketSize) % MultiSet::NUMBER_OF_BITS;
-    uint8_t occurrenceMask = numberSet[clusterIndex] >> bitIndex;
+    INSTRUMENT_CALL(OCCURRENCE_COUNT_CALLS, OCCURRENCE_COUNT_LATENCY);
+    return PackedKernels::counterAt(numberSet, number - 1, bucketSize);
+}
+
+void MultiSet::enableIndex() {
+    if (!index)
+        index = new BlockIndex(numberSet, maxNumber, bucketSize);
+}
+
+void MultiSet::disableIndex() {
+    delete index;
+    index = nullptr;
+}
+
+bool MultiSet::hasIndex() const {
+    return index != nullptr;
+}
+
+uint64_t MultiSet::countBelow(size_t count) const {
+    if (!index)
+        return PackedKernels::sumRange(numberSet, maxNumber, 0, count, bucketSize);
+
+    const size_t block = count / BlockIndex::BLOCK_SIZE;
+    return index->prefix(block) +
+           PackedKernels::sumRange(numberSet, maxNumber, block * BlockIndex::BLOCK_SIZE, count, bucketSize);
+}
 
-    if (bitIndex + bucketSize > MultiSet::NUMBER_OF_BITS) {
-        uint8_t remainingBits = bucketSize - (MultiSet::NUMBER_OF_BITS - bitIndex);
+uint64_t MultiSet::size() const {
+    return index ? index->size() : countBelow(maxNumber);
+}
+
+uint64_t MultiSet::rangeCount(unsigned int a, unsigned int b) const {
+    if(a < 1 || a > b || b > maxNumber) throw std::out_of_range("Out of bounds!");
+    return countBelow(b) - countBelow(a - 1);
+}
+
+uint64_t MultiSet::rank(unsigned int number) const {
+    if(number < 1) return 0;
+    return countBelow(number - 1 < maxNumber ? number - 1 : maxNumber);
+}
 
-        occurrenceMask |= (numberSet[clusterIndex + 1] & ((1 << remainingBits) - 1)) << (MultiSet::NUMBER_OF_BITS - bitIndex);
+unsigned int MultiSet::select(uint64_t position) const {
+    if(position >= size()) throw std::out_of_range("Out of bounds!");
+
+    // Jump to the block holding the element, then walk its groups of 8 counters
+    uint64_t rest = position;
+    const size_t block = index ? index->findBlock(rest) : 0;
+    for (size_t group = block * BlockIndex::BLOCK_SIZE / 8; ; ++group) {
+        uint64_t lanes = PackedKernels::loadLanes(numberSet, maxNumber, group, bucketSize);
+        const unsigned int sum = PackedKernels::laneSum(lanes);
+        if (rest >= sum) {
+            rest -= sum;
+            continue;
+        }
+        for (unsigned int lane = 0; ; ++lane, lanes >>= 8) {
+            if (rest < (lanes & 0xFF))
+                return (unsigned int)(group * 8 + lane + 1);
+            rest -= lanes & 0xFF;
+        }
     }
+}
 
-    occurrenceMask &= MAX_VALUES[MultiSet::NUMBER_OF_BITS - bucketSize];
+MultiSet::Iterator::Iterator(const MultiSet* set, size_t index) : set(set), index(index) {}
 
-    return occurrenceMask;
+MultiSet::Entry MultiSet::Iterator::operator*() const {
+    Entry entry = { (unsigned int)(index + 1), PackedKernels::counterAt(set->numberSet, index, set->bucketSize) };
+    return entry;
+}
+
+MultiSet::Iterator& MultiSet::Iterator::operator++() {
+    index = PackedKernels::nextNonZero(set->numberSet, set->maxNumber, index + 1, set->bucketSize);
+    return *this;
+}
+
+bool MultiSet::Iterator::operator==(const Iterator& other) const {
+    return set == other.set && index == other.index;
+}
+
+bool MultiSet::Iterator::operator!=(const Iterator& other) const {
+    return !(*this == other);
+}
+
+MultiSet::Iterator MultiSet::begin() const {
+    return Iterator(this, PackedKernels::nextNonZero(numberSet, maxNumber, 0, bucketSize));
+}
+
+MultiSet::Iterator MultiSet::end() const {
+    return Iterator(this, maxNumber);
 }
 
 void MultiSet::printNumbers() const {
-    for (size_t i = 1; i <= maxNumber; i++) {
-        uint8_t occurrences = occurrenceCount(i);
-        if (occurrences)
-            std::cout << i << " occurs "<< (int)occurrences << " times." <<std::endl;
-    }
+    forEach([](unsigned int number, uint8_t occurrences) {
+        std::cout << number << " occurs "<< (int)occurrences << " times." <<std::endl;
+    });
 }
 
 void MultiSet::printMultiSetInMemory() const {
@@ -110,30 +360,218 @@ void MultiSet::printMultiSetInMemory() const {
 }
 
 void MultiSet::serialize(const char* fileName) const{
+    INSTRUMENT_SCOPE(SERIALIZE_CALLS, SERIALIZE_LATENCY);
     std::ofstream file(fileName, std::ios::binary);
     if(!file){
         std::cout<<"Error opening output file!\n";
         return;
     }
     const size_t arraySize = getArraySize();
-    file.write((const char*) &maxNumber, sizeof(unsigned int));
-    file.write((const char*) &bucketSize, sizeof(size_t));
+
+    MultiSetFileHeader header = {};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FILE_VERSION;
+    header.headerSize = sizeof(MultiSetFileHeader);
+    header.endianness = ENDIANNESS_TAG;
+    header.bucketSize = (uint32_t) bucketSize;
+    header.maxNumber = maxNumber;
+    header.payloadSize = arraySize;
+    header.checksum = checksumOf(numberSet, arraySize);
+
+    file.write((const char*) &header, sizeof(MultiSetFileHeader));
     file.write((const char*) numberSet, arraySize * sizeof(uint8_t));
     file.close();
+    INSTRUMENT_COUNT(BYTES_SERIALIZED, arraySize);
 }
 
 void MultiSet::deserialize(const char* fileName){
-    std::ifstream file(fileName);
+    INSTRUMENT_SCOPE(DESERIALIZE_CALLS, DESERIALIZE_LATENCY);
+    std::ifstream file(fileName, std::ios::binary);
     if(!file){
         std::cout<<"Error opening input file!\n";
         return;
     }
+
+    // Only files without the magic are older layouts; a bad header behind it is a damaged
+    // or newer file, which must not be reinterpreted as the old layout
+    MultiSetFileHeader header;
+    if(!file.read((char*) &header, sizeof(MultiSetFileHeader)) ||
+       std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0){
+        file.clear();
+        file.seekg(0);
+        deserializeUnversioned(file);
+        return;
+    }
+    if(!readHeader(header)){
+        std::cout<<"Corrupted/unsupported MultiSet file!\n";
+        return;
+    }
+
+    uint8_t* buffer = new uint8_t[header.payloadSize];
+    if(!file.read((char*) buffer, header.payloadSize * sizeof(uint8_t)) ||
+       checksumOf(buffer, header.payloadSize) != header.checksum){
+        std::cout<<"Corrupted MultiSet file!\n";
+        delete[] buffer;
+        return;
+    }
+
+    const bool indexed = hasIndex();
     free();
-    file.read((char*) &maxNumber, sizeof(unsigned int));
-    file.read((char*) &bucketSize, sizeof(size_t));
-    const size_t arraySize = getArraySize();
-    numberSet = new uint8_t[arraySize];
-    file.read((char*) numberSet, arraySize * sizeof(uint8_t));
+    maxNumber = (unsigned int) header.maxNumber;
+    bucketSize = header.bucketSize;
+    numberSet = buffer;
+    if (indexed) enableIndex();
+    INSTRUMENT_COUNT(BYTES_DESERIALIZED, header.payloadSize);
+}
+
+// Files written before the versioned header: raw maxNumber, bucketSize and counters
+void MultiSet::deserializeUnversioned(std::istream& file){
+    unsigned int n = 0;
+    size_t k = 0;
+    file.read((char*) &n, sizeof(unsigned int));
+    file.read((char*) &k, sizeof(size_t));
+    if(!file || k < 1 || k > 8){
+        std::cout<<"Invalid MultiSet file!\n";
+        return;
+    }
+
+    const size_t arraySize = ((n * k) / 8) + 1;
+    uint8_t* buffer = new uint8_t[arraySize];
+    if(!file.read((char*) buffer, arraySize * sizeof(uint8_t))){
+        std::cout<<"Invalid MultiSet file!\n";
+        delete[] buffer;
+        return;
+    }
+
+    const bool indexed = hasIndex();
+    free();
+    maxNumber = n;
+    bucketSize = k;
+    numberSet = buffer;
+    if (indexed) enableIndex();
+    INSTRUMENT_COUNT(BYTES_DESERIALIZED, getArraySize());
+}
+
+void MultiSet::map(const char* fileName, bool verifyChecksum){
+#ifdef MULTISET_HAS_MMAP
+    INSTRUMENT_SCOPE(DESERIALIZE_CALLS, DESERIALIZE_LATENCY);
+    int descriptor = open(fileName, O_RDONLY);
+    if(descriptor < 0){
+        std::cout<<"Error opening input file!\n";
+        return;
+    }
+
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if(fstat(descriptor, &info) == 0 && (size_t) info.st_size >= sizeof(MultiSetFileHeader))
+        mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor); // the mapping stays valid after closing
+    if(mapping == MAP_FAILED){
+        std::cout<<"Invalid MultiSet file!\n";
+        return;
+    }
+
+    MultiSetFileHeader header;
+    std::memcpy(&header, mapping, sizeof(MultiSetFileHeader));
+    uint8_t* payload = (uint8_t*) mapping + sizeof(MultiSetFileHeader);
+    if(!readHeader(header) || header.payloadSize > info.st_size - sizeof(MultiSetFileHeader) ||
+       (verifyChecksum && checksumOf(payload, header.payloadSize) != header.checksum)){
+        std::cout<<"Invalid MultiSet file!\n";
+        munmap(mapping, info.st_size);
+        return;
+    }
+
+    const bool indexed = hasIndex();
+    free();
+    maxNumber = (unsigned int) header.maxNumber;
+    bucketSize = header.bucketSize;
+    numberSet = payload;
+    mappedFile = mapping;
+    mappedSize = info.st_size;
+    if (indexed) enableIndex();
+    INSTRUMENT_COUNT(BYTES_DESERIALIZED, header.payloadSize);
+#else
+    // No mmap on this platform, fall back to a private copy
+    deserialize(fileName);
+#endif
+}
+
+bool MultiSet::isReadOnly() const {
+    return mappedFile != nullptr;
+}
+
+void MultiSet::serializeCompressed(const char* fileName) const{
+    INSTRUMENT_SCOPE(SERIALIZE_CALLS, SERIALIZE_LATENCY);
+    MultiSetStreamWriter writer(fileName, maxNumber, bucketSize);
+    if(!writer.isOpen()) return;
+
+    // Chunks hold a multiple of 8 counters, so every chunk starts on a byte
+    const size_t chunkStride = MultiSetStream::CHUNK_COUNTERS * bucketSize / 8;
+    for (size_t chunk = 0; chunk < writer.chunkCount(); ++chunk)
+        writer.writeChunk(numberSet + chunk * chunkStride);
+    if(!writer.close())
+        std::cout<<"Error writing MultiSet stream!\n";
+    else INSTRUMENT_COUNT(BYTES_SERIALIZED, getArraySize());
+}
+
+void MultiSet::deserializeCompressed(const char* fileName){
+    INSTRUMENT_SCOPE(DESERIALIZE_CALLS, DESERIALIZE_LATENCY);
+    MultiSetStreamReader reader(fileName);
+    if(!reader.isValid()) return;
+
+    const unsigned int n = reader.getMaxNumber();
+    const unsigned int k = reader.getBucketSize();
+    uint8_t* buffer = new uint8_t[PackedKernels::bufferSize(n, k)]();
+    const size_t chunkStride = MultiSetStream::CHUNK_COUNTERS * k / 8;
+    for (size_t chunk = 0; chunk < reader.chunkCount(); ++chunk) {
+        bool allZero;
+        if(!reader.readChunk(buffer + chunk * chunkStride, allZero)){
+            std::cout<<"Corrupted MultiSet stream!\n";
+            delete[] buffer;
+            return;
+        }
+    }
+
+    const bool indexed = hasIndex();
+    free();
+    maxNumber = n;
+    bucketSize = k;
+    numberSet = buffer;
+    if (indexed) enableIndex();
+    INSTRUMENT_COUNT(BYTES_DESERIALIZED, getArraySize());
+}
+
+// Ranges start and end on BlockIndex block boundaries (or at the last group), so no
+// block is split between two threads
+void MultiSet::forEachGroupRange(size_t groups, const std::function<void(size_t, size_t)>& body) {
+    INSTRUMENT_SCOPE(SET_OPERATIONS, SET_OPERATION_LATENCY);
+    if (groups < PARALLEL_THRESHOLD) {
+        body(0, groups);
+        return;
+    }
+    const size_t groupsPerBlock = BlockIndex::BLOCK_SIZE / 8;
+    ThreadPool::shared().parallelFor((groups + groupsPerBlock - 1) / groupsPerBlock, [&](size_t begin, size_t end) {
+        body(begin * groupsPerBlock, end * groupsPerBlock < groups ? end * groupsPerBlock : groups);
+    });
+}
+
+void MultiSet::computeGroups(bool indexed, const std::function<void(size_t, size_t)>& body) {
+    const size_t groups = PackedKernels::groupCount(maxNumber);
+    if (!indexed) {
+        forEachGroupRange(groups, body);
+        return;
+    }
+
+    const size_t groupsPerBlock = BlockIndex::BLOCK_SIZE / 8;
+    std::vector<uint64_t> blockSums(BlockIndex::blockCountOf(maxNumber), 0);
+    forEachGroupRange(groups, [&](size_t begin, size_t end) {
+        body(begin, end);
+        for (size_t block = begin / groupsPerBlock; block * groupsPerBlock < end; ++block)
+            blockSums[block] = PackedKernels::sumRange(numberSet, maxNumber, block * BlockIndex::BLOCK_SIZE,
+                                                       (block + 1) * BlockIndex::BLOCK_SIZE, bucketSize);
+    });
+    if (index) index->rebuild(blockSums.data(), blockSums.size());
+    else index = new BlockIndex(blockSums.data(), blockSums.size());
 }
 
 MultiSet MultiSet::intersection(const MultiSet& other) const {
@@ -142,14 +580,10 @@ MultiSet MultiSet::intersection(const MultiSet& other) const {
 
     unsigned int minMaxNumber = maxNumber > other.maxNumber ? other.maxNumber : maxNumber;
     MultiSet intersection(minMaxNumber, bucketSize);
-
-    for (unsigned int num = 1; num <= minMaxNumber; ++num) {
-        unsigned int occurrences = occurrenceCount(num) < other.occurrenceCount(num) ?
-                            occurrenceCount(num) : other.occurrenceCount(num);
-        for (unsigned int i = 0; i < occurrences; ++i) {
-            intersection.add(num);
-        }
-    }
+    intersection.computeGroups(index || other.index, [&](size_t begin, size_t end) {
+        PackedKernels::intersection(numberSet, maxNumber, other.numberSet, other.maxNumber,
+                                    intersection.numberSet, minMaxNumber, bucketSize, begin, end);
+    });
 
     return intersection;
 }
@@ -160,30 +594,107 @@ MultiSet MultiSet::difference(const MultiSet& other) const {
 
     unsigned int maxMaxNumber = maxNumber < other.maxNumber ? other.maxNumber : maxNumber;
     MultiSet difference(maxMaxNumber, bucketSize);
-
-    for (unsigned int num = 1; num <= maxMaxNumber; ++num) {
-        unsigned int occ1 = occurrenceCount(num), occ2 = other.occurrenceCount(num);
-        unsigned int diff = occ1 > occ2 ? occ1 - occ2 : occ2 - occ1;
-        for (unsigned int i = 0; i < diff; ++i) {
-            difference.add(num);
-        }
-    }
+    difference.computeGroups(index || other.index, [&](size_t begin, size_t end) {
+        PackedKernels::difference(numberSet, maxNumber, other.numberSet, other.maxNumber,
+                                  difference.numberSet, maxMaxNumber, bucketSize, begin, end);
+    });
 
     return difference;
 }
 
 MultiSet MultiSet::fillInMultiSet() const {
-    MultiSet filledIn(*this);
-    const size_t arraySize = getArraySize();
-    for (size_t i = 0; i < arraySize - 1; i++){
-        filledIn.numberSet[i] = ~filledIn.numberSet[i];
+    MultiSet filledIn(maxNumber, bucketSize);
+    filledIn.computeGroups(index != nullptr, [&](size_t begin, size_t end) {
+        PackedKernels::complement(numberSet, maxNumber, filledIn.numberSet, bucketSize, begin, end);
+    });
+
+    return filledIn;
+}
+
+MultiSet MultiSet::unite(const MultiSet& other) const {
+    const MultiSet* sets[] = { this, &other };
+    return merge(sets, 2);
+}
+
+MultiSet& MultiSet::operator&=(const MultiSet& other) {
+    if(bucketSize != other.bucketSize)
+        throw std::invalid_argument("Incompatible Set!");
+    if(isReadOnly()) throw std::logic_error("Read-only MultiSet!");
+
+    // The result is never longer than this set, so it is computed in place; a shorter
+    // result just leaves unused bytes at the end of the buffer
+    const unsigned int oldMaxNumber = maxNumber;
+    maxNumber = maxNumber > other.maxNumber ? other.maxNumber : maxNumber;
+    computeGroups(index != nullptr, [&](size_t begin, size_t end) {
+        PackedKernels::intersection(numberSet, oldMaxNumber, other.numberSet, other.maxNumber,
+                                    numberSet, maxNumber, bucketSize, begin, end);
+    });
+    return *this;
+}
+
+MultiSet& MultiSet::operator-=(const MultiSet& other) {
+    if(bucketSize != other.bucketSize)
+        throw std::invalid_argument("Incompatible Set!");
+    if(isReadOnly()) throw std::logic_error("Read-only MultiSet!");
+    if(other.maxNumber > maxNumber)
+        return *this = difference(other);
+
+    computeGroups(index || other.index, [&](size_t begin, size_t end) {
+        PackedKernels::difference(numberSet, maxNumber, other.numberSet, other.maxNumber,
+                                  numberSet, maxNumber, bucketSize, begin, end);
+    });
+    return *this;
+}
+
+MultiSet& MultiSet::operator|=(const MultiSet& other) {
+    if(bucketSize != other.bucketSize)
+        throw std::invalid_argument("Incompatible Set!");
+    if(isReadOnly()) throw std::logic_error("Read-only MultiSet!");
+    if(other.maxNumber > maxNumber)
+        return *this = unite(other);
+
+    computeGroups(index || other.index, [&](size_t begin, size_t end) {
+        PackedKernels::unite(numberSet, maxNumber, other.numberSet, other.maxNumber,
+                             numberSet, maxNumber, bucketSize, begin, end);
+    });
+    return *this;
+}
+
+MultiSet& MultiSet::complement() {
+    if(isReadOnly()) throw std::logic_error("Read-only MultiSet!");
+
+    computeGroups(index != nullptr, [&](size_t begin, size_t end) {
+        PackedKernels::complement(numberSet, maxNumber, numberSet, bucketSize, begin, end);
+    });
+    return *this;
+}
+
+MultiSet MultiSet::merge(const MultiSet* const* sets, size_t count) {
+    if(count == 0)
+        throw std::invalid_argument("Nothing to merge!");
+
+    unsigned int maxMaxNumber = 0;
+    bool indexed = false;
+    for (size_t i = 0; i < count; ++i) {
+        if(sets[i]->bucketSize != sets[0]->bucketSize)
+            throw std::invalid_argument("Incompatible Set!");
+        if(sets[i]->maxNumber > maxMaxNumber) maxMaxNumber = sets[i]->maxNumber;
+        indexed = indexed || sets[i]->index;
     }
 
-    size_t bitIndex = ((maxNumber - 1) * bucketSize) % MultiSet::NUMBER_OF_BITS;
-    uint8_t mask = ~MultiSet::MAX_VALUES[MultiSet::NUMBER_OF_BITS - bitIndex];
-    filledIn.numberSet[maxNumber - 1] &= mask;
+    const size_t bucketSize = sets[0]->bucketSize;
+    MultiSet merged(maxMaxNumber, bucketSize);
+    // Every thread reduces all inputs over its own range of the output
+    merged.computeGroups(indexed, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; block += MERGE_BLOCK) {
+            const size_t blockEnd = end - block < MERGE_BLOCK ? end : block + MERGE_BLOCK;
+            for (size_t i = 0; i < count; ++i)
+                PackedKernels::unite(merged.numberSet, maxMaxNumber, sets[i]->numberSet, sets[i]->maxNumber,
+                                     merged.numberSet, maxMaxNumber, bucketSize, block, blockEnd);
+        }
+    });
 
-    return filledIn;
+    return merged;
 }
 
 MultiSet::~MultiSet() {
@@ -1,34 +1,104 @@
 #pragma once
 #include <iostream>
+#include <functional>
+#include "PackedKernels.h"
+#include "BlockIndex.h"
 
 class MultiSet {
+    friend class ConcurrentMultiSet; // toMultiSet writes the packed counters directly
+
     static uint8_t MAX_VALUES[8];
     static size_t NUMBER_OF_BITS;
     uint8_t* numberSet;
     size_t bucketSize;
     unsigned int maxNumber;
+    void* mappedFile; // non-null for a read-only view over a mapped file
+    size_t mappedSize;
+    BlockIndex* index; // optional block summary, kept up to date by every update
 
     void copyFrom(const MultiSet& other);
+    void moveFrom(MultiSet&& other);
     void free();
     size_t getArraySize() const;
+    uint8_t getMaxCount() const;
+    void deserializeUnversioned(std::istream& file);
+    uint64_t countBelow(size_t count) const; // occurrences of the first count numbers
+    static void forEachGroupRange(size_t groups, const std::function<void(size_t, size_t)>& body);
+    // Runs body over the groups of this set like forEachGroupRange. With indexed, every range
+    // also sums its blocks right after body wrote them and the index is rebuilt from those sums.
+    void computeGroups(bool indexed, const std::function<void(size_t, size_t)>& body);
 public:
+    struct Entry {
+        unsigned int number;
+        uint8_t count;
+    };
+
+    // Walks the numbers with a non-zero count in increasing order
+    class Iterator {
+        const MultiSet* set;
+        size_t index;
+    public:
+        Iterator(const MultiSet* set, size_t index);
+        Entry operator*() const;
+        Iterator& operator++();
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const;
+    };
+
     MultiSet();
     MultiSet(unsigned int n, unsigned int k);
     MultiSet(const MultiSet& other);
     MultiSet& operator= (const MultiSet& other);
+    MultiSet(MultiSet&& other) noexcept;
+    MultiSet& operator= (MultiSet&& other) noexcept;
 
     void add(unsigned int number);
+    void add(unsigned int number, unsigned int count);
+    void addAll(const unsigned int* values, size_t len);
     uint8_t occurrenceCount(unsigned int number) const;
 
+    void enableIndex();
+    void disableIndex();
+    bool hasIndex() const;
+    // O(log n) with the index enabled, a word-parallel scan without it
+    uint64_t size() const;
+    uint64_t rangeCount(unsigned int a, unsigned int b) const; // occurrences of numbers in [a, b]
+    uint64_t rank(unsigned int number) const; // occurrences of numbers smaller than number
+    unsigned int select(uint64_t position) const; // element at 0-based position in sorted order
+
+    Iterator begin() const;
+    Iterator end() const;
+    template <typename Visitor>
+    void forEach(Visitor visit) const; // visit(number, count) for every number in the set
+
     void printNumbers() const;
     void printMultiSetInMemory() const;
 
     void serialize(const char* fileName) const; // out
     void deserialize(const char* fileName); // in
+    void map(const char* fileName, bool verifyChecksum = false); // read-only view, no copy
+    bool isReadOnly() const;
+    void serializeCompressed(const char* fileName) const; // chunked MultiSetStream format
+    void deserializeCompressed(const char* fileName);
 
     MultiSet intersection(const MultiSet& other) const;
     MultiSet difference(const MultiSet& other) const;
     MultiSet fillInMultiSet() const;
+    MultiSet unite(const MultiSet& other) const; // counts add up, saturating at 2^k - 1
+    static MultiSet merge(const MultiSet* const* sets, size_t count); // unite of all sets at once
+
+    // In-place forms, reusing this set's buffer whenever the result fits in it
+    MultiSet& operator&=(const MultiSet& other); // intersection
+    MultiSet& operator-=(const MultiSet& other); // difference
+    MultiSet& operator|=(const MultiSet& other); // unite
+    MultiSet& complement(); // fillInMultiSet
     
     ~MultiSet();
-};
\ No newline at end of file
+};
+
+template <typename Visitor>
+void MultiSet::forEach(Visitor visit) const {
+    for (size_t i = PackedKernels::nextNonZero(numberSet, maxNumber, 0, bucketSize); i < maxNumber;
+         i = PackedKernels::nextNonZero(numberSet, maxNumber, i + 1, bucketSize))
+        visit((unsigned int)(i + 1), PackedKernels::counterAt(numberSet, i, bucketSize));
+}
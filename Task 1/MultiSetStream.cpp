@@ -0,0 +1,367 @@
+#include "MultiSetStream.h"
+#include "PackedKernels.h"
+#include <exception>
+#include <cstring>
+
+const size_t MultiSetStream::CHUNK_COUNTERS = 1 << 20;
+
+// On-disk layout: a 32 byte header, then one record per chunk made of the encoding
+// byte, the payload length and the payload. A RUNS payload is a sequence of
+// (zero bytes, literal bytes, literals...) triples covering the chunk exactly.
+static const char STREAM_MAGIC[4] = {'M', 'S', 'S', 'T'};
+static const uint16_t STREAM_VERSION = 1;
+static const uint16_t STREAM_HEADER_SIZE = 32;
+static const size_t RECORD_HEADER_SIZE = 5;
+static const size_t RUN_HEADER_SIZE = 8;
+
+static void storeLittleEndian(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i)
+        out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t loadLittleEndian(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        value |= (uint64_t)in[i] << (8 * i);
+    return value;
+}
+
+static size_t chunkCountOf(unsigned int maxNumber, size_t chunkCounters) {
+    return ((size_t)maxNumber + chunkCounters - 1) / chunkCounters;
+}
+
+static size_t chunkLengthOf(unsigned int maxNumber, size_t chunkCounters, size_t chunkIndex) {
+    const size_t first = chunkIndex * chunkCounters;
+    if (first >= maxNumber) return 0;
+    const size_t left = maxNumber - first;
+    return left < chunkCounters ? left : chunkCounters;
+}
+
+static size_t chunkBytesOf(size_t length, unsigned int bucketSize) {
+    return (length * bucketSize + 7) / 8;
+}
+
+static size_t zeroRun(const uint8_t* data, size_t from, size_t size) {
+    size_t i = from;
+    // Whole words first, the sets this format is for are mostly zeroes
+    while (i + 8 <= size) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        if (word) break;
+        i += 8;
+    }
+    while (i < size && data[i] == 0) ++i;
+    return i - from;
+}
+
+// Zero-run elision of a chunk. Returns the encoded size, or 0 when the encoding would
+// not be smaller than the raw bytes. A literal only ends at a zero run longer than
+// the header of the next run, otherwise splitting it would cost more than it saves.
+static size_t encodeRuns(const uint8_t* data, size_t size, uint8_t* out) {
+    size_t written = 0;
+    size_t position = 0;
+    while (position < size) {
+        const size_t zeroes = zeroRun(data, position, size);
+        const size_t literalStart = position + zeroes;
+        size_t literalEnd = literalStart;
+        while (literalEnd < size) {
+            const size_t gap = zeroRun(data, literalEnd, size);
+            if (gap > RUN_HEADER_SIZE || literalEnd + gap == size) break;
+            literalEnd += gap;
+            while (literalEnd < size && data[literalEnd] != 0) ++literalEnd;
+        }
+
+        const size_t literals = literalEnd - literalStart;
+        if (written + RUN_HEADER_SIZE + literals >= size) return 0;
+        storeLittleEndian(out + written, zeroes, 4);
+        storeLittleEndian(out + written + 4, literals, 4);
+        std::memcpy(out + written + RUN_HEADER_SIZE, data + literalStart, literals);
+        written += RUN_HEADER_SIZE + literals;
+        position = literalEnd;
+    }
+    return written;
+}
+
+static bool decodeRuns(const uint8_t* in, size_t inSize, uint8_t* data, size_t size) {
+    size_t read = 0;
+    size_t position = 0;
+    while (read < inSize) {
+        if (inSize - read < RUN_HEADER_SIZE) return false;
+        const size_t zeroes = (size_t)loadLittleEndian(in + read, 4);
+        const size_t literals = (size_t)loadLittleEndian(in + read + 4, 4);
+        read += RUN_HEADER_SIZE;
+        if (zeroes > size - position || literals > size - position - zeroes || literals > inSize - read)
+            return false;
+        std::memset(data + position, 0, zeroes);
+        position += zeroes;
+        std::memcpy(data + position, in + read, literals);
+        position += literals;
+        read += literals;
+    }
+    return position == size;
+}
+
+MultiSetStreamWriter::MultiSetStreamWriter(const char* fileName, unsigned int n, unsigned int k)
+        : file(fileName, std::ios::binary), maxNumber(n), chunksWritten(0) {
+    if(k < 1 || k > 8) throw std::out_of_range("K out of bounds!");
+    bucketSize = k;
+    encoded = new uint8_t[chunkBytes(0)]; // the first chunk is the largest
+    if(!file){
+        std::cout<<"Error opening output file!\n";
+        return;
+    }
+    writeHeader();
+}
+
+void MultiSetStreamWriter::writeHeader() {
+    uint8_t header[STREAM_HEADER_SIZE] = {};
+    std::memcpy(header, STREAM_MAGIC, sizeof(STREAM_MAGIC));
+    storeLittleEndian(header + 4, STREAM_VERSION, 2);
+    storeLittleEndian(header + 6, STREAM_HEADER_SIZE, 2);
+    storeLittleEndian(header + 8, bucketSize, 4);
+    storeLittleEndian(header + 16, maxNumber, 8);
+    storeLittleEndian(header + 24, MultiSetStream::CHUNK_COUNTERS, 8);
+    file.write((const char*) header, STREAM_HEADER_SIZE);
+}
+
+bool MultiSetStreamWriter::isOpen() const {
+    return file.is_open() && file.good();
+}
+
+size_t MultiSetStreamWriter::chunkCount() const {
+    return chunkCountOf(maxNumber, MultiSetStream::CHUNK_COUNTERS);
+}
+
+size_t MultiSetStreamWriter::chunkLength(size_t chunkIndex) const {
+    return chunkLengthOf(maxNumber, MultiSetStream::CHUNK_COUNTERS, chunkIndex);
+}
+
+size_t MultiSetStreamWriter::chunkBytes(size_t chunkIndex) const {
+    return chunkBytesOf(chunkLength(chunkIndex), bucketSize);
+}
+
+bool MultiSetStreamWriter::writeChunk(const uint8_t* counters) {
+    if(!isOpen() || chunksWritten >= chunkCount()) return false;
+    const size_t size = chunkBytes(chunksWritten);
+
+    uint8_t encoding = MultiSetStream::RAW;
+    size_t payloadSize = size;
+    const uint8_t* payload = counters;
+    if (!counters || zeroRun(counters, 0, size) == size) {
+        encoding = MultiSetStream::ZERO;
+        payloadSize = 0;
+    }
+    else if (size_t runsSize = encodeRuns(counters, size, encoded)) {
+        encoding = MultiSetStream::RUNS;
+        payloadSize = runsSize;
+        payload = encoded;
+    }
+
+    uint8_t record[RECORD_HEADER_SIZE];
+    record[0] = encoding;
+    storeLittleEndian(record + 1, payloadSize, 4);
+    file.write((const char*) record, RECORD_HEADER_SIZE);
+    file.write((const char*) payload, payloadSize);
+    ++chunksWritten;
+    return isOpen();
+}
+
+bool MultiSetStreamWriter::close() {
+    if(!file.is_open()) return false;
+    const bool complete = isOpen() && chunksWritten == chunkCount();
+    file.close();
+    return complete && !file.fail();
+}
+
+MultiSetStreamWriter::~MultiSetStreamWriter() {
+    delete[] encoded;
+}
+
+MultiSetStreamReader::MultiSetStreamReader(const char* fileName)
+        : file(fileName, std::ios::binary), maxNumber(0), bucketSize(0), chunkCounters(0),
+          chunksRead(0), valid(false), encoded(nullptr) {
+    if(!file){
+        std::cout<<"Error opening input file!\n";
+        return;
+    }
+
+    uint8_t header[STREAM_HEADER_SIZE];
+    if(!file.read((char*) header, STREAM_HEADER_SIZE) ||
+       std::memcmp(header, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0 ||
+       loadLittleEndian(header + 4, 2) != STREAM_VERSION ||
+       loadLittleEndian(header + 6, 2) != STREAM_HEADER_SIZE){
+        std::cout<<"Invalid MultiSet stream!\n";
+        return;
+    }
+
+    const uint64_t k = loadLittleEndian(header + 8, 4);
+    const uint64_t n = loadLittleEndian(header + 16, 8);
+    const uint64_t counters = loadLittleEndian(header + 24, 8);
+    // The chunk size bounds the reader's memory, so only the one we write is accepted
+    if(k < 1 || k > 8 || n > UINT32_MAX || counters != MultiSetStream::CHUNK_COUNTERS){
+        std::cout<<"Invalid MultiSet stream!\n";
+        return;
+    }
+
+    maxNumber = (unsigned int) n;
+    bucketSize = (unsigned int) k;
+    chunkCounters = (size_t) counters;
+    valid = true;
+    encoded = new uint8_t[chunkBytes(0)];
+}
+
+bool MultiSetStreamReader::isValid() const {
+    return valid;
+}
+
+unsigned int MultiSetStreamReader::getMaxNumber() const {
+    return maxNumber;
+}
+
+unsigned int MultiSetStreamReader::getBucketSize() const {
+    return bucketSize;
+}
+
+size_t MultiSetStreamReader::chunkCount() const {
+    return valid ? chunkCountOf(maxNumber, chunkCounters) : 0;
+}
+
+size_t MultiSetStreamReader::chunkLength(size_t chunkIndex) const {
+    return valid ? chunkLengthOf(maxNumber, chunkCounters, chunkIndex) : 0;
+}
+
+size_t MultiSetStreamReader::chunkBytes(size_t chunkIndex) const {
+    return chunkBytesOf(chunkLength(chunkIndex), bucketSize);
+}
+
+bool MultiSetStreamReader::readChunk(uint8_t* counters, bool& allZero) {
+    allZero = true;
+    if(!valid) return false;
+    if(chunksRead >= chunkCount()){
+        std::memset(counters, 0, chunkBytesOf(chunkCounters, bucketSize));
+        return true;
+    }
+    const size_t size = chunkBytes(chunksRead);
+
+    uint8_t record[RECORD_HEADER_SIZE];
+    if(!file.read((char*) record, RECORD_HEADER_SIZE)){
+        valid = false;
+        return false;
+    }
+    const uint8_t encoding = record[0];
+    const size_t payloadSize = (size_t) loadLittleEndian(record + 1, 4);
+
+    if (encoding == MultiSetStream::ZERO && payloadSize == 0) {
+        std::memset(counters, 0, size);
+    }
+    else if (encoding == MultiSetStream::RAW && payloadSize == size) {
+        valid = (bool) file.read((char*) counters, size);
+        allZero = false;
+    }
+    else if (encoding == MultiSetStream::RUNS && payloadSize < size) {
+        valid = file.read((char*) encoded, payloadSize) && decodeRuns(encoded, payloadSize, counters, size);
+        allZero = false;
+    }
+    else valid = false;
+
+    ++chunksRead;
+    return valid;
+}
+
+MultiSetStreamReader::~MultiSetStreamReader() {
+    delete[] encoded;
+}
+
+// Reads both inputs chunk by chunk, combines every chunk with the packed kernel and
+// writes it out. Only three chunk buffers are ever held, whatever the set sizes.
+template <typename Kernel>
+static void combineFiles(const char* first, const char* second, const char* result,
+                         bool outputIsLarger, bool zeroIfEitherZero, Kernel kernel) {
+    MultiSetStreamReader a(first);
+    MultiSetStreamReader b(second);
+    if(!a.isValid() || !b.isValid()) return;
+    if(a.getBucketSize() != b.getBucketSize())
+        throw std::invalid_argument("Incompatible Set!");
+
+    const unsigned int k = a.getBucketSize();
+    const unsigned int aMax = a.getMaxNumber(), bMax = b.getMaxNumber();
+    const unsigned int n = (aMax < bMax) == outputIsLarger ? bMax : aMax;
+    MultiSetStreamWriter out(result, n, k);
+    if(!out.isOpen()) return;
+
+    const size_t bufferSize = PackedKernels::bufferSize(MultiSetStream::CHUNK_COUNTERS, k);
+    uint8_t* aChunk = new uint8_t[bufferSize]();
+    uint8_t* bChunk = new uint8_t[bufferSize]();
+    uint8_t* outChunk = new uint8_t[bufferSize]();
+
+    bool ok = true;
+    for (size_t chunk = 0; ok && chunk < out.chunkCount(); ++chunk) {
+        bool aZero, bZero;
+        ok = a.readChunk(aChunk, aZero) && b.readChunk(bChunk, bZero);
+        if (!ok) break;
+
+        if ((aZero && bZero) || (zeroIfEitherZero && (aZero || bZero))) {
+            ok = out.writeChunk(nullptr);
+            continue;
+        }
+        kernel(aChunk, a.chunkLength(chunk), bChunk, b.chunkLength(chunk),
+               outChunk, out.chunkLength(chunk), k);
+        ok = out.writeChunk(outChunk);
+    }
+
+    delete[] aChunk;
+    delete[] bChunk;
+    delete[] outChunk;
+    if(!ok || !out.close())
+        std::cout<<"Error writing MultiSet stream!\n";
+}
+
+void MultiSetStream::intersection(const char* first, const char* second, const char* result) {
+    combineFiles(first, second, result, false, true,
+                 [](const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                    uint8_t* out, size_t outCount, unsigned int k) {
+        PackedKernels::intersection(a, aCount, b, bCount, out, outCount, k);
+    });
+}
+
+void MultiSetStream::difference(const char* first, const char* second, const char* result) {
+    combineFiles(first, second, result, true, false,
+                 [](const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                    uint8_t* out, size_t outCount, unsigned int k) {
+        PackedKernels::difference(a, aCount, b, bCount, out, outCount, k);
+    });
+}
+
+void MultiSetStream::unite(const char* first, const char* second, const char* result) {
+    combineFiles(first, second, result, true, false,
+                 [](const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                    uint8_t* out, size_t outCount, unsigned int k) {
+        PackedKernels::unite(a, aCount, b, bCount, out, outCount, k);
+    });
+}
+
+void MultiSetStream::complement(const char* source, const char* result) {
+    MultiSetStreamReader in(source);
+    if(!in.isValid()) return;
+    const unsigned int k = in.getBucketSize();
+    MultiSetStreamWriter out(result, in.getMaxNumber(), k);
+    if(!out.isOpen()) return;
+
+    const size_t bufferSize = PackedKernels::bufferSize(CHUNK_COUNTERS, k);
+    uint8_t* inChunk = new uint8_t[bufferSize]();
+    uint8_t* outChunk = new uint8_t[bufferSize]();
+
+    bool ok = true;
+    for (size_t chunk = 0; ok && chunk < out.chunkCount(); ++chunk) {
+        bool zero;
+        ok = in.readChunk(inChunk, zero);
+        if (!ok) break;
+        PackedKernels::complement(inChunk, in.chunkLength(chunk), outChunk, k);
+        ok = out.writeChunk(outChunk);
+    }
+
+    delete[] inChunk;
+    delete[] outChunk;
+    if(!ok || !out.close())
+        std::cout<<"Error writing MultiSet stream!\n";
+}
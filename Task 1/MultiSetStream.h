@@ -0,0 +1,74 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+
+// Chunked, compressed file format for MultiSets that do not fit in memory.
+// The counters are cut into chunks of CHUNK_COUNTERS numbers (always whole bytes of
+// the packed layout) and every chunk is stored on its own as all-zero, raw packed
+// bytes, or zero-run elided bytes, whichever is smallest. Integers are little-endian.
+class MultiSetStream {
+public:
+    static const size_t CHUNK_COUNTERS;
+
+    enum ChunkEncoding : uint8_t { ZERO, RAW, RUNS };
+
+    // Set operations from file to file, holding one chunk of every file in memory.
+    // Same semantics as MultiSet::intersection/difference/fillInMultiSet/unite.
+    static void intersection(const char* first, const char* second, const char* result);
+    static void difference(const char* first, const char* second, const char* result);
+    static void unite(const char* first, const char* second, const char* result);
+    static void complement(const char* source, const char* result);
+};
+
+class MultiSetStreamWriter {
+    std::ofstream file;
+    unsigned int maxNumber;
+    unsigned int bucketSize;
+    size_t chunksWritten;
+    uint8_t* encoded;
+
+    void writeHeader();
+public:
+    MultiSetStreamWriter(const char* fileName, unsigned int n, unsigned int k);
+    MultiSetStreamWriter(const MultiSetStreamWriter& other) = delete;
+    MultiSetStreamWriter& operator= (const MultiSetStreamWriter& other) = delete;
+
+    bool isOpen() const;
+    size_t chunkCount() const;
+    size_t chunkLength(size_t chunkIndex) const; // numbers in the chunk
+    size_t chunkBytes(size_t chunkIndex) const; // packed bytes of the chunk
+
+    // Writes the next chunk given its packed counters, or all zeroes for nullptr
+    bool writeChunk(const uint8_t* counters);
+    bool close(); // false if anything failed or not every chunk was written
+
+    ~MultiSetStreamWriter();
+};
+
+class MultiSetStreamReader {
+    std::ifstream file;
+    unsigned int maxNumber;
+    unsigned int bucketSize;
+    size_t chunkCounters;
+    size_t chunksRead;
+    bool valid;
+    uint8_t* encoded;
+public:
+    explicit MultiSetStreamReader(const char* fileName);
+    MultiSetStreamReader(const MultiSetStreamReader& other) = delete;
+    MultiSetStreamReader& operator= (const MultiSetStreamReader& other) = delete;
+
+    bool isValid() const; // header read and every chunk so far well-formed
+    unsigned int getMaxNumber() const;
+    unsigned int getBucketSize() const;
+    size_t chunkCount() const;
+    size_t chunkLength(size_t chunkIndex) const;
+    size_t chunkBytes(size_t chunkIndex) const;
+
+    // Decodes the next chunk into counters (chunkBytes bytes). Past the last chunk it
+    // clears a full chunk of counters and reports allZero, so shorter sets read as padded
+    // with zero counts; counters must hold a full chunk for that.
+    bool readChunk(uint8_t* counters, bool& allZero);
+
+    ~MultiSetStreamReader();
+};
@@ -0,0 +1,368 @@
+#include "PackedKernels.h"
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define PACKED_KERNELS_X86
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <cstring>
+
+const uint64_t PackedKernels::LOW_BITS = 0x0101010101010101ULL;
+const uint64_t PackedKernels::HIGH_BITS = 0x8080808080808080ULL;
+const size_t PackedKernels::ALL_GROUPS;
+
+static unsigned int lowestSetBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// Little-endian load of up to 8 bytes, bytes past the buffer read as 0
+static uint64_t loadWord(const uint8_t* buffer, size_t bufferSize, size_t offset) {
+    uint64_t word = 0;
+    if (offset + 8 <= bufferSize) {
+        std::memcpy(&word, buffer + offset, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        return word;
+    }
+    for (size_t i = 0; offset + i < bufferSize; ++i)
+        word |= (uint64_t)buffer[offset + i] << (8 * i);
+    return word;
+}
+
+static bool hasBmi2() {
+#ifdef PACKED_KERNELS_X86
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("bmi2"));
+    return supported;
+#else
+    return false;
+#endif
+}
+
+#ifdef PACKED_KERNELS_X86
+__attribute__((target("bmi2")))
+static uint64_t spreadBmi2(uint64_t packed, uint64_t mask) {
+    return _pdep_u64(packed, mask);
+}
+
+__attribute__((target("bmi2")))
+static uint64_t packBmi2(uint64_t lanes, uint64_t mask) {
+    return _pext_u64(lanes, mask);
+}
+#endif
+
+// The k bytes of a group, counters past count read as 0
+static uint64_t loadGroup(const uint8_t* buffer, size_t count, size_t group, unsigned int bucketSize) {
+    const size_t first = group * 8;
+    if (first >= count) return 0;
+
+    const size_t fields = count - first < 8 ? count - first : 8;
+    const size_t bits = fields * bucketSize;
+    const size_t bytes = (bits + 7) / 8;
+    const uint8_t* source = buffer + group * bucketSize;
+
+    uint64_t packed = 0;
+    // A whole group with 8 readable bytes is one load
+    if (fields == 8 && (count * bucketSize) / 8 + 1 >= group * bucketSize + 8)
+        packed = loadWord(buffer, group * bucketSize + 8, group * bucketSize);
+    else
+        for (size_t i = 0; i < bytes; ++i)
+            packed |= (uint64_t)source[i] << (8 * i);
+
+    if (bits < 64)
+        packed &= (1ULL << bits) - 1;
+    return packed;
+}
+
+static void storeGroup(uint8_t* buffer, size_t bufferSize, size_t group, unsigned int bucketSize, uint64_t packed) {
+    const size_t offset = group * bucketSize;
+    for (size_t i = 0; i < bucketSize && offset + i < bufferSize; ++i)
+        buffer[offset + i] = (uint8_t)(packed >> (8 * i));
+}
+
+size_t PackedKernels::bufferSize(size_t count, unsigned int bucketSize) {
+    return ((count * bucketSize) / 8) + 1;
+}
+
+size_t PackedKernels::groupCount(size_t count) {
+    return (count + 7) / 8;
+}
+
+size_t PackedKernels::countNonZero(const uint8_t* buffer, size_t count, unsigned int bucketSize) {
+    const size_t groups = (count + 7) / 8;
+    size_t nonZero = 0;
+    for (size_t group = 0; group < groups; ++group) {
+        const uint64_t lanes = spread(loadGroup(buffer, count, group, bucketSize), bucketSize);
+        // High bit of every lane is set iff the lane is not zero
+        const uint64_t flags = (((lanes & ~HIGH_BITS) + ~HIGH_BITS) | lanes) & HIGH_BITS;
+        for (uint64_t rest = flags; rest; rest &= rest - 1)
+            ++nonZero;
+    }
+    return nonZero;
+}
+
+uint64_t PackedKernels::sumRange(const uint8_t* buffer, size_t count, size_t from, size_t to, unsigned int bucketSize) {
+    if (to > count) to = count;
+    uint64_t sum = 0;
+    while (from < to) {
+        const size_t group = from / 8;
+        uint64_t lanes = spread(loadGroup(buffer, count, group, bucketSize), bucketSize);
+
+        // Drop the lanes outside [from, to) of the first and last group
+        const size_t first = from % 8;
+        const size_t last = to - group * 8 < 8 ? to - group * 8 : 8;
+        lanes >>= 8 * first;
+        if (last - first < 8)
+            lanes &= (1ULL << (8 * (last - first))) - 1;
+
+        sum += laneSum(lanes);
+        from = group * 8 + last;
+    }
+    return sum;
+}
+
+size_t PackedKernels::nextNonZero(const uint8_t* buffer, size_t count, size_t from, unsigned int bucketSize) {
+    // A counter is non-zero iff one of its bits is set, so the first set bit at or
+    // after the counter's start identifies it. All-zero words are skipped whole.
+    const size_t size = bufferSize(count, bucketSize);
+    const size_t endBit = count * bucketSize;
+    size_t bit = from * bucketSize;
+
+    while (bit < endBit) {
+        uint64_t word = loadWord(buffer, size, bit / 8) >> (bit % 8);
+        size_t available = 64 - bit % 8;
+        if (endBit - bit < available) {
+            available = endBit - bit;
+            word &= (1ULL << available) - 1;
+        }
+
+        if (word)
+            return (bit + lowestSetBit(word)) / bucketSize;
+        bit += available;
+    }
+    return count;
+}
+
+uint64_t PackedKernels::laneMask(unsigned int bucketSize) {
+    return LOW_BITS * ((1u << bucketSize) - 1);
+}
+
+uint64_t PackedKernels::spread(uint64_t packed, unsigned int bucketSize) {
+    if (bucketSize == 8) return packed;
+#ifdef PACKED_KERNELS_X86
+    if (hasBmi2()) return spreadBmi2(packed, laneMask(bucketSize));
+#endif
+    const uint64_t mask = (1u << bucketSize) - 1;
+    uint64_t lanes = 0;
+    for (unsigned int i = 0; i < 8; ++i)
+        lanes |= ((packed >> (i * bucketSize)) & mask) << (8 * i);
+    return lanes;
+}
+
+uint64_t PackedKernels::pack(uint64_t lanes, unsigned int bucketSize) {
+    if (bucketSize == 8) return lanes;
+#ifdef PACKED_KERNELS_X86
+    if (hasBmi2()) return packBmi2(lanes, laneMask(bucketSize));
+#endif
+    const uint64_t mask = (1u << bucketSize) - 1;
+    uint64_t packed = 0;
+    for (unsigned int i = 0; i < 8; ++i)
+        packed |= ((lanes >> (8 * i)) & mask) << (i * bucketSize);
+    return packed;
+}
+
+uint64_t PackedKernels::greaterOrEqual(uint64_t a, uint64_t b) {
+    // Compare the low 7 bits with the high bit of every lane acting as a borrow guard,
+    // then resolve the high bits separately. The result is 0xFF in every lane where a >= b.
+    const uint64_t low = (a | HIGH_BITS) - (b & ~HIGH_BITS);
+    const uint64_t ge = ((a & ~b) | (~(a ^ b) & low)) & HIGH_BITS;
+    return (ge >> 7) * 0xFF;
+}
+
+void PackedKernels::clearTail(uint8_t* buffer, size_t bufferSize, size_t count, unsigned int bucketSize) {
+    const size_t bit = count * bucketSize;
+    size_t index = bit / 8;
+    if (index >= bufferSize) return;
+
+    buffer[index] &= (uint8_t)((1u << (bit % 8)) - 1);
+    for (++index; index < bufferSize; ++index)
+        buffer[index] = 0;
+}
+
+uint64_t PackedKernels::laneMin(uint64_t a, uint64_t b) {
+    const uint64_t mask = greaterOrEqual(a, b);
+    return (b & mask) | (a & ~mask);
+}
+
+uint64_t PackedKernels::laneAbsDiff(uint64_t a, uint64_t b) {
+    const uint64_t mask = greaterOrEqual(a, b);
+    // max >= min in every lane, so the subtraction never borrows across lanes
+    return ((a & mask) | (b & ~mask)) - ((b & mask) | (a & ~mask));
+}
+
+unsigned int PackedKernels::laneSum(uint64_t lanes) {
+    // Pairwise add into 16 bit lanes (at most 510 each), then fold them with a multiply
+    const uint64_t pairs = (lanes & 0x00FF00FF00FF00FFULL) + ((lanes >> 8) & 0x00FF00FF00FF00FFULL);
+    return (unsigned int)((pairs * 0x0001000100010001ULL) >> 48);
+}
+
+uint64_t PackedKernels::laneSaturatingAdd(uint64_t a, uint64_t b, uint64_t full) {
+    // Below k = 8 both lanes are at most 127, so the plain sum never carries out of a lane
+    if (!(full & HIGH_BITS)) return laneMin(a + b, full);
+    // Add the low 7 bits, then the high bits, recovering the carry out of every lane
+    const uint64_t low = (a & ~HIGH_BITS) + (b & ~HIGH_BITS);
+    const uint64_t sum = low ^ ((a ^ b) & HIGH_BITS);
+    const uint64_t carry = ((a & b) | ((a | b) & ~sum)) & HIGH_BITS;
+    return laneMin(sum | ((carry >> 7) * 0xFF), full);
+}
+
+uint64_t PackedKernels::loadLanes(const uint8_t* buffer, size_t count, size_t group, unsigned int bucketSize) {
+    return spread(loadGroup(buffer, count, group, bucketSize), bucketSize);
+}
+
+void PackedKernels::storeLanes(uint8_t* buffer, size_t count, size_t group, unsigned int bucketSize, uint64_t lanes) {
+    storeGroup(buffer, bufferSize(count, bucketSize), group, bucketSize, pack(lanes, bucketSize));
+}
+
+// Lane-wise operations for combine(). With k = 1 every counter is one bit, so the
+// word form handles 64 counters at once; with k = 8 every counter is a whole byte,
+// so the SSE2 form handles 16 counters per instruction.
+struct MinOperation {
+    static uint64_t lanes(uint64_t a, uint64_t b, uint64_t) { return PackedKernels::laneMin(a, b); }
+    static uint64_t bits(uint64_t a, uint64_t b) { return a & b; }
+#ifdef __SSE2__
+    static __m128i bytes(__m128i a, __m128i b) { return _mm_min_epu8(a, b); }
+#endif
+};
+
+struct AbsDiffOperation {
+    static uint64_t lanes(uint64_t a, uint64_t b, uint64_t) { return PackedKernels::laneAbsDiff(a, b); }
+    static uint64_t bits(uint64_t a, uint64_t b) { return a ^ b; }
+#ifdef __SSE2__
+    static __m128i bytes(__m128i a, __m128i b) { return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)); }
+#endif
+};
+
+struct SaturatingAddOperation {
+    static uint64_t lanes(uint64_t a, uint64_t b, uint64_t full) { return PackedKernels::laneSaturatingAdd(a, b, full); }
+    static uint64_t bits(uint64_t a, uint64_t b) { return a | b; }
+#ifdef __SSE2__
+    static __m128i bytes(__m128i a, __m128i b) { return _mm_adds_epu8(a, b); }
+#endif
+};
+
+#ifdef PACKED_KERNELS_X86
+// The group loop of combine() compiled for BMI2, so pdep and pext are inlined
+template <typename Operation>
+__attribute__((target("bmi2")))
+static void combineGroupsBmi2(const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                              uint8_t* out, size_t outSize, unsigned int bucketSize, uint64_t full,
+                              size_t group, size_t toGroup) {
+    for (; group < toGroup; ++group) {
+        const uint64_t lanes = Operation::lanes(_pdep_u64(loadGroup(a, aCount, group, bucketSize), full),
+                                                _pdep_u64(loadGroup(b, bCount, group, bucketSize), full), full);
+        storeGroup(out, outSize, group, bucketSize, _pext_u64(lanes, full));
+    }
+}
+#endif
+
+template <typename Operation>
+void PackedKernels::combine(const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                            uint8_t* out, size_t outCount, unsigned int bucketSize, size_t fromGroup, size_t toGroup) {
+    const size_t outSize = bufferSize(outCount, bucketSize);
+    const size_t groups = groupCount(outCount);
+    const uint64_t full = laneMask(bucketSize);
+    if (toGroup > groups) toGroup = groups;
+    size_t group = fromGroup;
+
+    // Counters held by both inputs and the output, where nothing has to read as 0
+    size_t common = aCount < bCount ? aCount : bCount;
+    if (common > outCount) common = outCount;
+    if (common > toGroup * 8) common = toGroup * 8;
+
+    if (bucketSize == 1) {
+        // A group is one byte, so 8 groups are one word
+        for (; group * 8 + 64 <= common; group += 8) {
+            uint64_t x, y;
+            std::memcpy(&x, a + group, 8);
+            std::memcpy(&y, b + group, 8);
+            const uint64_t combined = Operation::bits(x, y);
+            std::memcpy(out + group, &combined, 8);
+        }
+    }
+#ifdef __SSE2__
+    if (bucketSize == 8) {
+        for (; group * 8 + 16 <= common; group += 2) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(a + group * 8));
+            __m128i y = _mm_loadu_si128((const __m128i*)(b + group * 8));
+            _mm_storeu_si128((__m128i*)(out + group * 8), Operation::bytes(x, y));
+        }
+    }
+#endif
+
+#ifdef PACKED_KERNELS_X86
+    if (bucketSize != 8 && hasBmi2()) {
+        combineGroupsBmi2<Operation>(a, aCount, b, bCount, out, outSize, bucketSize, full, group, toGroup);
+        group = toGroup;
+    }
+#endif
+    for (; group < toGroup; ++group) {
+        uint64_t lanes = Operation::lanes(spread(loadGroup(a, aCount, group, bucketSize), bucketSize),
+                                          spread(loadGroup(b, bCount, group, bucketSize), bucketSize), full);
+        storeGroup(out, outSize, group, bucketSize, pack(lanes, bucketSize));
+    }
+
+    // Only the range holding the last group owns the tail bytes
+    if (toGroup == groups && fromGroup <= toGroup)
+        clearTail(out, outSize, outCount, bucketSize);
+}
+
+void PackedKernels::intersection(const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                                 uint8_t* out, size_t outCount, unsigned int bucketSize, size_t fromGroup, size_t toGroup) {
+    combine<MinOperation>(a, aCount, b, bCount, out, outCount, bucketSize, fromGroup, toGroup);
+}
+
+void PackedKernels::difference(const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                               uint8_t* out, size_t outCount, unsigned int bucketSize, size_t fromGroup, size_t toGroup) {
+    combine<AbsDiffOperation>(a, aCount, b, bCount, out, outCount, bucketSize, fromGroup, toGroup);
+}
+
+void PackedKernels::unite(const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                          uint8_t* out, size_t outCount, unsigned int bucketSize, size_t fromGroup, size_t toGroup) {
+    combine<SaturatingAddOperation>(a, aCount, b, bCount, out, outCount, bucketSize, fromGroup, toGroup);
+}
+
+// Complementing a k-bit counter flips all of its bits, so whole bytes are flipped
+// without spreading the counters, a word at a time
+void PackedKernels::complement(const uint8_t* a, size_t aCount, uint8_t* out, unsigned int bucketSize,
+                               size_t fromGroup, size_t toGroup) {
+    const size_t size = bufferSize(aCount, bucketSize);
+    const size_t groups = groupCount(aCount);
+    if (toGroup > groups) toGroup = groups;
+    if (fromGroup > toGroup) return;
+
+    size_t byte = fromGroup * bucketSize;
+    size_t end = toGroup * bucketSize;
+    if (end > size) end = size;
+    for (; byte + 8 <= end; byte += 8) {
+        uint64_t word;
+        std::memcpy(&word, a + byte, 8);
+        word = ~word;
+        std::memcpy(out + byte, &word, 8);
+    }
+    for (; byte < end; ++byte)
+        out[byte] = (uint8_t)~a[byte];
+
+    if (toGroup == groups)
+        clearTail(out, size, aCount, bucketSize);
+}
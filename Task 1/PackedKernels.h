@@ -0,0 +1,96 @@
+#pragma once
+#include <iostream>
+#include "PackedLayout.h"
+
+// Word-parallel operations on the packed k-bit counter layout used by MultiSet.
+// Every 8 consecutive counters occupy exactly k bytes, so the buffer is processed
+// in groups of 8 counters: each group is spread into the 8 byte lanes of a uint64_t,
+// combined lane-wise without any per-counter branching and packed back.
+// Spreading uses BMI2 pdep/pext when the CPU has them, picked once at runtime.
+// k = 1 works on 64 counters per word and k = 8 on 16 per SSE2 instruction directly.
+class PackedKernels {
+    static uint64_t laneMask(unsigned int bucketSize);
+    static uint64_t spread(uint64_t packed, unsigned int bucketSize);
+    static uint64_t pack(uint64_t lanes, unsigned int bucketSize);
+    static uint64_t greaterOrEqual(uint64_t a, uint64_t b);
+
+    static void clearTail(uint8_t* buffer, size_t bufferSize, size_t count, unsigned int bucketSize);
+
+    template <typename Operation>
+    static void combine(const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                        uint8_t* out, size_t outCount, unsigned int bucketSize, size_t fromGroup, size_t toGroup);
+public:
+    static const size_t ALL_GROUPS = (size_t)-1;
+
+    static const uint64_t LOW_BITS;
+    static const uint64_t HIGH_BITS;
+
+    static size_t bufferSize(size_t count, unsigned int bucketSize);
+    static size_t groupCount(size_t count); // groups of 8 counters, the unit of the set operations
+
+    // Single counters, index is 0-based. These dispatch once on the runtime
+    // bucket size to the matching PackedLayout<K>.
+    static uint8_t counterAt(const uint8_t* buffer, size_t index, unsigned int bucketSize);
+    static void setCounter(uint8_t* buffer, size_t index, unsigned int bucketSize, uint8_t value);
+    static uint8_t addToCounter(uint8_t* buffer, size_t index, unsigned int bucketSize, unsigned int count);
+    static size_t countNonZero(const uint8_t* buffer, size_t count, unsigned int bucketSize);
+    static uint64_t sumRange(const uint8_t* buffer, size_t count, size_t from, size_t to, unsigned int bucketSize);
+    // First index >= from with a non-zero counter, count if there is none
+    static size_t nextNonZero(const uint8_t* buffer, size_t count, size_t from, unsigned int bucketSize);
+
+    // Lane-wise operations on 8 byte lanes
+    static uint64_t laneMin(uint64_t a, uint64_t b);
+    static uint64_t laneAbsDiff(uint64_t a, uint64_t b);
+    static uint64_t laneSaturatingAdd(uint64_t a, uint64_t b, uint64_t full);
+    static unsigned int laneSum(uint64_t lanes);
+
+    // Counters of one group spread into byte lanes and back
+    static uint64_t loadLanes(const uint8_t* buffer, size_t count, size_t group, unsigned int bucketSize);
+    static void storeLanes(uint8_t* buffer, size_t count, size_t group, unsigned int bucketSize, uint64_t lanes);
+
+    // Counters past the end of an input are treated as 0,
+    // counters past the end of the output are cleared.
+    // [fromGroup, toGroup) selects the groups of the output to compute, so disjoint
+    // ranges can run on different threads. The output may alias an input.
+    static void intersection(const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                             uint8_t* out, size_t outCount, unsigned int bucketSize,
+                             size_t fromGroup = 0, size_t toGroup = ALL_GROUPS);
+    static void difference(const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                           uint8_t* out, size_t outCount, unsigned int bucketSize,
+                           size_t fromGroup = 0, size_t toGroup = ALL_GROUPS);
+    static void unite(const uint8_t* a, size_t aCount, const uint8_t* b, size_t bCount,
+                      uint8_t* out, size_t outCount, unsigned int bucketSize,
+                      size_t fromGroup = 0, size_t toGroup = ALL_GROUPS);
+    static void complement(const uint8_t* a, size_t aCount, uint8_t* out, unsigned int bucketSize,
+                           size_t fromGroup = 0, size_t toGroup = ALL_GROUPS);
+};
+
+#define PACKED_LAYOUT_DISPATCH(bucketSize, call) \
+    switch (bucketSize) { \
+        case 1: { typedef PackedLayout<1> Layout; call; } \
+        case 2: { typedef PackedLayout<2> Layout; call; } \
+        case 3: { typedef PackedLayout<3> Layout; call; } \
+        case 4: { typedef PackedLayout<4> Layout; call; } \
+        case 5: { typedef PackedLayout<5> Layout; call; } \
+        case 6: { typedef PackedLayout<6> Layout; call; } \
+        case 7: { typedef PackedLayout<7> Layout; call; } \
+        default: { typedef PackedLayout<8> Layout; call; } \
+    }
+
+inline uint8_t PackedKernels::counterAt(const uint8_t* buffer, size_t index, unsigned int bucketSize) {
+    PACKED_LAYOUT_DISPATCH(bucketSize, return Layout::counterAt(buffer, index))
+}
+
+inline void PackedKernels::setCounter(uint8_t* buffer, size_t index, unsigned int bucketSize, uint8_t value) {
+    PACKED_LAYOUT_DISPATCH(bucketSize, Layout::setCounter(buffer, index, value); return)
+}
+
+// Saturating add, returns the new value of the counter
+inline uint8_t PackedKernels::addToCounter(uint8_t* buffer, size_t index, unsigned int bucketSize, unsigned int count) {
+    PACKED_LAYOUT_DISPATCH(bucketSize,
+        const uint8_t updated = Layout::saturatingAdd(Layout::counterAt(buffer, index), count);
+        Layout::setCounter(buffer, index, updated);
+        return updated)
+}
+
+#undef PACKED_LAYOUT_DISPATCH
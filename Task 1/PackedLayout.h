@@ -0,0 +1,51 @@
+#pragma once
+#include <iostream>
+
+// Counter access for a bucket size known at compile time.
+// For K = 1, 2, 4 and 8 a counter never straddles a byte, so an access is one
+// shift and one mask; the other sizes read and write a 16 bit window.
+template <unsigned int K>
+struct PackedLayout {
+    static_assert(K >= 1 && K <= 8, "K out of bounds!");
+
+    static constexpr uint8_t MAX_COUNT = (1u << K) - 1;
+    static constexpr bool ALIGNED = 8 % K == 0;
+    static constexpr unsigned int PER_BYTE = 8 / K;
+
+    static uint8_t counterAt(const uint8_t* buffer, size_t index) {
+        if (ALIGNED)
+            return (buffer[index / PER_BYTE] >> ((index % PER_BYTE) * K)) & MAX_COUNT;
+
+        const size_t clusterIndex = (index * K) / 8;
+        const unsigned int bitIndex = (index * K) % 8;
+        unsigned int window = buffer[clusterIndex] >> bitIndex;
+        if (bitIndex + K > 8)
+            window |= (unsigned int)buffer[clusterIndex + 1] << (8 - bitIndex);
+        return window & MAX_COUNT;
+    }
+
+    static void setCounter(uint8_t* buffer, size_t index, uint8_t value) {
+        if (ALIGNED) {
+            const unsigned int shift = (index % PER_BYTE) * K;
+            uint8_t& cluster = buffer[index / PER_BYTE];
+            cluster = (uint8_t)((cluster & ~(MAX_COUNT << shift)) | (value << shift));
+            return;
+        }
+
+        const size_t clusterIndex = (index * K) / 8;
+        const unsigned int bitIndex = (index * K) % 8;
+        const uint16_t mask = (uint16_t)(MAX_COUNT << bitIndex);
+        const uint16_t shifted = (uint16_t)(value << bitIndex);
+        buffer[clusterIndex] = (uint8_t)((buffer[clusterIndex] & ~mask) | (shifted & 0xFF));
+        if (bitIndex + K > 8)
+            buffer[clusterIndex + 1] = (uint8_t)((buffer[clusterIndex + 1] & ~(mask >> 8)) | (shifted >> 8));
+    }
+
+    static uint8_t saturatingAdd(uint8_t current, unsigned int count) {
+        return count >= (unsigned int)(MAX_COUNT - current) ? MAX_COUNT : (uint8_t)(current + count);
+    }
+};
+
+template <unsigned int K> constexpr uint8_t PackedLayout<K>::MAX_COUNT;
+template <unsigned int K> constexpr bool PackedLayout<K>::ALIGNED;
+template <unsigned int K> constexpr unsigned int PackedLayout<K>::PER_BYTE;
@@ -33,5 +33,15 @@ int main(){
     MultiSet difference = set1.difference(set2);
     difference.printNumbers(); // Expected output: 1, 4
 
+    std::cout<<"=====union=====\n";
+    MultiSet united = set1.unite(set2);
+    united.printNumbers(); // Expected output: 1, 2, 2, 3, 3, 4
+
+    std::cout<<"=====file=====\n";
+    difference.serialize("multiset_data.bin");
+    MultiSet loaded;
+    loaded.deserialize("multiset_data.bin");
+    loaded.printNumbers(); // Expected output: 1, 4
+
 
 }
\ No newline at end of file
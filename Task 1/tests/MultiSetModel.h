@@ -0,0 +1,80 @@
+#pragma once
+#include "MultiSet.h"
+#include <vector>
+#include <random>
+#include <fstream>
+
+// The MultiSet tests check every structure against a plain vector of counts, index = number
+
+typedef std::vector<unsigned int> Model;
+
+inline unsigned int maxCount(unsigned int k) {
+    return (1u << k) - 1;
+}
+
+inline void addToModel(Model& model, unsigned int number, unsigned int count, unsigned int k) {
+    model[number] = model[number] + count > maxCount(k) ? maxCount(k) : model[number] + count;
+}
+
+inline MultiSet randomSet(unsigned int n, unsigned int k, size_t additions, std::mt19937& random, Model& model) {
+    MultiSet set(n, k);
+    model.assign(n + 1, 0);
+    for (size_t i = 0; i < additions; ++i) {
+        const unsigned int number = 1 + random() % n;
+        const unsigned int count = 1 + random() % 3;
+        set.add(number, count);
+        addToModel(model, number, count, k);
+    }
+    return set;
+}
+
+inline bool matches(const MultiSet& set, const Model& model) {
+    for (size_t number = 1; number < model.size(); ++number)
+        if (set.occurrenceCount((unsigned int)number) != model[number]) return false;
+    return true;
+}
+
+inline unsigned int countOr0(const Model& model, size_t number) {
+    return number < model.size() ? model[number] : 0;
+}
+
+// Expected results, sized like the result of the MultiSet operation
+inline Model intersectionOf(const Model& a, const Model& b) {
+    Model result(a.size() < b.size() ? a.size() : b.size(), 0);
+    for (size_t i = 1; i < result.size(); ++i)
+        result[i] = a[i] < b[i] ? a[i] : b[i];
+    return result;
+}
+
+inline Model differenceOf(const Model& a, const Model& b) {
+    Model result(a.size() < b.size() ? b.size() : a.size(), 0);
+    for (size_t i = 1; i < result.size(); ++i) {
+        const unsigned int x = countOr0(a, i), y = countOr0(b, i);
+        result[i] = x > y ? x - y : y - x;
+    }
+    return result;
+}
+
+inline Model unionOf(const Model& a, const Model& b, unsigned int k) {
+    Model result(a.size() < b.size() ? b.size() : a.size(), 0);
+    for (size_t i = 1; i < result.size(); ++i)
+        addToModel(result, (unsigned int)i, countOr0(a, i) + countOr0(b, i), k);
+    return result;
+}
+
+inline Model complementOf(const Model& a, unsigned int k) {
+    Model result(a.size(), 0);
+    for (size_t i = 1; i < result.size(); ++i)
+        result[i] = maxCount(k) - a[i];
+    return result;
+}
+
+inline std::vector<uint8_t> readFile(const char* fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+inline void writeFile(const char* fileName, const std::vector<uint8_t>& data) {
+    std::ofstream file(fileName, std::ios::binary);
+    file.write((const char*) data.data(), data.size());
+}
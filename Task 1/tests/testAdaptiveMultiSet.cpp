@@ -0,0 +1,100 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+#include "AdaptiveMultiSet.h"
+#include <cstdio>
+
+static const char* const FILE_NAME = "test_adaptive.bin";
+static const char* const OTHER_FILE_NAME = "test_adaptive_other.bin";
+
+static bool matches(const AdaptiveMultiSet& set, const Model& model, unsigned int n) {
+    for (unsigned int i = 1; i <= n; ++i)
+        if (set.occurrenceCount(i) != countOr0(model, i)) return false;
+    return true;
+}
+
+static void testAgainstModel() {
+    std::mt19937 random(7);
+    for (unsigned int k : { 1u, 4u, 8u }) {
+        const unsigned int n = 300000;
+        Model a(n + 1, 0), b(n / 2 + 1, 0);
+        AdaptiveMultiSet first(n, k), second(n / 2, k);
+        // A dense chunk, the rest sparse or empty
+        for (unsigned int number = 1; number <= 70000; number += 2) {
+            first.add(number);
+            addToModel(a, number, 1, k);
+        }
+        for (size_t i = 0; i < 2000; ++i) {
+            const unsigned int x = 1 + random() % n, y = 1 + random() % (n / 2);
+            first.add(x, 2);
+            addToModel(a, x, 2, k);
+            second.add(y);
+            addToModel(b, y, 1, k);
+        }
+        CHECK(matches(first, a, n));
+        CHECK(matches(second, b, n / 2));
+        CHECK(matches(first.intersection(second), intersectionOf(a, b), n / 2));
+        CHECK(matches(first.difference(second), differenceOf(a, b), n));
+
+        first.serialize(FILE_NAME);
+        AdaptiveMultiSet loaded;
+        loaded.deserialize(FILE_NAME);
+        CHECK(matches(loaded, a, n));
+    }
+}
+
+// Header, then the first chunk: kind, entry count, offsets, counts
+static void testCorruptSparseChunks() {
+    AdaptiveMultiSet sparse(100, 2);
+    sparse.add(5);
+    sparse.add(9, 2);
+    sparse.serialize(FILE_NAME);
+    const std::vector<uint8_t> data = readFile(FILE_NAME);
+    const size_t offsets = 37, counts = 41;
+    const size_t positions[] = { offsets, offsets, counts, counts };
+    const uint8_t values[] = { 20, 100, 0, 4 }; // unsorted, past the chunk, zero, over 2^k - 1
+    for (size_t i = 0; i < 4; ++i) {
+        std::vector<uint8_t> broken = data;
+        broken[positions[i]] = values[i];
+        writeFile(OTHER_FILE_NAME, broken);
+        AdaptiveMultiSet target(10, 2);
+        target.add(3);
+        target.deserialize(OTHER_FILE_NAME);
+        CHECK(target.memoryUsage() == 0);
+    }
+    AdaptiveMultiSet loaded;
+    loaded.deserialize(FILE_NAME);
+    CHECK(loaded.occurrenceCount(5) == 1 && loaded.occurrenceCount(9) == 2 && loaded.occurrenceCount(6) == 0);
+}
+
+// Moves hand the chunks over and leave an empty set behind
+static void testMoves() {
+    AdaptiveMultiSet set(200000, 3);
+    set.add(7, 2);
+    set.add(150000);
+    const size_t usage = set.memoryUsage();
+
+    AdaptiveMultiSet moved(std::move(set));
+    CHECK(moved.memoryUsage() == usage && moved.occurrenceCount(7) == 2 && moved.occurrenceCount(150000) == 1);
+    CHECK(set.memoryUsage() == 0);
+
+    AdaptiveMultiSet assigned(10, 1);
+    assigned.add(1);
+    assigned = std::move(moved);
+    CHECK(assigned.memoryUsage() == usage && assigned.occurrenceCount(7) == 2);
+    CHECK(moved.memoryUsage() == 0);
+
+    // Reusable after the move
+    moved = assigned;
+    moved.add(8);
+    CHECK(moved.occurrenceCount(8) == 1 && assigned.occurrenceCount(8) == 0);
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("AdaptiveMultiSet against a count table", testAgainstModel);
+    suite.run("AdaptiveMultiSet corrupt sparse chunks", testCorruptSparseChunks);
+    suite.run("AdaptiveMultiSet moves", testMoves);
+    std::remove(FILE_NAME);
+    std::remove(OTHER_FILE_NAME);
+    return suite.report();
+}
@@ -0,0 +1,81 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+#include "ConcurrentMultiSet.h"
+#include <thread>
+
+// Every thread adds every other number, so each count is known in the end
+static void testConcurrentAdds() {
+    const unsigned int n = 5000, threads = 8, rounds = 3;
+    for (unsigned int k : { 1u, 3u, 8u }) {
+        for (size_t shards : { 1u, 4u }) {
+            ConcurrentMultiSet set(n, k, shards);
+            std::vector<std::thread> workers;
+            for (unsigned int t = 0; t < threads; ++t)
+                workers.emplace_back([&set, t] {
+                    for (unsigned int round = 0; round < rounds; ++round)
+                        for (unsigned int number = 1 + t % 2; number <= n; number += 2)
+                            set.add(number);
+                });
+            for (std::thread& worker : workers)
+                worker.join();
+
+            const unsigned int expected = threads / 2 * rounds > maxCount(k) ? maxCount(k) : threads / 2 * rounds;
+            const MultiSet snapshot = set.toMultiSet();
+            bool same = true;
+            for (unsigned int number = 1; number <= n; ++number)
+                same = same && set.occurrenceCount(number) == expected && snapshot.occurrenceCount(number) == expected;
+            CHECK(same);
+        }
+    }
+}
+
+static void testAgainstModel() {
+    std::mt19937 random(8);
+    for (unsigned int k = 1; k <= 8; ++k) {
+        const unsigned int n = 3001 + k;
+        ConcurrentMultiSet set(n, k, 3);
+        Model model(n + 1, 0);
+        for (size_t i = 0; i < 6000; ++i) {
+            const unsigned int number = 1 + random() % n, count = random() % 3;
+            set.add(number, count);
+            addToModel(model, number, count, k);
+        }
+        CHECK(matches(set.toMultiSet(), model));
+    }
+}
+
+// Threads land on different shards, so the snapshot has to saturate across shards
+static void testShardedSnapshot() {
+    const unsigned int threads = 6;
+    for (unsigned int k = 1; k <= 8; ++k) {
+        const unsigned int n = 2000 + 13 * k;
+        ConcurrentMultiSet set(n, k, 4);
+        std::vector<Model> models(threads, Model(n + 1, 0));
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; ++t)
+            workers.emplace_back([&set, &models, t, n, k] {
+                std::mt19937 random(t + 10 * k);
+                for (size_t i = 0; i < 4000; ++i) {
+                    const unsigned int number = 1 + random() % n, count = random() % 4;
+                    set.add(number, count);
+                    models[t][number] += count;
+                }
+            });
+        for (std::thread& worker : workers)
+            worker.join();
+
+        Model expected(n + 1, 0);
+        for (const Model& model : models)
+            for (unsigned int number = 1; number <= n; ++number)
+                addToModel(expected, number, model[number], k);
+        CHECK(matches(set.toMultiSet(), expected));
+    }
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("ConcurrentMultiSet concurrent adds", testConcurrentAdds);
+    suite.run("ConcurrentMultiSet against a count table", testAgainstModel);
+    suite.run("ConcurrentMultiSet sharded snapshot", testShardedSnapshot);
+    return suite.report();
+}
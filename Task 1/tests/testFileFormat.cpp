@@ -0,0 +1,109 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+
+static const char* const FILE_NAME = "test_file_format.bin";
+static const char* const OTHER_FILE_NAME = "test_file_format_other.bin";
+static const size_t HEADER_SIZE = 64;
+
+static void testRoundTrip() {
+    std::mt19937 random(5);
+    for (unsigned int k = 1; k <= 8; ++k) {
+        Model model;
+        const MultiSet set = randomSet(5000 + k, k, 4000, random, model);
+        set.serialize(FILE_NAME);
+
+        MultiSet loaded;
+        loaded.deserialize(FILE_NAME);
+        CHECK(matches(loaded, model));
+
+        MultiSet mapped;
+        mapped.map(FILE_NAME, true);
+        CHECK(matches(mapped, model));
+        if (mapped.isReadOnly()) {
+            bool threw = false;
+            try { mapped.add(1); } catch (const std::logic_error&) { threw = true; }
+            CHECK(threw);
+        }
+    }
+}
+
+// A flipped payload bit or a missing byte leaves the target untouched
+static void testCorruptFiles() {
+    std::mt19937 random(6);
+    for (unsigned int k = 1; k <= 8; ++k) {
+        Model model;
+        randomSet(3000, k, 2000, random, model).serialize(FILE_NAME);
+
+        std::vector<uint8_t> data = readFile(FILE_NAME);
+        data[HEADER_SIZE + random() % (data.size() - HEADER_SIZE)] ^= 0x10;
+        writeFile(OTHER_FILE_NAME, data);
+        MultiSet target(3, 1);
+        target.add(2);
+        target.deserialize(OTHER_FILE_NAME);
+        CHECK(target.occurrenceCount(2) == 1 && target.occurrenceCount(3) == 0);
+        target.map(OTHER_FILE_NAME, true);
+        CHECK(!target.isReadOnly() && target.occurrenceCount(2) == 1);
+
+        data = readFile(FILE_NAME);
+        data.resize(data.size() - 1);
+        writeFile(OTHER_FILE_NAME, data);
+        target.deserialize(OTHER_FILE_NAME);
+        CHECK(target.occurrenceCount(2) == 1 && target.occurrenceCount(3) == 0);
+        target.map(OTHER_FILE_NAME);
+        CHECK(!target.isReadOnly() && target.occurrenceCount(2) == 1);
+    }
+}
+
+// A file with the magic but a header this version cannot read is not an old headerless file
+static void testUnsupportedHeaders() {
+    MultiSet set(4000, 3);
+    set.add(7, 5);
+    set.serialize(FILE_NAME);
+    const std::vector<uint8_t> data = readFile(FILE_NAME);
+    const size_t positions[] = { 4, 6, 12, 24 }; // version, header size, k, payload size
+    for (size_t position : positions) {
+        std::vector<uint8_t> broken = data;
+        broken[position] ^= 0x40;
+        writeFile(OTHER_FILE_NAME, broken);
+        MultiSet target(3, 1);
+        target.add(2);
+        target.deserialize(OTHER_FILE_NAME);
+        CHECK(target.occurrenceCount(2) == 1 && target.occurrenceCount(3) == 0);
+        target.map(OTHER_FILE_NAME);
+        CHECK(!target.isReadOnly() && target.occurrenceCount(2) == 1);
+    }
+}
+
+// Files from before the header: n, then k as size_t, then the counters
+static void testLegacyFile() {
+    MultiSet old(20, 3);
+    old.add(5, 4);
+    old.add(20, 7);
+    old.serialize(FILE_NAME);
+    const std::vector<uint8_t> data = readFile(FILE_NAME);
+    std::vector<uint8_t> legacy(sizeof(unsigned int) + sizeof(size_t));
+    const unsigned int n = 20;
+    const size_t k = 3;
+    std::memcpy(legacy.data(), &n, sizeof(n));
+    std::memcpy(legacy.data() + sizeof(n), &k, sizeof(k));
+    legacy.insert(legacy.end(), data.begin() + HEADER_SIZE, data.end());
+    writeFile(OTHER_FILE_NAME, legacy);
+
+    MultiSet loaded;
+    loaded.deserialize(OTHER_FILE_NAME);
+    CHECK(loaded.occurrenceCount(5) == 4 && loaded.occurrenceCount(20) == 7 && loaded.occurrenceCount(1) == 0);
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("MultiSet file round trip", testRoundTrip);
+    suite.run("MultiSet corrupt files", testCorruptFiles);
+    suite.run("MultiSet unsupported headers", testUnsupportedHeaders);
+    suite.run("MultiSet legacy file", testLegacyFile);
+    std::remove(FILE_NAME);
+    std::remove(OTHER_FILE_NAME);
+    return suite.report();
+}
@@ -0,0 +1,66 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+#include "FixedMultiSet.h"
+
+// FixedMultiSet<K> has to agree with MultiSet(n, K) on every operation
+template <unsigned int K>
+static void testAgainstMultiSet(std::mt19937& random) {
+    FixedMultiSet<K> fixedA(777), fixedB(500);
+    MultiSet a(777, K), b(500, K);
+    for (size_t i = 0; i < 1500; ++i) {
+        const unsigned int x = 1 + random() % 777, y = 1 + random() % 500;
+        fixedA.add(x);
+        a.add(x);
+        fixedB.add(y, 2);
+        b.add(y, 2);
+    }
+    const MultiSet intersection = a.intersection(b), difference = a.difference(b), complement = a.fillInMultiSet();
+    const FixedMultiSet<K> fixedIntersection = fixedA.intersection(fixedB), fixedDifference = fixedA.difference(fixedB),
+            fixedComplement = fixedA.fillInMultiSet();
+    bool same = true;
+    for (unsigned int i = 1; i <= 777; ++i) {
+        same = same && fixedA.occurrenceCount(i) == a.occurrenceCount(i) &&
+               fixedDifference.occurrenceCount(i) == difference.occurrenceCount(i) &&
+               fixedComplement.occurrenceCount(i) == complement.occurrenceCount(i);
+        if (i <= 500) same = same && fixedIntersection.occurrenceCount(i) == intersection.occurrenceCount(i);
+    }
+    CHECK(same);
+}
+
+// Copies of a default-constructed set hold no buffer
+template <unsigned int K>
+static void testCopies() {
+    FixedMultiSet<K> set(40);
+    set.add(3, 2);
+    const FixedMultiSet<K> empty;
+    FixedMultiSet<K> copy(empty);
+    copy = set;
+    CHECK(copy.occurrenceCount(3) == set.occurrenceCount(3));
+    copy = empty;
+    FixedMultiSet<K> again(copy);
+    again = set;
+    CHECK(again.occurrenceCount(3) == set.occurrenceCount(3) && again.occurrenceCount(4) == 0);
+}
+
+static void testFixedMultiSets() {
+    std::mt19937 random(11);
+    testAgainstMultiSet<1>(random);
+    testAgainstMultiSet<2>(random);
+    testAgainstMultiSet<3>(random);
+    testAgainstMultiSet<4>(random);
+    testAgainstMultiSet<5>(random);
+    testAgainstMultiSet<8>(random);
+}
+
+static void testFixedCopies() {
+    testCopies<1>();
+    testCopies<3>();
+    testCopies<8>();
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("FixedMultiSet against MultiSet", testFixedMultiSets);
+    suite.run("FixedMultiSet copies", testFixedCopies);
+    return suite.report();
+}
@@ -0,0 +1,67 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+#include <utility>
+#include <stdexcept>
+
+static const unsigned int SIZES[] = { 1, 9, 64, 65, 1000 };
+
+// The in-place forms give the same counts as the operations that return a new set,
+// whether the other set is shorter or longer
+static void testCompoundOperators() {
+    std::mt19937 random(17);
+    for (unsigned int k = 1; k <= 8; ++k) {
+        for (unsigned int aSize : SIZES) {
+            for (unsigned int bSize : SIZES) {
+                Model a, b;
+                const MultiSet first = randomSet(aSize, k, aSize, random, a);
+                const MultiSet second = randomSet(bSize, k, bSize, random, b);
+
+                MultiSet inPlace(first);
+                inPlace &= second;
+                CHECK(matches(inPlace, intersectionOf(a, b)));
+                inPlace = first;
+                inPlace -= second;
+                CHECK(matches(inPlace, differenceOf(a, b)));
+                inPlace = first;
+                inPlace |= second;
+                CHECK(matches(inPlace, unionOf(a, b, k)));
+                inPlace = first;
+                CHECK(matches(inPlace.complement(), complementOf(a, k)));
+            }
+        }
+    }
+
+    MultiSet a(10, 2);
+    const MultiSet b(10, 3);
+    bool threw = false;
+    try { a &= b; } catch (const std::invalid_argument&) { threw = true; }
+    CHECK(threw);
+}
+
+static void testMoves() {
+    std::mt19937 random(18);
+    Model model;
+    MultiSet set = randomSet(5000, 4, 3000, random, model);
+    set.enableIndex();
+
+    MultiSet moved(std::move(set));
+    CHECK(matches(moved, model) && moved.hasIndex());
+    CHECK(!set.hasIndex());
+
+    MultiSet assigned(3, 1);
+    assigned = std::move(moved);
+    CHECK(matches(assigned, model));
+
+    // A moved-from set can be assigned again
+    set = assigned;
+    set.add(1);
+    addToModel(model, 1, 1, 4);
+    CHECK(matches(set, model));
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("MultiSet compound operators", testCompoundOperators);
+    suite.run("MultiSet moves", testMoves);
+    return suite.report();
+}
@@ -0,0 +1,84 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+
+// size, rangeCount, rank and select against prefix sums of the model
+static bool answersMatch(const MultiSet& set, const Model& model, std::mt19937& random) {
+    std::vector<uint64_t> prefix(model.size() + 1, 0);
+    for (size_t i = 1; i < model.size(); ++i) prefix[i + 1] = prefix[i] + model[i];
+    const unsigned int n = (unsigned int)model.size() - 1;
+    if (set.size() != prefix.back()) return false;
+    for (int query = 0; query < 200; ++query) {
+        unsigned int a = 1 + random() % n, b = 1 + random() % n;
+        if (a > b) std::swap(a, b);
+        if (set.rangeCount(a, b) != prefix[b + 1] - prefix[a]) return false;
+        if (set.rank(a) != prefix[a]) return false;
+        if (set.size() == 0) continue;
+        const uint64_t position = random() % set.size();
+        const unsigned int selected = set.select(position);
+        if (prefix[selected] > position || position >= prefix[selected + 1]) return false;
+    }
+    return true;
+}
+
+static void testQueries() {
+    std::mt19937 random(12);
+    for (unsigned int k : { 1u, 2u, 5u, 8u }) {
+        for (unsigned int n : { 1u, 64u, 65u, 20000u }) {
+            Model model;
+            MultiSet set = randomSet(n, k, n, random, model);
+            CHECK(answersMatch(set, model, random));
+            set.enableIndex();
+            CHECK(set.hasIndex());
+            CHECK(answersMatch(set, model, random));
+
+            // Single adds and batches keep the index up to date
+            std::vector<unsigned int> batch;
+            for (size_t i = 0; i < 300; ++i) batch.push_back(1 + random() % n);
+            set.addAll(batch.data(), batch.size());
+            for (unsigned int number : batch) addToModel(model, number, 1, k);
+            for (size_t i = 0; i < 300; ++i) {
+                const unsigned int number = 1 + random() % n;
+                set.add(number, 2);
+                addToModel(model, number, 2, k);
+            }
+            CHECK(answersMatch(set, model, random));
+        }
+    }
+}
+
+// Set operations on an indexed set hand back an index that matches the new counts
+static void testIndexAfterSetOperations() {
+    std::mt19937 random(13);
+    for (unsigned int k : { 1u, 3u, 8u }) {
+        // The largest size splits the operations across threads in whole blocks
+        for (unsigned int n : { 100u, 5000u, 1200003u }) {
+            Model a, b;
+            MultiSet first = randomSet(n, k, n, random, a);
+            const MultiSet second = randomSet(n / 2 + 3, k, n, random, b);
+            first.enableIndex();
+
+            const MultiSet intersection = first.intersection(second), difference = first.difference(second),
+                    complement = first.fillInMultiSet();
+            CHECK(intersection.hasIndex() && answersMatch(intersection, intersectionOf(a, b), random));
+            CHECK(difference.hasIndex() && answersMatch(difference, differenceOf(a, b), random));
+            CHECK(complement.hasIndex() && answersMatch(complement, complementOf(a, k), random));
+
+            MultiSet inPlace(first);
+            inPlace -= second;
+            CHECK(inPlace.hasIndex() && answersMatch(inPlace, differenceOf(a, b), random));
+            inPlace = first;
+            inPlace &= second;
+            CHECK(inPlace.hasIndex() && answersMatch(inPlace, intersectionOf(a, b), random));
+            inPlace = first;
+            inPlace.complement();
+            CHECK(inPlace.hasIndex() && answersMatch(inPlace, complementOf(a, k), random));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("MultiSet rank and select", testQueries);
+    suite.run("MultiSet index after set operations", testIndexAfterSetOperations);
+    return suite.report();
+}
@@ -0,0 +1,57 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+#include <stdexcept>
+
+static void testCountedAdd() {
+    std::mt19937 random(3);
+    for (unsigned int k = 1; k <= 8; ++k) {
+        const unsigned int n = 1000 + k;
+        MultiSet set(n, k);
+        Model model(n + 1, 0);
+        for (size_t i = 0; i < 5000; ++i) {
+            const unsigned int number = 1 + random() % n;
+            const unsigned int count = random() % 4 == 0 ? random() % 1000 : random() % 3;
+            set.add(number, count);
+            addToModel(model, number, count, k);
+        }
+        CHECK(matches(set, model));
+    }
+}
+
+static void testAddAll() {
+    std::mt19937 random(4);
+    for (unsigned int k : { 1u, 2u, 5u, 8u }) {
+        Model model;
+        MultiSet set = randomSet(20000, k, 15000, random, model);
+        // Runs of one number, neighbours in one group and scattered values in one batch
+        std::vector<unsigned int> batch;
+        for (size_t i = 0; i < 3000; ++i) batch.push_back(1 + random() % 20000);
+        for (size_t i = 0; i < 300; ++i) batch.push_back(17);
+        for (unsigned int number = 1; number <= 16; ++number) batch.push_back(number);
+        set.addAll(batch.data(), batch.size());
+        for (unsigned int number : batch) addToModel(model, number, 1, k);
+        CHECK(matches(set, model));
+    }
+
+    // A batch with one bad value changes nothing
+    MultiSet set(10, 3);
+    const unsigned int batch[] = { 1, 2, 11 };
+    bool threw = false;
+    try { set.addAll(batch, 3); } catch (const std::out_of_range&) { threw = true; }
+    CHECK(threw);
+    CHECK(set.occurrenceCount(1) == 0 && set.occurrenceCount(2) == 0);
+
+    threw = false;
+    try { set.add(11, 2); } catch (const std::out_of_range&) { threw = true; }
+    CHECK(threw);
+    threw = false;
+    try { set.add(0); } catch (const std::out_of_range&) { threw = true; }
+    CHECK(threw);
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("MultiSet counted add", testCountedAdd);
+    suite.run("MultiSet addAll", testAddAll);
+    return suite.report();
+}
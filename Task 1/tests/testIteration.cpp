@@ -0,0 +1,51 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+
+// Visits every non-zero count once, in increasing order of the numbers
+static void testIterator() {
+    std::mt19937 random(9);
+    for (unsigned int k = 1; k <= 8; ++k) {
+        for (unsigned int n : { 1u, 8u, 63u, 64u, 65u, 20000u }) {
+            Model model;
+            const MultiSet set = randomSet(n, k, random() % (n + 1), random, model);
+            Model seen(n + 1, 0);
+            bool ordered = true;
+            unsigned int previous = 0;
+            for (MultiSet::Iterator it = set.begin(); it != set.end(); ++it) {
+                const MultiSet::Entry entry = *it;
+                ordered = ordered && entry.number > previous && entry.count != 0;
+                previous = entry.number;
+                seen[entry.number] = entry.count;
+            }
+            CHECK(ordered);
+            CHECK(seen == model);
+        }
+    }
+    const MultiSet empty(100, 4);
+    CHECK(empty.begin() == empty.end());
+}
+
+static void testForEach() {
+    std::mt19937 random(10);
+    for (unsigned int k = 1; k <= 8; ++k) {
+        Model model;
+        const MultiSet set = randomSet(4099, k, 1000, random, model);
+        Model seen(model.size(), 0);
+        unsigned int previous = 0;
+        bool ordered = true;
+        set.forEach([&](unsigned int number, uint8_t count) {
+            ordered = ordered && number > previous && count != 0;
+            previous = number;
+            seen[number] = count;
+        });
+        CHECK(ordered);
+        CHECK(seen == model);
+    }
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("MultiSet iterator", testIterator);
+    suite.run("MultiSet forEach", testForEach);
+    return suite.report();
+}
@@ -0,0 +1,42 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+
+// Sizes around the word boundaries of every k
+static const unsigned int SIZES[] = { 1, 7, 8, 9, 63, 64, 65, 1000, 4099 };
+
+static void testSetOperations() {
+    std::mt19937 random(1);
+    for (unsigned int k = 1; k <= 8; ++k) {
+        for (unsigned int aSize : SIZES) {
+            for (unsigned int bSize : SIZES) {
+                Model a, b;
+                const MultiSet first = randomSet(aSize, k, aSize, random, a);
+                const MultiSet second = randomSet(bSize, k, bSize, random, b);
+                CHECK(matches(first.intersection(second), intersectionOf(a, b)));
+                CHECK(matches(first.difference(second), differenceOf(a, b)));
+            }
+        }
+    }
+}
+
+static void testComplement() {
+    std::mt19937 random(2);
+    for (unsigned int k = 1; k <= 8; ++k) {
+        for (unsigned int size : SIZES) {
+            Model a;
+            const MultiSet set = randomSet(size, k, size, random, a);
+            const Model complement = complementOf(a, k);
+            CHECK(matches(set.fillInMultiSet(), complement));
+            MultiSet inPlace(set);
+            CHECK(matches(inPlace.complement(), complement));
+            CHECK(matches(inPlace.complement(), a));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("MultiSet intersection and difference", testSetOperations);
+    suite.run("MultiSet complement", testComplement);
+    return suite.report();
+}
@@ -0,0 +1,80 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+#include "MultiSetStream.h"
+#include <cstdio>
+
+static const char* const FILE_NAME = "test_stream.bin";
+static const char* const OTHER_FILE_NAME = "test_stream_other.bin";
+static const char* const RESULT_FILE_NAME = "test_stream_result.bin";
+
+static void testRoundTripAndFileOperations() {
+    std::mt19937 random(19);
+    const unsigned int n = (unsigned int)MultiSetStream::CHUNK_COUNTERS * 2 + 1001;
+    for (unsigned int k : { 1u, 3u, 8u }) {
+        // Sparse in the first chunk, dense in the second, a short third one
+        Model a(n + 1, 0), b;
+        MultiSet first(n, k);
+        for (size_t i = 0; i < 100; ++i) {
+            const unsigned int number = 1 + random() % (unsigned int)MultiSetStream::CHUNK_COUNTERS;
+            first.add(number);
+            addToModel(a, number, 1, k);
+        }
+        for (unsigned int number = (unsigned int)MultiSetStream::CHUNK_COUNTERS + 1; number <= n; number += 3) {
+            first.add(number, number % 4);
+            addToModel(a, number, number % 4, k);
+        }
+        const MultiSet second = randomSet(n / 2, k, n / 4, random, b);
+
+        first.serializeCompressed(FILE_NAME);
+        second.serializeCompressed(OTHER_FILE_NAME);
+        MultiSet loaded;
+        loaded.deserializeCompressed(FILE_NAME);
+        CHECK(matches(loaded, a));
+
+        MultiSetStream::intersection(FILE_NAME, OTHER_FILE_NAME, RESULT_FILE_NAME);
+        loaded.deserializeCompressed(RESULT_FILE_NAME);
+        CHECK(matches(loaded, intersectionOf(a, b)));
+        MultiSetStream::difference(OTHER_FILE_NAME, FILE_NAME, RESULT_FILE_NAME);
+        loaded.deserializeCompressed(RESULT_FILE_NAME);
+        CHECK(matches(loaded, differenceOf(b, a)));
+        MultiSetStream::unite(FILE_NAME, OTHER_FILE_NAME, RESULT_FILE_NAME);
+        loaded.deserializeCompressed(RESULT_FILE_NAME);
+        CHECK(matches(loaded, unionOf(a, b, k)));
+        MultiSetStream::complement(FILE_NAME, RESULT_FILE_NAME);
+        loaded.deserializeCompressed(RESULT_FILE_NAME);
+        CHECK(matches(loaded, complementOf(a, k)));
+    }
+}
+
+// Truncated files, unknown chunk encodings and a wrong magic leave the set untouched
+static void testCorruptStreams() {
+    MultiSet set((unsigned int)MultiSetStream::CHUNK_COUNTERS + 500, 3);
+    for (unsigned int number = 1; number <= MultiSetStream::CHUNK_COUNTERS + 500; number += 7) set.add(number);
+    set.serializeCompressed(FILE_NAME);
+    const std::vector<uint8_t> data = readFile(FILE_NAME);
+
+    std::vector<std::vector<uint8_t>> broken;
+    broken.push_back(std::vector<uint8_t>(data.begin(), data.end() - 10));
+    broken.push_back(std::vector<uint8_t>(data.begin(), data.begin() + 20));
+    broken.push_back(data);
+    broken.back()[32] = 9; // encoding of the first record
+    broken.push_back(data);
+    broken.back()[0] = 'X';
+    for (const std::vector<uint8_t>& file : broken) {
+        writeFile(OTHER_FILE_NAME, file);
+        MultiSet target(4, 2);
+        target.add(3, 2);
+        target.deserializeCompressed(OTHER_FILE_NAME);
+        CHECK(target.occurrenceCount(3) == 2 && target.occurrenceCount(4) == 0);
+    }
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("MultiSetStream round trip and file operations", testRoundTripAndFileOperations);
+    suite.run("MultiSetStream corrupt files", testCorruptStreams);
+    std::remove(FILE_NAME);
+    std::remove(OTHER_FILE_NAME);
+    std::remove(RESULT_FILE_NAME);
+    return suite.report();
+}
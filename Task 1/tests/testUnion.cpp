@@ -0,0 +1,70 @@
+#include "TestSuite.h"
+#include "MultiSetModel.h"
+#include <stdexcept>
+
+static const unsigned int SIZES[] = { 1, 7, 8, 9, 63, 64, 65, 1000, 4099 };
+
+static void testUnite() {
+    std::mt19937 random(14);
+    for (unsigned int k = 1; k <= 8; ++k) {
+        for (unsigned int aSize : SIZES) {
+            for (unsigned int bSize : SIZES) {
+                Model a, b;
+                const MultiSet first = randomSet(aSize, k, aSize, random, a);
+                const MultiSet second = randomSet(bSize, k, bSize, random, b);
+                CHECK(matches(first.unite(second), unionOf(a, b, k)));
+            }
+        }
+    }
+}
+
+static void testMerge() {
+    std::mt19937 random(15);
+    for (unsigned int k : { 1u, 2u, 7u }) {
+        std::vector<MultiSet> sets;
+        std::vector<const MultiSet*> pointers;
+        Model expected(1, 0);
+        for (unsigned int i = 0; i < 9; ++i) {
+            Model model;
+            sets.push_back(randomSet(SIZES[i], k, 2 * SIZES[i], random, model));
+            expected = unionOf(expected, model, k);
+        }
+        for (const MultiSet& set : sets) pointers.push_back(&set);
+        CHECK(matches(MultiSet::merge(pointers.data(), pointers.size()), expected));
+    }
+
+    bool threw = false;
+    try { MultiSet::merge(nullptr, 0); } catch (const std::invalid_argument&) { threw = true; }
+    CHECK(threw);
+    const MultiSet a(5, 1), b(5, 2);
+    const MultiSet* mixed[] = { &a, &b };
+    threw = false;
+    try { MultiSet::merge(mixed, 2); } catch (const std::invalid_argument&) { threw = true; }
+    CHECK(threw);
+}
+
+// Large enough for the operations to split across the worker pool
+static void testParallelSetOperations() {
+    std::mt19937 random(16);
+    const unsigned int n = 1200003;
+    for (unsigned int k : { 1u, 3u, 8u }) {
+        Model a, b, c;
+        const MultiSet first = randomSet(n, k, n / 2, random, a);
+        const MultiSet second = randomSet(n - 77, k, n / 2, random, b);
+        const MultiSet third = randomSet(n / 3, k, n / 4, random, c);
+
+        CHECK(matches(first.intersection(second), intersectionOf(a, b)));
+        CHECK(matches(first.difference(third), differenceOf(a, c)));
+        CHECK(matches(first.fillInMultiSet(), complementOf(a, k)));
+        const MultiSet* sets[] = { &first, &second, &third };
+        CHECK(matches(MultiSet::merge(sets, 3), unionOf(unionOf(a, b, k), c, k)));
+    }
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("MultiSet unite", testUnite);
+    suite.run("MultiSet merge", testMerge);
+    suite.run("MultiSet parallel set operations", testParallelSetOperations);
+    return suite.report();
+}
@@ -0,0 +1,177 @@
+#include "FunctionEncoding.h"
+
+// Payload: u32 run count, the u32 run lengths (defined points first), u32 segment
+// count, (u16 start, u16 slope, u16 offset) per segment, u32 exception count and
+// (u16 index, u16 result) per exception
+static const size_t SEGMENT_SIZE = 6;
+static const size_t EXCEPTION_SIZE = 4;
+// A break in a line is stored as exceptions when the line resumes this close after
+// it; leaving the line and coming back would cost two segments instead
+static const size_t MAX_EXCEPTION_GAP = 3;
+
+static void appendLittleEndian(std::vector<uint8_t>& out, uint32_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i)
+        out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static bool readLittleEndian(const uint8_t* in, size_t size, size_t& read, size_t bytes, uint32_t& value) {
+    if (size - read < bytes) return false;
+    value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        value |= (uint32_t)in[read + i] << (8 * i);
+    read += bytes;
+    return true;
+}
+
+static bool isDisabledAt(const uint8_t* disabled, size_t index) {
+    return (disabled[index / 8] >> (index % 8)) & 1;
+}
+
+namespace {
+struct Segment {
+    size_t start;
+    uint16_t slope;
+    uint16_t offset;
+
+    uint16_t at(size_t index) const {
+        return (uint16_t)(offset + slope * (index - start));
+    }
+};
+}
+
+void FunctionEncoding::encodeAffine(const int16_t* results, const uint8_t* disabled, size_t count,
+                                    std::vector<uint8_t>& out) {
+    std::vector<uint32_t> runs;
+    bool runDisabled = false;
+    uint32_t runLength = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (isDisabledAt(disabled, i) != runDisabled) {
+            runs.push_back(runLength);
+            runDisabled = !runDisabled;
+            runLength = 0;
+        }
+        runLength++;
+    }
+    runs.push_back(runLength);
+
+    appendLittleEndian(out, (uint32_t)runs.size(), 4);
+    for (size_t i = 0; i < runs.size(); ++i)
+        appendLittleEndian(out, runs[i], 4);
+
+    // Disabled points fit any line
+    auto onLine = [&](const Segment& segment, size_t index) {
+        return isDisabledAt(disabled, index) || (uint16_t)results[index] == segment.at(index);
+    };
+
+    std::vector<Segment> segments;
+    std::vector<size_t> exceptions;
+    size_t start = 0;
+    while (start < count) {
+        // The line through the first two neighbouring defined points
+        Segment segment = { start, 0, 0 };
+        size_t first = start;
+        while (first + 1 < count && (isDisabledAt(disabled, first) || isDisabledAt(disabled, first + 1)))
+            first++;
+        if (first + 1 < count) {
+            segment.slope = (uint16_t)(results[first + 1] - results[first]);
+            segment.offset = (uint16_t)(results[first] - segment.slope * (first - start));
+        }
+        else if (!isDisabledAt(disabled, start)) {
+            segment.offset = (uint16_t)results[start];
+        }
+
+        size_t end = start;
+        while (end < count) {
+            if (onLine(segment, end)) {
+                end++;
+                continue;
+            }
+            size_t resume = 0;
+            for (size_t gap = 1; gap <= MAX_EXCEPTION_GAP && end + gap < count; ++gap) {
+                if (onLine(segment, end + gap) && (end + gap + 1 == count || onLine(segment, end + gap + 1))) {
+                    resume = end + gap;
+                    break;
+                }
+            }
+            if (!resume) break;
+            for (size_t i = end; i < resume; ++i)
+                if (!onLine(segment, i)) exceptions.push_back(i);
+            end = resume;
+        }
+
+        // The first point is off its own line: start a segment of just that point
+        if (end == start) {
+            segment.slope = 0;
+            segment.offset = (uint16_t)results[start];
+            end = start + 1;
+        }
+        segments.push_back(segment);
+        start = end;
+    }
+
+    appendLittleEndian(out, (uint32_t)segments.size(), 4);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        appendLittleEndian(out, (uint32_t)segments[i].start, 2);
+        appendLittleEndian(out, segments[i].slope, 2);
+        appendLittleEndian(out, segments[i].offset, 2);
+    }
+    appendLittleEndian(out, (uint32_t)exceptions.size(), 4);
+    for (size_t i = 0; i < exceptions.size(); ++i) {
+        appendLittleEndian(out, (uint32_t)exceptions[i], 2);
+        appendLittleEndian(out, (uint16_t)results[exceptions[i]], 2);
+    }
+}
+
+bool FunctionEncoding::decodeAffine(const uint8_t* payload, size_t size, int16_t* results, uint8_t* disabled,
+                                    size_t count) {
+    size_t read = 0;
+    uint32_t runCount;
+    if (!readLittleEndian(payload, size, read, 4, runCount) || runCount > count + 1) return false;
+
+    for (size_t i = 0; i < (count + 7) / 8; ++i)
+        disabled[i] = 0;
+    size_t index = 0;
+    for (uint32_t run = 0; run < runCount; ++run) {
+        uint32_t length;
+        if (!readLittleEndian(payload, size, read, 4, length) || length > count - index) return false;
+        if (run % 2)
+            for (size_t i = index; i < index + length; ++i)
+                disabled[i / 8] |= 1 << (i % 8);
+        index += length;
+    }
+    if (index != count) return false;
+
+    uint32_t segmentCount;
+    if (!readLittleEndian(payload, size, read, 4, segmentCount) || !segmentCount ||
+        segmentCount > count || size - read < (size_t)segmentCount * SEGMENT_SIZE) return false;
+    for (uint32_t i = 0; i < segmentCount; ++i) {
+        uint32_t start = 0, slope = 0, offset = 0, next = (uint32_t)count;
+        if (!readLittleEndian(payload, size, read, 2, start) ||
+            !readLittleEndian(payload, size, read, 2, slope) ||
+            !readLittleEndian(payload, size, read, 2, offset)) return false;
+        if (i + 1 < segmentCount) {
+            size_t peek = read;
+            if (!readLittleEndian(payload, size, peek, 2, next)) return false;
+        }
+        if ((i == 0 && start != 0) || start >= next || next > count) return false;
+
+        const Segment segment = { start, (uint16_t)slope, (uint16_t)offset };
+        for (size_t j = start; j < next; ++j)
+            results[j] = (int16_t)segment.at(j);
+    }
+
+    uint32_t exceptionCount;
+    if (!readLittleEndian(payload, size, read, 4, exceptionCount) ||
+        size - read != (size_t)exceptionCount * EXCEPTION_SIZE) return false;
+    for (uint32_t i = 0; i < exceptionCount; ++i) {
+        uint32_t exception = 0, result = 0;
+        if (!readLittleEndian(payload, size, read, 2, exception) ||
+            !readLittleEndian(payload, size, read, 2, result)) return false;
+        if (exception >= count) return false;
+        results[exception] = (int16_t)result;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        if (isDisabledAt(disabled, i)) results[i] = 0;
+    return true;
+}
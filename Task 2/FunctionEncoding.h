@@ -0,0 +1,20 @@
+#pragma once
+#include <iostream>
+#include <vector>
+
+// Compact encoding of a function table for ModifiableIntegerFunction files.
+// Results are cut into affine segments: inside a segment starting at index s the
+// result at index i is offset + slope * (i - s) (mod 2^16). Single points off the line
+// of their segment are stored as exceptions. Disabled points are stored as alternating
+// run lengths of defined and disabled points, and their results are not encoded.
+// Integers are little-endian; indices fit in 16 bits, so count is at most 65536.
+class FunctionEncoding {
+public:
+    // Appends the encoding of count results and their disabled bitmap to out
+    static void encodeAffine(const int16_t* results, const uint8_t* disabled, size_t count,
+                             std::vector<uint8_t>& out);
+    // Fills results and disabled, with 0 as the result of every disabled point.
+    // False when the payload is malformed.
+    static bool decodeAffine(const uint8_t* payload, size_t size, int16_t* results, uint8_t* disabled,
+                             size_t count);
+};
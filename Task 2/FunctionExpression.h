@@ -0,0 +1,116 @@
+#pragma once
+#include <iostream>
+#include <stdexcept>
+#include "Instrumentation.h"
+
+class ModifiableIntegerFunction;
+
+// Anything that can be evaluated point by point over the int16 domain: a
+// ModifiableIntegerFunction itself, or the lazy result of +, - and * on them.
+// Operators only build the expression tree. It is evaluated in one fused pass over
+// the domain when assigned to a ModifiableIntegerFunction, without intermediate tables,
+// or at a single point by invoke. Expressions refer to the functions they were built
+// from, so they have to be evaluated while those are still alive.
+//
+// Every expression provides
+//   void prepare() const; // called once before a pass over the whole domain
+//   int16_t at(size_t index, bool& defined) const; // index = x - INT16_MIN, clears defined where undefined
+template <typename E>
+class FunctionExpression {
+public:
+    const E& self() const {
+        return static_cast<const E&>(*this);
+    }
+
+    int16_t invoke(int16_t number) const {
+        bool defined = true;
+        const int16_t result = self().at(number - INT16_MIN, defined);
+        if(!defined){
+            INSTRUMENT_COUNT(EXCEPTIONS_THROWN, 1);
+            throw std::invalid_argument("The number is disabled!");
+        }
+        return result;
+    }
+};
+
+// Functions are held by reference, intermediate nodes by value
+template <typename E>
+struct ExpressionOperand {
+    typedef E Type;
+};
+
+template <>
+struct ExpressionOperand<ModifiableIntegerFunction> {
+    typedef const ModifiableIntegerFunction& Type;
+};
+
+template <typename L, typename R>
+class BinaryExpression {
+protected:
+    typename ExpressionOperand<L>::Type left;
+    typename ExpressionOperand<R>::Type right;
+public:
+    BinaryExpression(const L& left, const R& right) : left(left), right(right) {}
+
+    const L& leftOperand() const { return left; }
+    const R& rightOperand() const { return right; }
+
+    void prepare() const {
+        left.prepare();
+        right.prepare();
+    }
+};
+
+// (f + g)(x), undefined where either is
+template <typename L, typename R>
+class FunctionSum : public FunctionExpression<FunctionSum<L, R>>, public BinaryExpression<L, R> {
+public:
+    FunctionSum(const L& left, const R& right) : BinaryExpression<L, R>(left, right) {}
+
+    int16_t at(size_t index, bool& defined) const {
+        const int16_t a = this->left.at(index, defined);
+        const int16_t b = this->right.at(index, defined);
+        return (int16_t)(a + b);
+    }
+};
+
+// (f - g)(x), undefined where either is
+template <typename L, typename R>
+class FunctionDifference : public FunctionExpression<FunctionDifference<L, R>>, public BinaryExpression<L, R> {
+public:
+    FunctionDifference(const L& left, const R& right) : BinaryExpression<L, R>(left, right) {}
+
+    int16_t at(size_t index, bool& defined) const {
+        const int16_t a = this->left.at(index, defined);
+        const int16_t b = this->right.at(index, defined);
+        return (int16_t)(a - b);
+    }
+};
+
+// (f * g)(x) = f(g(x)), undefined where g(x) or f(g(x)) is
+template <typename L, typename R>
+class FunctionComposition : public FunctionExpression<FunctionComposition<L, R>>, public BinaryExpression<L, R> {
+public:
+    FunctionComposition(const L& left, const R& right) : BinaryExpression<L, R>(left, right) {}
+
+    int16_t at(size_t index, bool& defined) const {
+        const int16_t inner = this->right.at(index, defined);
+        if(!defined) return 0;
+        return this->left.at(inner - INT16_MIN, defined);
+    }
+};
+
+template <typename L, typename R>
+FunctionSum<L, R> operator+(const FunctionExpression<L>& left, const FunctionExpression<R>& right) {
+    return FunctionSum<L, R>(left.self(), right.self());
+}
+
+template <typename L, typename R>
+FunctionDifference<L, R> operator-(const FunctionExpression<L>& left, const FunctionExpression<R>& right) {
+    return FunctionDifference<L, R>(left.self(), right.self());
+}
+
+template <typename L, typename R>
+FunctionComposition<L, R> operator*(const FunctionExpression<L>& left, const FunctionExpression<R>& right) {
+    return FunctionComposition<L, R>(left.self(), right.self());
+}
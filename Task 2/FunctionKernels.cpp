@@ -0,0 +1,299 @@
+#include "FunctionKernels.h"
+#include <cstring>
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define FUNCTION_KERNELS_X86
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static unsigned int lowestSetBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// Word of the bitmap in host order, only for order-independent uses
+static uint64_t rawWord(const uint8_t* bits, size_t index) {
+    uint64_t word;
+    std::memcpy(&word, bits + index * 8, sizeof(word));
+    return word;
+}
+
+// Little-endian word of the bitmap, bit j belongs to result index * 64 + j
+static uint64_t loadWord(const uint8_t* bits, size_t index) {
+    uint64_t word = 0;
+    for (size_t i = 0; i < 8; ++i)
+        word |= (uint64_t)bits[index * 8 + i] << (8 * i);
+    return word;
+}
+
+static unsigned int loadBits(const uint8_t* bits, size_t first, size_t lanes) {
+    // Little-endian like the bitmap itself, so bit j belongs to result first + j
+    unsigned int value = 0;
+    for (size_t i = 0; i < lanes / 8; ++i)
+        value |= (unsigned int)bits[first / 8 + i] << (8 * i);
+    return value;
+}
+
+// One entry per instruction set, filled with the best one the CPU runs
+struct KernelTable {
+    const char* name;
+    void (*add)(const int16_t*, const int16_t*, int16_t*, size_t);
+    void (*subtract)(const int16_t*, const int16_t*, int16_t*, size_t);
+    bool (*equal)(const int16_t*, const int16_t*, size_t);
+    bool (*less)(const int16_t*, const uint8_t*, const int16_t*, const uint8_t*, size_t);
+    size_t (*gather)(const int16_t*, const uint8_t*, const int16_t*, int16_t*, uint8_t*, size_t);
+};
+
+static void addScalar(const int16_t* a, const int16_t* b, int16_t* out, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        out[i] = (int16_t)(a[i] + b[i]);
+}
+
+static void subtractScalar(const int16_t* a, const int16_t* b, int16_t* out, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        out[i] = (int16_t)(a[i] - b[i]);
+}
+
+static bool equalScalar(const int16_t* a, const int16_t* b, size_t count) {
+    return std::memcmp(a, b, count * sizeof(int16_t)) == 0;
+}
+
+static bool lessScalar(const int16_t* a, const uint8_t* aDisabled, const int16_t* b, const uint8_t* bDisabled, size_t count) {
+    for (size_t word = 0; word < count / 64; ++word) {
+        const uint64_t aOff = loadWord(aDisabled, word), bOff = loadWord(bDisabled, word);
+        for (size_t bit = 0; bit < 64; ++bit) {
+            const size_t i = word * 64 + bit;
+            const bool aDefined = !((aOff >> bit) & 1), bDefined = !((bOff >> bit) & 1);
+            if (!bDefined || (aDefined && a[i] >= b[i]))
+                return false;
+        }
+    }
+    return true;
+}
+
+static size_t gatherScalar(const int16_t* results, const uint8_t* disabled, const int16_t* in,
+                           int16_t* out, uint8_t* validMask, size_t count) {
+    size_t valid = 0;
+    for (size_t i = 0; i < count; i += 8) {
+        const size_t lanes = count - i < 8 ? count - i : 8;
+        uint8_t bits = 0;
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            const size_t index = in[i + lane] - INT16_MIN;
+            out[i + lane] = results[index];
+            if (!((disabled[index / 8] >> (index % 8)) & 1)) {
+                bits |= 1 << lane;
+                ++valid;
+            }
+        }
+        validMask[i / 8] = bits;
+    }
+    return valid;
+}
+
+static const KernelTable SCALAR_KERNELS = { "scalar", addScalar, subtractScalar, equalScalar, lessScalar, gatherScalar };
+
+#ifdef FUNCTION_KERNELS_X86
+
+// A point passes when b is defined and either a is disabled or a < b there
+static bool lessHolds(unsigned int lessLanes, unsigned int aOff, unsigned int bOff, unsigned int allLanes) {
+    return (~bOff & (aOff | lessLanes) & allLanes) == allLanes;
+}
+
+__attribute__((target("sse2")))
+static void addSse2(const int16_t* a, const int16_t* b, int16_t* out, size_t count) {
+    for (size_t i = 0; i < count; i += 16) {
+        const __m128i low = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        const __m128i high = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(a + i + 8)), _mm_loadu_si128((const __m128i*)(b + i + 8)));
+        _mm_storeu_si128((__m128i*)(out + i), low);
+        _mm_storeu_si128((__m128i*)(out + i + 8), high);
+    }
+}
+
+__attribute__((target("sse2")))
+static void subtractSse2(const int16_t* a, const int16_t* b, int16_t* out, size_t count) {
+    for (size_t i = 0; i < count; i += 16) {
+        const __m128i low = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        const __m128i high = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(a + i + 8)), _mm_loadu_si128((const __m128i*)(b + i + 8)));
+        _mm_storeu_si128((__m128i*)(out + i), low);
+        _mm_storeu_si128((__m128i*)(out + i + 8), high);
+    }
+}
+
+__attribute__((target("sse2")))
+static bool equalSse2(const int16_t* a, const int16_t* b, size_t count) {
+    for (size_t i = 0; i < count; i += 16) {
+        const __m128i low = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        const __m128i high = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(a + i + 8)), _mm_loadu_si128((const __m128i*)(b + i + 8)));
+        if (_mm_movemask_epi8(_mm_and_si128(low, high)) != 0xFFFF)
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("sse2")))
+static bool lessSse2(const int16_t* a, const uint8_t* aDisabled, const int16_t* b, const uint8_t* bDisabled, size_t count) {
+    for (size_t i = 0; i < count; i += 16) {
+        const __m128i low = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        const __m128i high = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i*)(a + i + 8)), _mm_loadu_si128((const __m128i*)(b + i + 8)));
+        // Narrowing keeps the all-ones/zero lanes, one mask bit per result
+        const unsigned int lessLanes = (unsigned int)_mm_movemask_epi8(_mm_packs_epi16(low, high));
+        if (!lessHolds(lessLanes, loadBits(aDisabled, i, 16), loadBits(bDisabled, i, 16), 0xFFFF))
+            return false;
+    }
+    return true;
+}
+
+// SSE2 has no gathers
+static const KernelTable SSE2_KERNELS = { "sse2", addSse2, subtractSse2, equalSse2, lessSse2, gatherScalar };
+
+__attribute__((target("avx2")))
+static void addAvx2(const int16_t* a, const int16_t* b, int16_t* out, size_t count) {
+    for (size_t i = 0; i < count; i += 32) {
+        const __m256i low = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        const __m256i high = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(a + i + 16)), _mm256_loadu_si256((const __m256i*)(b + i + 16)));
+        _mm256_storeu_si256((__m256i*)(out + i), low);
+        _mm256_storeu_si256((__m256i*)(out + i + 16), high);
+    }
+}
+
+__attribute__((target("avx2")))
+static void subtractAvx2(const int16_t* a, const int16_t* b, int16_t* out, size_t count) {
+    for (size_t i = 0; i < count; i += 32) {
+        const __m256i low = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        const __m256i high = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(a + i + 16)), _mm256_loadu_si256((const __m256i*)(b + i + 16)));
+        _mm256_storeu_si256((__m256i*)(out + i), low);
+        _mm256_storeu_si256((__m256i*)(out + i + 16), high);
+    }
+}
+
+__attribute__((target("avx2")))
+static bool equalAvx2(const int16_t* a, const int16_t* b, size_t count) {
+    for (size_t i = 0; i < count; i += 32) {
+        const __m256i low = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        const __m256i high = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)(a + i + 16)), _mm256_loadu_si256((const __m256i*)(b + i + 16)));
+        if ((unsigned int)_mm256_movemask_epi8(_mm256_and_si256(low, high)) != 0xFFFFFFFFu)
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx2")))
+static bool lessAvx2(const int16_t* a, const uint8_t* aDisabled, const int16_t* b, const uint8_t* bDisabled, size_t count) {
+    for (size_t i = 0; i < count; i += 32) {
+        const __m256i low = _mm256_cmpgt_epi16(_mm256_loadu_si256((const __m256i*)(b + i)), _mm256_loadu_si256((const __m256i*)(a + i)));
+        const __m256i high = _mm256_cmpgt_epi16(_mm256_loadu_si256((const __m256i*)(b + i + 16)), _mm256_loadu_si256((const __m256i*)(a + i + 16)));
+        // packs works per 128 bit half, the permute puts the 32 results back in order
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+        const unsigned int lessLanes = (unsigned int)_mm256_movemask_epi8(packed);
+        if (!lessHolds(lessLanes, loadBits(aDisabled, i, 32), loadBits(bDisabled, i, 32), 0xFFFFFFFFu))
+            return false;
+    }
+    return true;
+}
+
+// 16 samples per step: two 8-lane gathers of 32 bits each from the result table (the
+// upper half belongs to the next entry and is masked off) and two from the bitmap
+__attribute__((target("avx2")))
+static size_t gatherAvx2(const int16_t* results, const uint8_t* disabled, const int16_t* in,
+                         int16_t* out, uint8_t* validMask, size_t count) {
+    const __m256i bias = _mm256_set1_epi32(-INT16_MIN);
+    const __m256i lowHalf = _mm256_set1_epi32(0xFFFF);
+    const __m256i bitOfWord = _mm256_set1_epi32(31);
+    const __m256i one = _mm256_set1_epi32(1);
+    const int* table = (const int*)results;
+    const int* words = (const int*)disabled;
+
+    size_t valid = 0, i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i low = _mm256_add_epi32(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(in + i))), bias);
+        const __m256i high = _mm256_add_epi32(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(in + i + 8))), bias);
+
+        const __m256i lowResults = _mm256_and_si256(_mm256_i32gather_epi32(table, low, 2), lowHalf);
+        const __m256i highResults = _mm256_and_si256(_mm256_i32gather_epi32(table, high, 2), lowHalf);
+        _mm256_storeu_si256((__m256i*)(out + i),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi32(lowResults, highResults), 0xD8));
+
+        const __m256i lowBits = _mm256_and_si256(_mm256_srlv_epi32(
+                _mm256_i32gather_epi32(words, _mm256_srli_epi32(low, 5), 4), _mm256_and_si256(low, bitOfWord)), one);
+        const __m256i highBits = _mm256_and_si256(_mm256_srlv_epi32(
+                _mm256_i32gather_epi32(words, _mm256_srli_epi32(high, 5), 4), _mm256_and_si256(high, bitOfWord)), one);
+        const unsigned int lowValid = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(lowBits, _mm256_setzero_si256())));
+        const unsigned int highValid = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(highBits, _mm256_setzero_si256())));
+        validMask[i / 8] = (uint8_t)lowValid;
+        validMask[i / 8 + 1] = (uint8_t)highValid;
+        valid += __builtin_popcount(lowValid | (highValid << 8));
+    }
+    return valid + gatherScalar(results, disabled, in + i, out + i, validMask + i / 8, count - i);
+}
+
+static const KernelTable AVX2_KERNELS = { "avx2", addAvx2, subtractAvx2, equalAvx2, lessAvx2, gatherAvx2 };
+
+#endif
+
+static const KernelTable& selectKernels() {
+#ifdef FUNCTION_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return AVX2_KERNELS;
+    if (__builtin_cpu_supports("sse2")) return SSE2_KERNELS;
+#endif
+    return SCALAR_KERNELS;
+}
+
+static const KernelTable& kernels() {
+    static const KernelTable& selected = selectKernels();
+    return selected;
+}
+
+void FunctionKernels::add(const int16_t* a, const int16_t* b, int16_t* out, size_t count) {
+    kernels().add(a, b, out, count);
+}
+
+void FunctionKernels::subtract(const int16_t* a, const int16_t* b, int16_t* out, size_t count) {
+    kernels().subtract(a, b, out, count);
+}
+
+bool FunctionKernels::equal(const int16_t* a, const int16_t* b, size_t count) {
+    return kernels().equal(a, b, count);
+}
+
+bool FunctionKernels::less(const int16_t* a, const uint8_t* aDisabled,
+                           const int16_t* b, const uint8_t* bDisabled, size_t count) {
+    return kernels().less(a, aDisabled, b, bDisabled, count);
+}
+
+size_t FunctionKernels::gather(const int16_t* results, const uint8_t* disabled, const int16_t* in,
+                               int16_t* out, uint8_t* validMask, size_t count) {
+    return kernels().gather(results, disabled, in, out, validMask, count);
+}
+
+void FunctionKernels::uniteBits(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count) {
+    for (size_t word = 0; word < count / 64; ++word) {
+        const uint64_t united = rawWord(a, word) | rawWord(b, word);
+        std::memcpy(out + word * 8, &united, sizeof(united));
+    }
+}
+
+bool FunctionKernels::equalBits(const uint8_t* a, const uint8_t* b, size_t count) {
+    for (size_t word = 0; word < count / 64; ++word)
+        if (rawWord(a, word) != rawWord(b, word))
+            return false;
+    return true;
+}
+
+void FunctionKernels::clearDisabled(int16_t* results, const uint8_t* disabled, size_t count) {
+    for (size_t word = 0; word < count / 64; ++word) {
+        for (uint64_t bits = loadWord(disabled, word); bits; bits &= bits - 1)
+            results[word * 64 + lowestSetBit(bits)] = 0;
+    }
+}
+
+const char* FunctionKernels::implementation() {
+    return kernels().name;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <iostream>
+
+// Whole-table operations behind ModifiableIntegerFunction's arithmetic and comparison
+// operators. Results are processed 16 int16 lanes at a time with SSE2 or 32 with AVX2,
+// disabled bitmaps a 64 bit word at a time. The instruction set is picked once at
+// runtime from what the CPU supports, with a plain loop as the fallback.
+// Counts are numbers of results and must be multiples of 64.
+class FunctionKernels {
+public:
+    static void add(const int16_t* a, const int16_t* b, int16_t* out, size_t count);
+    static void subtract(const int16_t* a, const int16_t* b, int16_t* out, size_t count);
+    static bool equal(const int16_t* a, const int16_t* b, size_t count);
+    // a(x) < b(x) for every x, where a disabled point is lower than any result
+    static bool less(const int16_t* a, const uint8_t* aDisabled,
+                     const int16_t* b, const uint8_t* bDisabled, size_t count);
+
+    // out[i] = results[in[i] - INT16_MIN], bit i of validMask set where that point is not
+    // disabled. results must have one readable entry past its end for the 32 bit gathers.
+    // Returns the number of defined points.
+    static size_t gather(const int16_t* results, const uint8_t* disabled, const int16_t* in,
+                         int16_t* out, uint8_t* validMask, size_t count);
+
+    static void uniteBits(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count);
+    static bool equalBits(const uint8_t* a, const uint8_t* b, size_t count);
+    static void clearDisabled(int16_t* results, const uint8_t* disabled, size_t count); // zeroes disabled points
+
+    static const char* implementation(); // "avx2", "sse2" or "scalar"
+};
@@ -0,0 +1,55 @@
+#include "FunctionRegistry.h"
+
+FunctionRegistry::FunctionRegistry() : hits(0), misses(0) {}
+
+uint64_t FunctionRegistry::pairKey(uint64_t outer, uint64_t inner) {
+    // Not symmetric, f * g and g * f are different functions
+    return outer * 0x9e3779b97f4a7c15ULL ^ (inner + 0x632be59bd9b4e019ULL + (outer << 6) + (outer >> 2));
+}
+
+ModifiableIntegerFunction FunctionRegistry::intern(const ModifiableIntegerFunction& function) {
+    const uint64_t hash = function.hash();
+    auto candidates = functions.equal_range(hash);
+    for (auto it = candidates.first; it != candidates.second; ++it)
+        if (it->second == function)
+            return it->second;
+
+    return functions.emplace(hash, function)->second;
+}
+
+ModifiableIntegerFunction FunctionRegistry::compose(const ModifiableIntegerFunction& outer,
+                                                    const ModifiableIntegerFunction& inner) {
+    const uint64_t key = pairKey(outer.hash(), inner.hash());
+    auto candidates = compositions.equal_range(key);
+    for (auto it = candidates.first; it != candidates.second; ++it) {
+        if (it->second.outer == outer && it->second.inner == inner) {
+            hits++;
+            return it->second.result;
+        }
+    }
+
+    misses++;
+    const ModifiableIntegerFunction result = intern(outer * inner);
+    Composition composition = { intern(outer), intern(inner), result };
+    compositions.emplace(key, composition);
+    return result;
+}
+
+size_t FunctionRegistry::size() const {
+    return functions.size();
+}
+
+size_t FunctionRegistry::compositionHits() const {
+    return hits;
+}
+
+size_t FunctionRegistry::compositionMisses() const {
+    return misses;
+}
+
+void FunctionRegistry::clear() {
+    functions.clear();
+    compositions.clear();
+    hits = 0;
+    misses = 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include "ModifiableIntegerFunction.h"
+
+// Hash-consing of function tables. intern returns a copy of the registered function
+// equal to its argument, registering the argument if there is none, so functions
+// interned through the same registry share one table per distinct content. Copies
+// share tables copy-on-write, so changing an interned function only detaches it.
+// Lookups go by ModifiableIntegerFunction::hash and are confirmed with ==.
+// Not thread-safe; guard a registry shared between threads.
+class FunctionRegistry {
+    struct Composition {
+        ModifiableIntegerFunction outer;
+        ModifiableIntegerFunction inner;
+        ModifiableIntegerFunction result;
+    };
+
+    std::unordered_multimap<uint64_t, ModifiableIntegerFunction> functions;
+    std::unordered_multimap<uint64_t, Composition> compositions; // by the hashes of both operands
+    size_t hits;
+    size_t misses;
+
+    static uint64_t pairKey(uint64_t outer, uint64_t inner);
+public:
+    FunctionRegistry();
+
+    ModifiableIntegerFunction intern(const ModifiableIntegerFunction& function);
+    // outer * inner, looked up before it is computed; the result is interned
+    ModifiableIntegerFunction compose(const ModifiableIntegerFunction& outer, const ModifiableIntegerFunction& inner);
+
+    size_t size() const; // distinct functions held
+    size_t compositionHits() const;
+    size_t compositionMisses() const;
+    void clear(); // drops every held table and memoized composition
+};
@@ -0,0 +1,16 @@
+#include "Instrumentation.h"
+
+const char* FunctionEvents::name(Counter counter) {
+    static const char* const NAMES[COUNTER_COUNT] = {
+        "materializations", "copies", "table_clones", "invoke_calls", "exceptions_thrown",
+        "serialize_calls", "deserialize_calls", "bytes_serialized", "bytes_deserialized"
+    };
+    return NAMES[counter];
+}
+
+const char* FunctionEvents::name(Histogram histogram) {
+    static const char* const NAMES[HISTOGRAM_COUNT] = {
+        "materialize_latency_ns", "invoke_latency_ns", "serialize_latency_ns", "deserialize_latency_ns"
+    };
+    return NAMES[histogram];
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "InstrumentationRegistry.h"
+
+// What ModifiableIntegerFunction records. The INSTRUMENT_* macros below only record anything when
+// FUNCTION_INSTRUMENTATION is defined (cmake -DFUNCTION_INSTRUMENTATION=ON);
+// otherwise they expand to nothing and every snapshot is empty.
+struct FunctionEvents {
+    enum Counter {
+        MATERIALIZATIONS, // full tables built from the base function and overrides
+        COPIES, // copy constructions and assignments, which share the table
+        TABLE_CLONES, // shared tables copied on the first write
+        INVOKE_CALLS,
+        EXCEPTIONS_THROWN,
+        SERIALIZE_CALLS,
+        DESERIALIZE_CALLS, // including map
+        BYTES_SERIALIZED, // file bytes
+        BYTES_DESERIALIZED,
+        COUNTER_COUNT
+    };
+
+    enum Histogram {
+        MATERIALIZE_LATENCY,
+        INVOKE_LATENCY, // sampled
+        SERIALIZE_LATENCY,
+        DESERIALIZE_LATENCY,
+        HISTOGRAM_COUNT
+    };
+
+    static const char* name(Counter counter);
+    static const char* name(Histogram histogram);
+};
+
+typedef InstrumentationRegistry<FunctionEvents> Instrumentation;
+
+#ifdef FUNCTION_INSTRUMENTATION
+#define INSTRUMENT_COUNT(counter, amount) Instrumentation::count(Instrumentation::counter, amount)
+// Counts a hot call and times a sample of them
+#define INSTRUMENT_CALL(counter, histogram) \
+    Instrumentation::ScopedTimer instrumentationTimer(Instrumentation::histogram, \
+                                                      Instrumentation::countSampled(Instrumentation::counter))
+// Counts and times every call
+#define INSTRUMENT_SCOPE(counter, histogram) \
+    Instrumentation::count(Instrumentation::counter); \
+    Instrumentation::ScopedTimer instrumentationTimer(Instrumentation::histogram)
+#else
+#define INSTRUMENT_COUNT(counter, amount) ((void)0)
+#define INSTRUMENT_CALL(counter, histogram) ((void)0)
+#define INSTRUMENT_SCOPE(counter, histogram) ((void)0)
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+#include <iostream>
+#include "ModifiableIntegerFunction.h"
+#include "PiecewiseIntegerFunction.h"
+
+// The function class for a domain type: the dense table for int16_t, pieces for wider ones
+template <typename Int>
+struct IntegerFunctionFor {
+    typedef PiecewiseIntegerFunction<Int> Type;
+};
+
+template <>
+struct IntegerFunctionFor<int16_t> {
+    typedef ModifiableIntegerFunction Type;
+};
+
+template <typename Int>
+using IntegerFunction = typename IntegerFunctionFor<Int>::Type;
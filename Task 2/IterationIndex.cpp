@@ -0,0 +1,160 @@
+#include "IterationIndex.h"
+#include "Instrumentation.h"
+#include <exception>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static const size_t POINTS = INT16_MAX - INT16_MIN + 1;
+
+static unsigned int highestSetBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, word);
+    return index;
+#else
+    return 63 - __builtin_clzll(word);
+#endif
+}
+
+IterationIndex::IterationIndex(const ModifiableIntegerFunction& function)
+        : root(POINTS), depth(POINTS), cycleStart(POINTS), cycleLength(POINTS), cyclePosition(POINTS),
+          ladderPosition(POINTS) {
+    std::vector<uint16_t> next(POINTS);
+    std::vector<bool> disabled(POINTS);
+    for (size_t x = 0; x < POINTS; ++x) {
+        disabled[x] = function.isDisabled(x + INT16_MIN);
+        if (!disabled[x]) next[x] = (uint16_t)(function.invoke(x + INT16_MIN) - INT16_MIN);
+    }
+
+    // Walk from every unseen point until the walk meets a seen point, a disabled point
+    // or itself. A walk that meets itself closed a new cycle; the rest of it is a tail.
+    enum { UNSEEN, ON_PATH, DONE };
+    std::vector<uint8_t> state(POINTS, UNSEEN);
+    std::vector<uint16_t> path;
+    for (size_t start = 0; start < POINTS; ++start) {
+        if (state[start] != UNSEEN) continue;
+
+        path.clear();
+        size_t x = start;
+        while (state[x] == UNSEEN && !disabled[x]) {
+            state[x] = ON_PATH;
+            path.push_back((uint16_t)x);
+            x = next[x];
+        }
+
+        size_t tailEnd = path.size();
+        if (state[x] == UNSEEN) {
+            state[x] = DONE;
+            root[x] = (uint16_t)x;
+            depth[x] = 0;
+            cycleLength[x] = 0;
+        }
+        else if (state[x] == ON_PATH) {
+            size_t first = path.size() - 1;
+            while (path[first] != x) --first;
+
+            const uint32_t offset = (uint32_t)cycleNodes.size();
+            for (size_t i = first; i < path.size(); ++i) {
+                const uint16_t point = path[i];
+                cycleNodes.push_back(point);
+                state[point] = DONE;
+                root[point] = point;
+                depth[point] = 0;
+                cycleStart[point] = offset;
+                cycleLength[point] = (uint32_t)(path.size() - first);
+                cyclePosition[point] = (uint32_t)(i - first);
+            }
+            tailEnd = first;
+        }
+
+        for (size_t i = tailEnd; i-- > 0;) {
+            const uint16_t point = path[i];
+            state[point] = DONE;
+            root[point] = root[next[point]];
+            depth[point] = (uint16_t)(depth[next[point]] + 1);
+        }
+    }
+
+    // Heights and long children, deepest points first (counting sort on depth)
+    std::vector<uint32_t> firstOfDepth(POINTS + 1, 0);
+    for (size_t x = 0; x < POINTS; ++x)
+        firstOfDepth[depth[x] + 1]++;
+    for (size_t d = 1; d <= POINTS; ++d)
+        firstOfDepth[d] += firstOfDepth[d - 1];
+    std::vector<uint16_t> byDepth(POINTS);
+    for (size_t x = 0; x < POINTS; ++x)
+        byDepth[firstOfDepth[depth[x]]++] = (uint16_t)x;
+
+    std::vector<uint32_t> height(POINTS, 0);
+    std::vector<int32_t> longChild(POINTS, -1);
+    for (size_t i = POINTS; i-- > 0;) {
+        const uint16_t x = byDepth[i];
+        if (!depth[x]) continue;
+        const uint16_t parent = next[x];
+        if (longChild[parent] < 0 || height[x] + 1 > height[parent]) {
+            height[parent] = height[x] + 1;
+            longChild[parent] = x;
+        }
+    }
+
+    // One ladder per long path: the path itself, preceded by as many of the points
+    // above its top as the path is long (fewer when the root comes first)
+    ladders.reserve(2 * POINTS);
+    for (size_t x = 0; x < POINTS; ++x) {
+        if (depth[x] && longChild[next[x]] == (int32_t)x) continue;
+
+        const size_t length = height[x] + 1;
+        const size_t extension = length < depth[x] ? length : depth[x];
+        const size_t offset = ladders.size();
+        ladders.resize(offset + extension);
+        uint16_t above = (uint16_t)x;
+        for (size_t i = extension; i-- > 0;) {
+            above = next[above];
+            ladders[offset + i] = above;
+        }
+        for (int32_t point = (int32_t)x; point >= 0; point = longChild[point]) {
+            ladderPosition[point] = (uint32_t)ladders.size();
+            ladders.push_back((uint16_t)point);
+        }
+    }
+
+    jump[0].resize(POINTS);
+    for (size_t x = 0; x < POINTS; ++x)
+        jump[0][x] = depth[x] ? next[x] : (uint16_t)x;
+    for (size_t level = 1; level < LEVELS; ++level) {
+        jump[level].resize(POINTS);
+        for (size_t x = 0; x < POINTS; ++x)
+            jump[level][x] = jump[level - 1][jump[level - 1][x]];
+    }
+}
+
+// The 2^level jump leaves fewer than 2^level steps. The point reached has a tail of
+// at least 2^level below it, so its ladder reaches at least that far up.
+size_t IterationIndex::ancestor(size_t point, uint64_t steps) const {
+    if (!steps) return point;
+    const unsigned int level = highestSetBit(steps);
+    const uint16_t reached = jump[level][point];
+    return ladders[ladderPosition[reached] - (steps - ((uint64_t)1 << level))];
+}
+
+bool IterationIndex::isDefined(int16_t number, uint64_t power) const {
+    const size_t x = number - INT16_MIN;
+    return power <= depth[x] || cycleLength[root[x]] != 0;
+}
+
+int16_t IterationIndex::invoke(int16_t number, uint64_t power) const {
+    const size_t x = number - INT16_MIN;
+    if (power <= depth[x])
+        return (int16_t)(ancestor(x, power) + INT16_MIN);
+
+    const uint16_t cycleRoot = root[x];
+    const uint32_t length = cycleLength[cycleRoot];
+    if (!length) {
+        INSTRUMENT_COUNT(EXCEPTIONS_THROWN, 1);
+        throw std::invalid_argument("The number is disabled!");
+    }
+
+    const uint64_t position = (cyclePosition[cycleRoot] + (power - depth[x]) % length) % length;
+    return (int16_t)(cycleNodes[cycleStart[cycleRoot] + position] + INT16_MIN);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include "ModifiableIntegerFunction.h"
+
+// Answers f^k(x) in O(1) for any k. Built in one pass over f's functional graph, where
+// every point leads to its result and disabled points lead nowhere. Each point sits
+// on a tail of `depth` steps that ends in a root: either a point on a cycle or a
+// disabled point. Steps inside the tail are level-ancestor queries, answered with jump
+// pointers plus ladders over a long-path decomposition. Steps past a cycle root wrap
+// around the cycle. The index is a snapshot; later changes to f do not show up in it.
+class IterationIndex {
+    static const size_t LEVELS = 16; // 2^LEVELS exceeds every possible depth
+
+    std::vector<uint16_t> root;
+    std::vector<uint16_t> depth;
+    std::vector<uint32_t> cycleStart; // of the root's cycle in cycleNodes
+    std::vector<uint32_t> cycleLength; // 0 for points that are not on a cycle
+    std::vector<uint32_t> cyclePosition;
+    std::vector<uint16_t> cycleNodes;
+    std::vector<uint16_t> jump[LEVELS]; // jump[i][x] is 2^i steps from x within its tail
+    std::vector<uint32_t> ladderPosition; // of x in the ladder of its long path
+    std::vector<uint16_t> ladders; // each ladder from its highest point down to its leaf
+
+    size_t ancestor(size_t point, uint64_t steps) const; // steps <= depth[point]
+public:
+    explicit IterationIndex(const ModifiableIntegerFunction& function);
+
+    bool isDefined(int16_t number, uint64_t power) const;
+    int16_t invoke(int16_t number, uint64_t power) const; // f^power(number), throws where undefined
+};
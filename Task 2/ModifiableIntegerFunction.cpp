@@ -1,168 +1,645 @@
 #include "ModifiableIntegerFunction.h"
+#include "FunctionKernels.h"
+#include "ThreadPool.h"
+#include "FunctionEncoding.h"
+#include "Instrumentation.h"
 #include <fstream>
 #include <exception>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define FUNCTION_HAS_MMAP
+#endif
 
 const size_t ModifiableIntegerFunction::NUMBER_OF_ELEMENTS = INT16_MAX - INT16_MIN + 1;
 
+// Past this many overrides the sorted list costs more than the table it saves
+static const size_t MAX_OVERRIDES = 4096;
+
+// Passes run on ThreadPool::shared() unless setThreadCount asks for another size, which
+// gets a private pool; passes already running keep the pool they started with
+static std::mutex poolMutex;
+static std::shared_ptr<ThreadPool> pool; // nullptr while the shared pool fits
+static size_t configuredThreads = 0;
+
+// On-disk layout: a 64 byte header followed by the payload. A RAW payload is the result
+// table followed by the disabled bitmap, in the writer's byte order so it can be mapped
+// as is; an AFFINE payload is a FunctionEncoding. Header fields are stored in the
+// writer's byte order too, and the endianness tag tells the reader whether to swap them.
+// Files without the magic are the raw table and bitmap written by older versions.
+struct FunctionFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t endianness;
+    uint32_t encoding;
+    uint64_t payloadSize;
+    uint64_t checksum;
+    uint8_t reserved[32];
+};
+
+enum FunctionFileEncoding : uint32_t { RAW, AFFINE };
+
+static const char FILE_MAGIC[4] = {'M', 'I', 'F', 'N'};
+static const uint16_t FILE_VERSION = 1;
+static const uint32_t ENDIANNESS_TAG = 0x01020304;
+
+static uint16_t swapBytes(uint16_t value) {
+    return (uint16_t)((value >> 8) | (value << 8));
+}
+
+static uint32_t swapBytes(uint32_t value) {
+    return ((uint32_t)swapBytes((uint16_t)value) << 16) | swapBytes((uint16_t)(value >> 16));
+}
+
+static uint64_t swapBytes(uint64_t value) {
+    return ((uint64_t)swapBytes((uint32_t)value) << 32) | swapBytes((uint32_t)(value >> 32));
+}
+
+// FNV-1a, continuing from hash when a payload is written in parts
+static uint64_t checksumOf(const uint8_t* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Validates the header and converts it to the host byte order. swapped tells whether
+// a RAW payload has to be swapped too. An AFFINE payload is written only when it is
+// smaller than the raw table, which also bounds what a reader allocates for it.
+static bool readHeader(FunctionFileHeader& header, bool& swapped, size_t rawSize) {
+    if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+        return false;
+    swapped = header.endianness != ENDIANNESS_TAG;
+    if (swapped) {
+        if (header.endianness != swapBytes(ENDIANNESS_TAG))
+            return false;
+        header.version = swapBytes(header.version);
+        header.headerSize = swapBytes(header.headerSize);
+        header.encoding = swapBytes(header.encoding);
+        header.payloadSize = swapBytes(header.payloadSize);
+        header.checksum = swapBytes(header.checksum);
+    }
+    return header.version == FILE_VERSION &&
+           header.headerSize == sizeof(FunctionFileHeader) &&
+           ((header.encoding == AFFINE && header.payloadSize < rawSize) ||
+            (header.encoding == RAW && header.payloadSize == rawSize));
+}
+
+static void writeFile(const char* filename, FunctionFileEncoding encoding, const uint8_t* first, size_t firstSize,
+                      const uint8_t* second, size_t secondSize) {
+    INSTRUMENT_SCOPE(SERIALIZE_CALLS, SERIALIZE_LATENCY);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cout << "Error opening output file! " << std::endl;
+        return;
+    }
+
+    FunctionFileHeader header = {};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FILE_VERSION;
+    header.headerSize = sizeof(FunctionFileHeader);
+    header.endianness = ENDIANNESS_TAG;
+    header.encoding = encoding;
+    header.payloadSize = firstSize + secondSize;
+    header.checksum = checksumOf(second, secondSize, checksumOf(first, firstSize));
+
+    file.write((const char*) &header, sizeof(FunctionFileHeader));
+    file.write((const char*) first, firstSize);
+    file.write((const char*) second, secondSize);
+    file.close();
+    INSTRUMENT_COUNT(BYTES_SERIALIZED, sizeof(FunctionFileHeader) + firstSize + secondSize);
+}
+
+static size_t resolveThreads(size_t threads){
+    if(threads) return threads;
+    const size_t hardware = std::thread::hardware_concurrency();
+    return hardware ? hardware : 1;
+}
+
+void ModifiableIntegerFunction::setThreadCount(size_t threads){
+    std::lock_guard<std::mutex> lock(poolMutex);
+    configuredThreads = threads;
+    const size_t workers = resolveThreads(threads) - 1;
+    if(workers == ThreadPool::shared().size()) pool.reset();
+    else if(!pool || pool->size() != workers) pool = std::make_shared<ThreadPool>(workers);
+}
+
+size_t ModifiableIntegerFunction::threadCount(){
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return resolveThreads(configuredThreads);
+}
+
+void ModifiableIntegerFunction::forEachWordRange(size_t words, const std::function<void(size_t, size_t)>& body){
+    std::shared_ptr<ThreadPool> current;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        current = pool;
+    }
+    (current ? *current : ThreadPool::shared()).parallelFor(words, body);
+}
+
+ModifiableIntegerFunction::Table* ModifiableIntegerFunction::createTable(){
+    Table* table = new Table;
+    // One spare entry, so 32 bit gathers of the last result stay inside the allocation
+    table->results = new int16_t[ModifiableIntegerFunction::NUMBER_OF_ELEMENTS + 1]();
+    table->disabled = new uint8_t[ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8]();
+    table->preimages = nullptr;
+    table->contentHash = 0;
+    table->hashed = false;
+    table->references = 1;
+    table->mapping = nullptr;
+    table->mappedSize = 0;
+    return table;
+}
+
+void ModifiableIntegerFunction::release(Table* table){
+    if(!table || table->references.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    Preimages* preimages = table->preimages.load(std::memory_order_acquire);
+    if(preimages) delete[] preimages->counts;
+    delete preimages;
+    if(table->mapping){
+#ifdef FUNCTION_HAS_MMAP
+        munmap(table->mapping, table->mappedSize);
+#endif
+    }
+    else{
+        delete[] table->results;
+        delete[] table->disabled;
+    }
+    delete table;
+}
+
+void ModifiableIntegerFunction::release(PageCache* cache){
+    if(!cache || cache->references.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    for (size_t page = 0; page < PAGE_COUNT; page++)
+        delete[] cache->pages[page].load(std::memory_order_relaxed);
+    delete cache;
+}
+
+// A materialized function is copied without its lazy state, which only it may still be reading
 void ModifiableIntegerFunction::copyFrom(const ModifiableIntegerFunction& other){
+    Table* shared = other.table.load(std::memory_order_acquire);
     function = other.function;
-    resultsOfFunction = new int16_t[ModifiableIntegerFunction::NUMBER_OF_ELEMENTS];
-    disabledNumbers = new uint8_t[ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8];
-    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; i++){
-        resultsOfFunction[i] = other.resultsOfFunction[i];
-        if(i <= ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8)
-            disabledNumbers[i] = other.disabledNumbers[i];
-    }
+    table.store(shared, std::memory_order_relaxed);
+    cache = shared ? nullptr : other.cache;
+    if(!shared) overrides = other.overrides;
+    if(shared) shared->references.fetch_add(1, std::memory_order_relaxed);
+    if(cache) cache->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ModifiableIntegerFunction::moveFrom(ModifiableIntegerFunction&& other){
+    function = other.function;
+    table.store(other.table.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    cache = other.cache;
+    overrides = std::move(other.overrides);
+
+    other.function = nullptr;
+    other.table.store(nullptr, std::memory_order_relaxed);
+    other.cache = nullptr;
+    other.overrides.clear();
 }
 
 void ModifiableIntegerFunction::free(){
-    delete[] resultsOfFunction;
-    delete[] disabledNumbers;
+    release(table.load(std::memory_order_relaxed));
+    release(cache);
+    table.store(nullptr, std::memory_order_relaxed);
+    cache = nullptr;
+    overrides.clear();
+}
+
+// Builds the full table and bitmap from the computed pages, the base function and the
+// overrides, after which every operation works on the table alone. Const calls on the same
+// function may build at once, so the pages and overrides are left for other readers and
+// the first table to be published wins, like a page of the cache.
+ModifiableIntegerFunction::Table* ModifiableIntegerFunction::materialize() const{
+    Table* current = table.load(std::memory_order_acquire);
+    if(current) return current;
+    INSTRUMENT_SCOPE(MATERIALIZATIONS, MATERIALIZE_LATENCY);
+
+    // The base function may be expensive, so its calls are spread over the pool. It may also
+    // throw, so the table replaces the lazy state only once it is complete
+    Table* built = createTable();
+    int16_t* results = built->results;
+    try {
+        forEachWordRange(NUMBER_OF_ELEMENTS / 64, [&](size_t begin, size_t end){
+            for (size_t word = begin; word < end; word++){
+                const size_t first = word * 64;
+                const int16_t* computed = cache ? cache->pages[first / PAGE_SIZE].load(std::memory_order_acquire) : nullptr;
+                for (size_t i = first; i < first + 64; i++)
+                    results[i] = computed ? computed[i % PAGE_SIZE] : function ? function(i + INT16_MIN) : 0;
+            }
+        });
+    }
+    catch (...) {
+        release(built);
+        throw;
+    }
+    for (size_t i = 0; i < overrides.size(); i++){
+        const size_t index = overrides[i].number - INT16_MIN;
+        results[index] = overrides[i].result;
+        if(overrides[i].disabled)
+            built->disabled[index / 8] |= 1 << (index % 8);
+    }
+    if(table.compare_exchange_strong(current, built, std::memory_order_acq_rel)) return built;
+    release(built);
+    return current;
 }
 
-void ModifiableIntegerFunction::initArray(){
-    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; i++){
-        resultsOfFunction[i] = function(i + INT16_MIN);
-        if(i <= ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8)
-            disabledNumbers[i] = 0;
+// Only non-const calls get here, so nothing else reads the lazy state any more
+void ModifiableIntegerFunction::detach(){
+    Table* current = materialize();
+    std::vector<Override>().swap(overrides);
+    release(cache);
+    cache = nullptr;
+    if(current->references.load(std::memory_order_acquire) == 1 && !current->mapping) return;
+    INSTRUMENT_COUNT(TABLE_CLONES, 1);
+
+    Table* own = createTable();
+    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; i++)
+        own->results[i] = current->results[i];
+    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8; i++)
+        own->disabled[i] = current->disabled[i];
+    if(const Preimages* shared = current->preimages.load(std::memory_order_acquire)){
+        Preimages* copied = new Preimages(*shared);
+        copied->counts = new uint32_t[ModifiableIntegerFunction::NUMBER_OF_ELEMENTS];
+        for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; i++)
+            copied->counts[i] = shared->counts[i];
+        own->preimages = copied;
+    }
+    if(current->hashed.load(std::memory_order_acquire)){
+        own->contentHash = current->contentHash.load(std::memory_order_relaxed);
+        own->hashed = true;
     }
+    release(current);
+    table.store(own, std::memory_order_relaxed);
 }
 
-ModifiableIntegerFunction::ModifiableIntegerFunction() : function(nullptr), resultsOfFunction(nullptr), disabledNumbers(nullptr) {}
+bool ModifiableIntegerFunction::isMaterialized() const{
+    return table.load(std::memory_order_acquire) != nullptr;
+}
+
+void ModifiableIntegerFunction::Preimages::add(int16_t result){
+    if(counts[result - INT16_MIN]++ == 0) distinct++;
+}
 
-ModifiableIntegerFunction::ModifiableIntegerFunction(int16_t (*_function)(int16_t)) : function(_function){
-    resultsOfFunction = new int16_t[ModifiableIntegerFunction::NUMBER_OF_ELEMENTS];
-    disabledNumbers = new uint8_t[ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8];
-    if(function) initArray();
+void ModifiableIntegerFunction::Preimages::remove(int16_t result){
+    if(--counts[result - INT16_MIN] == 0) distinct--;
+}
+
+// Copies sharing the table may count at once; the first one to publish wins
+const ModifiableIntegerFunction::Preimages& ModifiableIntegerFunction::preimages() const{
+    Table* current = materialize();
+    Preimages* counted = current->preimages.load(std::memory_order_acquire);
+    if(counted) return *counted;
+
+    Preimages* computed = new Preimages;
+    computed->counts = new uint32_t[NUMBER_OF_ELEMENTS]();
+    computed->distinct = 0;
+    computed->defined = 0;
+    for (size_t i = 0; i < NUMBER_OF_ELEMENTS; i++){
+        if((current->disabled[i / 8] >> (i % 8)) & 1) continue;
+        computed->add(current->results[i]);
+        computed->defined++;
+    }
+    if(current->preimages.compare_exchange_strong(counted, computed, std::memory_order_acq_rel))
+        return *computed;
+    delete[] computed->counts;
+    delete computed;
+    return *counted;
+}
+
+// splitmix64 finalizer over the point and its value, so a sum over all points changes
+// unpredictably with every single change
+uint64_t ModifiableIntegerFunction::pointHash(size_t index, uint32_t value){
+    uint64_t hash = ((uint64_t)index << 17 | value) + 0x9e3779b97f4a7c15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+// Only called on a table this function owns, after detach
+void ModifiableIntegerFunction::rehashPoint(size_t index, uint32_t before, uint32_t after){
+    Table* own = table.load(std::memory_order_relaxed);
+    if(!own->hashed.load(std::memory_order_relaxed)) return;
+    const uint64_t hash = own->contentHash.load(std::memory_order_relaxed);
+    own->contentHash.store(hash - pointHash(index, before) + pointHash(index, after), std::memory_order_relaxed);
+}
+
+// Copies sharing the table may hash it at once; they store the same value
+uint64_t ModifiableIntegerFunction::hash() const{
+    Table* current = materialize();
+    if(current->hashed.load(std::memory_order_acquire))
+        return current->contentHash.load(std::memory_order_relaxed);
+
+    std::atomic<uint64_t> sum(0);
+    forEachWordRange(NUMBER_OF_ELEMENTS / 64, [&](size_t begin, size_t end){
+        uint64_t partial = 0;
+        for (size_t i = begin * 64; i < end * 64; i++){
+            const bool disabled = (current->disabled[i / 8] >> (i % 8)) & 1;
+            partial += pointHash(i, disabled ? 0x10000 : (uint16_t)current->results[i]);
+        }
+        sum.fetch_add(partial, std::memory_order_relaxed);
+    });
+    current->contentHash.store(sum, std::memory_order_relaxed);
+    current->hashed.store(true, std::memory_order_release);
+    return sum;
+}
+
+// Result of the base function while lazy, computing and caching its page on first use
+int16_t ModifiableIntegerFunction::baseResult(int16_t number) const{
+    if(!function) return 0;
+
+    const size_t index = number - INT16_MIN;
+    std::atomic<int16_t*>& slot = cache->pages[index / PAGE_SIZE];
+    int16_t* page = slot.load(std::memory_order_acquire);
+    if(!page){
+        // Copies may fill the same page at once; the first one to publish it wins
+        int16_t* computed = new int16_t[PAGE_SIZE];
+        const size_t first = index - index % PAGE_SIZE;
+        try {
+            for (size_t i = 0; i < PAGE_SIZE; i++)
+                computed[i] = function(first + i + INT16_MIN);
+        }
+        catch (...) {
+            delete[] computed;
+            throw;
+        }
+        if(slot.compare_exchange_strong(page, computed, std::memory_order_acq_rel)) page = computed;
+        else delete[] computed;
+    }
+    return page[index % PAGE_SIZE];
+}
+
+// Index of the first override not below number
+size_t ModifiableIntegerFunction::overridePosition(int16_t number) const{
+    size_t low = 0, high = overrides.size();
+    while (low < high){
+        const size_t middle = (low + high) / 2;
+        if(overrides[middle].number < number) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+const ModifiableIntegerFunction::Override* ModifiableIntegerFunction::findOverride(int16_t number) const{
+    const size_t position = overridePosition(number);
+    return position < overrides.size() && overrides[position].number == number ? &overrides[position] : nullptr;
+}
+
+ModifiableIntegerFunction::Override& ModifiableIntegerFunction::overrideFor(int16_t number){
+    const size_t position = overridePosition(number);
+    if(position < overrides.size() && overrides[position].number == number)
+        return overrides[position];
+
+    Override added = { number, baseResult(number), false };
+    return *overrides.insert(overrides.begin() + position, added);
+}
+
+ModifiableIntegerFunction::ModifiableIntegerFunction() : function(nullptr), table(nullptr), cache(nullptr) {}
+
+ModifiableIntegerFunction::ModifiableIntegerFunction(int16_t (*_function)(int16_t)) : function(_function), table(nullptr), cache(nullptr){
+    if(function){
+        cache = new PageCache;
+        for (size_t page = 0; page < PAGE_COUNT; page++)
+            cache->pages[page] = nullptr;
+        cache->references = 1;
+    }
 }
 
 ModifiableIntegerFunction::ModifiableIntegerFunction(const ModifiableIntegerFunction& other){
+    INSTRUMENT_COUNT(COPIES, 1);
     copyFrom(other);
 }
 
 ModifiableIntegerFunction& ModifiableIntegerFunction::operator=(const ModifiableIntegerFunction& other){
     if(this != &other){
+        INSTRUMENT_COUNT(COPIES, 1);
         free();
         copyFrom(other);
     }
     return *this;
 }
 
+ModifiableIntegerFunction::ModifiableIntegerFunction(ModifiableIntegerFunction&& other) noexcept{
+    moveFrom(std::move(other));
+}
+
+ModifiableIntegerFunction& ModifiableIntegerFunction::operator=(ModifiableIntegerFunction&& other) noexcept{
+    if(this != &other){
+        free();
+        moveFrom(std::move(other));
+    }
+    return *this;
+}
+
 ModifiableIntegerFunction ModifiableIntegerFunction::inverse() const
 {
-    if(!isBijective()) throw std::invalid_argument("Function is not reversible!");
-    ModifiableIntegerFunction result(nullptr);
-    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; ++i) {
-        result.resultsOfFunction[resultsOfFunction[i]] = i + INT16_MIN;
+    if(!isBijective()){
+        INSTRUMENT_COUNT(EXCEPTIONS_THROWN, 1);
+        throw std::invalid_argument("Function is not reversible!");
     }
+    const Table* current = materialize();
+    ModifiableIntegerFunction result(nullptr);
+    int16_t* inverted = result.materialize()->results;
+    // A bijection writes every entry exactly once, so the ranges never collide
+    forEachWordRange(NUMBER_OF_ELEMENTS / 64, [&](size_t begin, size_t end){
+        for (size_t i = begin * 64; i < end * 64; ++i)
+            inverted[current->results[i] - INT16_MIN] = i + INT16_MIN;
+    });
     return result;
 }
 
-void ModifiableIntegerFunction::setCustomResult(size_t number, int16_t result) const{
-    resultsOfFunction[number - INT16_MIN] = result;
+void ModifiableIntegerFunction::setCustomResult(int16_t number, int16_t result){
+    // A disabled point stays disabled and keeps 0 as its stored result
+    if(isDisabled(number)) return;
+    if(!isMaterialized() && overrides.size() >= MAX_OVERRIDES && !findOverride(number))
+        materialize();
+
+    if(!isMaterialized()){
+        overrideFor(number).result = result;
+        return;
+    }
+    detach();
+    Table* own = table.load(std::memory_order_relaxed);
+    if(Preimages* counted = own->preimages.load(std::memory_order_relaxed)){
+        counted->remove(own->results[number - INT16_MIN]);
+        counted->add(result);
+    }
+    rehashPoint(number - INT16_MIN, (uint16_t)own->results[number - INT16_MIN], (uint16_t)result);
+    own->results[number - INT16_MIN] = result;
 }
 
 void ModifiableIntegerFunction::disable(int16_t number){
     if(isDisabled(number)) return;
+    if(!isMaterialized() && overrides.size() >= MAX_OVERRIDES && !findOverride(number))
+        materialize();
+
+    if(!isMaterialized()){
+        Override& disabled = overrideFor(number);
+        disabled.disabled = true;
+        disabled.result = 0;
+        return;
+    }
+    detach();
+    Table* own = table.load(std::memory_order_relaxed);
+    if(Preimages* counted = own->preimages.load(std::memory_order_relaxed)){
+        counted->remove(own->results[number - INT16_MIN]);
+        counted->defined--;
+    }
+    rehashPoint(number - INT16_MIN, (uint16_t)own->results[number - INT16_MIN], 0x10000);
     size_t index = (number - INT16_MIN) / 8;
     uint8_t mask = 1 << ((number - INT16_MIN) % 8);
-    disabledNumbers[index] |= mask;
-    resultsOfFunction[number - INT16_MIN] = 0;
+    own->disabled[index] |= mask;
+    own->results[number - INT16_MIN] = 0;
+}
+
+void ModifiableIntegerFunction::prepare() const{
+    materialize();
+}
+
+int16_t ModifiableIntegerFunction::lazyAt(size_t index, bool& defined) const{
+    const int16_t number = (int16_t)(index + INT16_MIN);
+    if(const Override* custom = findOverride(number)){
+        if(custom->disabled) defined = false;
+        return custom->result;
+    }
+    return baseResult(number);
 }
 
 int16_t ModifiableIntegerFunction::invoke(int16_t number) const {
-    if(isDisabled(number))
+    INSTRUMENT_CALL(INVOKE_CALLS, INVOKE_LATENCY);
+    if(isDisabled(number)){
+        INSTRUMENT_COUNT(EXCEPTIONS_THROWN, 1);
         throw std::invalid_argument("The number is disabled!");
+    }
 
-    return resultsOfFunction[number - INT16_MIN];
+    if(const Table* current = table.load(std::memory_order_acquire)) return current->results[number - INT16_MIN];
+    if(const Override* custom = findOverride(number)) return custom->result;
+    return baseResult(number);
+}
+
+size_t ModifiableIntegerFunction::invokeBatch(const int16_t* in, int16_t* out, uint8_t* validMask, size_t n) const {
+    if(isMaterialized() || n >= NUMBER_OF_ELEMENTS / 16){
+        const Table* current = materialize();
+        return FunctionKernels::gather(current->results, current->disabled, in, out, validMask, n);
+    }
+
+    // Few points of a lazy function: not worth computing the whole table
+    size_t valid = 0;
+    for (size_t i = 0; i < n; i++){
+        if(i % 8 == 0) validMask[i / 8] = 0;
+        const Override* custom = findOverride(in[i]);
+        if(custom && custom->disabled){
+            out[i] = 0;
+            continue;
+        }
+        out[i] = custom ? custom->result : baseResult(in[i]);
+        validMask[i / 8] |= 1 << (i % 8);
+        valid++;
+    }
+    return valid;
 }
 
 bool ModifiableIntegerFunction::isDisabled(int16_t number) const {
+    const Table* current = table.load(std::memory_order_acquire);
+    if(!current){
+        const Override* custom = findOverride(number);
+        return custom && custom->disabled;
+    }
     size_t index = (number - INT16_MIN) / 8;
     uint8_t mask = 1 << ((number - INT16_MIN) % 8);
-    return disabledNumbers[index] & mask;
+    return current->disabled[index] & mask;
 }
 
+// No two defined points share a result
 bool ModifiableIntegerFunction::isInjective() const{
-    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8; i++)
-        if(disabledNumbers[i]) return false;
-
-    return true;
+    const Preimages& counted = preimages();
+    return counted.distinct == counted.defined;
 }
 
+// Every int16 value is the result of some defined point
 bool ModifiableIntegerFunction::isSurjective() const {
-    bool *covered = new bool[ModifiableIntegerFunction::NUMBER_OF_ELEMENTS];
-    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; ++i) {
-        if (!isDisabled(i + INT16_MIN)) {
-            int16_t output = resultsOfFunction[i];
-            if (output >= INT16_MIN && output <= INT16_MAX) {
-                covered[output - INT16_MIN] = true;
-            }
-        }
-    }
-
-    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; ++i) 
-        if (!covered[i])
-            return false;
-
-    return true;
+    return preimages().distinct == NUMBER_OF_ELEMENTS;
 }
 
+// Surjective on a domain of NUMBER_OF_ELEMENTS points leaves no point disabled or shared
 bool ModifiableIntegerFunction::isBijective() const {
-    return isSurjective() && isInjective();
+    const Preimages& counted = preimages();
+    return counted.distinct == NUMBER_OF_ELEMENTS && counted.defined == NUMBER_OF_ELEMENTS;
 }
 
 bool ModifiableIntegerFunction::areParallel(const ModifiableIntegerFunction& other) const {
-    for (size_t i = 0; i <= ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; ++i) {
-        if (!isDisabled(i + INT16_MIN) && !other.isDisabled(i + INT16_MIN)) {
-            int16_t diff1 = invoke(i + INT16_MIN);
-            int16_t diff2 = other.invoke(i + INT16_MIN);
-            if (diff1 != diff2)
-                return false;
+    const Table* left = materialize();
+    const Table* right = other.materialize();
+    std::atomic<bool> parallel(true);
+    forEachWordRange(NUMBER_OF_ELEMENTS / 64, [&](size_t begin, size_t end){
+        for (size_t i = begin * 64; i < end * 64 && parallel.load(std::memory_order_relaxed); ++i) {
+            const bool disabled = ((left->disabled[i / 8] | right->disabled[i / 8]) >> (i % 8)) & 1;
+            if (!disabled && left->results[i] != right->results[i])
+                parallel.store(false, std::memory_order_relaxed);
         }
-    }
-    return true;
+    });
+    return parallel;
 }
 
-ModifiableIntegerFunction ModifiableIntegerFunction::operator+(const ModifiableIntegerFunction& other) const{
-    ModifiableIntegerFunction result(nullptr);
-    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; i++){
-        result.resultsOfFunction[i] = resultsOfFunction[i] + other.resultsOfFunction[i];
-        if(i <= ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8)
-            result.disabledNumbers[i] = disabledNumbers[i] & other.disabledNumbers[i];
-    }
-    return result;
+// Defined where both functions are, like composition
+ModifiableIntegerFunction::Table* ModifiableIntegerFunction::evaluate(
+        const FunctionSum<ModifiableIntegerFunction, ModifiableIntegerFunction>& sum){
+    const Table* left = sum.leftOperand().materialize();
+    const Table* right = sum.rightOperand().materialize();
+    Table* evaluated = createTable();
+    forEachWordRange(NUMBER_OF_ELEMENTS / 64, [&](size_t begin, size_t end){
+        const size_t first = begin * 64, count = (end - begin) * 64;
+        FunctionKernels::add(left->results + first, right->results + first,
+                             evaluated->results + first, count);
+        FunctionKernels::uniteBits(left->disabled + first / 8, right->disabled + first / 8,
+                                   evaluated->disabled + first / 8, count);
+        FunctionKernels::clearDisabled(evaluated->results + first, evaluated->disabled + first / 8, count);
+    });
+    return evaluated;
 }
 
-ModifiableIntegerFunction ModifiableIntegerFunction::operator-(const ModifiableIntegerFunction& other) const{
-    ModifiableIntegerFunction result(nullptr);
-    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; i++){
-        result.resultsOfFunction[i] = resultsOfFunction[i] - other.resultsOfFunction[i];
-        if(i <= ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8)
-            result.disabledNumbers[i] = disabledNumbers[i] & other.disabledNumbers[i];
-    }
-    return result;
-}
-
-ModifiableIntegerFunction ModifiableIntegerFunction::operator*(const ModifiableIntegerFunction& other) const{
-    ModifiableIntegerFunction result(nullptr);
-    for (size_t i = 0; i < NUMBER_OF_ELEMENTS; i++){
-        result.resultsOfFunction[i] = function(other.resultsOfFunction[i]);
-        if(i <= ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8)
-            result.disabledNumbers[i] = disabledNumbers[i] | other.disabledNumbers[i];
-    }
-    return result;
+ModifiableIntegerFunction::Table* ModifiableIntegerFunction::evaluate(
+        const FunctionDifference<ModifiableIntegerFunction, ModifiableIntegerFunction>& difference){
+    const Table* left = difference.leftOperand().materialize();
+    const Table* right = difference.rightOperand().materialize();
+    Table* evaluated = createTable();
+    forEachWordRange(NUMBER_OF_ELEMENTS / 64, [&](size_t begin, size_t end){
+        const size_t first = begin * 64, count = (end - begin) * 64;
+        FunctionKernels::subtract(left->results + first, right->results + first,
+                             evaluated->results + first, count);
+        FunctionKernels::uniteBits(left->disabled + first / 8, right->disabled + first / 8,
+                                   evaluated->disabled + first / 8, count);
+        FunctionKernels::clearDisabled(evaluated->results + first, evaluated->disabled + first / 8, count);
+    });
+    return evaluated;
 }
 
+// Hashes already cached with both tables tell different functions apart in O(1). Computing
+// a missing one costs a full pass, so then the scan below is just as cheap
 bool ModifiableIntegerFunction::operator==(const ModifiableIntegerFunction& other) const {
-    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; i++){
-        if(resultsOfFunction[i] != other.resultsOfFunction[i])
-            return false;
-        if(i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8)
-            if(disabledNumbers[i] != other.disabledNumbers[i])
-                return false;
-    }
-    return true;
+    const Table* left = materialize();
+    const Table* right = other.materialize();
+    if(left == right) return true;
+    if(left->hashed.load(std::memory_order_acquire) && right->hashed.load(std::memory_order_acquire) &&
+       left->contentHash.load(std::memory_order_relaxed) != right->contentHash.load(std::memory_order_relaxed))
+        return false;
+    std::atomic<bool> equal(true);
+    forEachWordRange(NUMBER_OF_ELEMENTS / 64, [&](size_t begin, size_t end){
+        const size_t first = begin * 64, count = (end - begin) * 64;
+        if(!equal.load(std::memory_order_relaxed)) return;
+        if(!FunctionKernels::equalBits(left->disabled + first / 8, right->disabled + first / 8, count) ||
+           !FunctionKernels::equal(left->results + first, right->results + first, count))
+            equal.store(false, std::memory_order_relaxed);
+    });
+    return equal;
 }
 
 bool ModifiableIntegerFunction::operator!=(const ModifiableIntegerFunction& other) const
@@ -170,15 +647,19 @@ bool ModifiableIntegerFunction::operator!=(const ModifiableIntegerFunction& othe
     return !(*this == other);
 }
 
+// A disabled point counts as lower than any result
 bool ModifiableIntegerFunction::operator<(const ModifiableIntegerFunction& other) const{
-    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; i++){
-        if(resultsOfFunction[i] >= other.resultsOfFunction[i])
-            return false;
-        if(i <= ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8)
-            if(disabledNumbers[i] != other.disabledNumbers[i])
-                return false;
-    }
-    return true;
+    const Table* left = materialize();
+    const Table* right = other.materialize();
+    std::atomic<bool> less(true);
+    forEachWordRange(NUMBER_OF_ELEMENTS / 64, [&](size_t begin, size_t end){
+        const size_t first = begin * 64, count = (end - begin) * 64;
+        if(!less.load(std::memory_order_relaxed)) return;
+        if(!FunctionKernels::less(left->results + first, left->disabled + first / 8,
+                                  right->results + first, right->disabled + first / 8, count))
+            less.store(false, std::memory_order_relaxed);
+    });
+    return less;
 }
 
 bool ModifiableIntegerFunction::operator<=(const ModifiableIntegerFunction& other) const
@@ -196,43 +677,169 @@ bool ModifiableIntegerFunction::operator>=(const ModifiableIntegerFunction& othe
     return !(*this < other);
 }
 
+// f^power by repeated squaring, O(NUMBER_OF_ELEMENTS * log(power)). f^0 is the identity.
+// Composition keeps overrides and makes a point undefined once any step hits a disabled one.
 ModifiableIntegerFunction ModifiableIntegerFunction::operator^(size_t power) const{
-    ModifiableIntegerFunction result(*this);
-
-    for (size_t i = 0; i < power; ++i)
-        for (size_t j = 0; j < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; ++j)
-            result.resultsOfFunction[i] = function(resultsOfFunction[i]);
-
+    ModifiableIntegerFunction result(nullptr);
+    int16_t* identityResults = result.materialize()->results;
+    for (size_t i = 0; i < ModifiableIntegerFunction::NUMBER_OF_ELEMENTS; ++i)
+        identityResults[i] = (int16_t)(i + INT16_MIN);
+
+    bool identity = true;
+    ModifiableIntegerFunction square(*this);
+    while (power) {
+        if (power & 1) {
+            if (identity) result = square;
+            else result = square * result;
+            identity = false;
+        }
+        power >>= 1;
+        if (power) square = square * square;
+    }
     return result;
 }
 
 void ModifiableIntegerFunction::serialize(const char* filename) const {
-    std::ofstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-        std::cout << "Error opening output file! " << std::endl;
+    const Table* current = materialize();
+    std::vector<uint8_t> encoded;
+    FunctionEncoding::encodeAffine(current->results, current->disabled, NUMBER_OF_ELEMENTS, encoded);
+    if (encoded.size() >= NUMBER_OF_ELEMENTS * sizeof(int16_t) + NUMBER_OF_ELEMENTS / 8) {
+        serializeRaw(filename);
         return;
     }
+    writeFile(filename, AFFINE, encoded.data(), encoded.size(), nullptr, 0);
+}
 
-    file.write((const char*)resultsOfFunction, NUMBER_OF_ELEMENTS * sizeof(int16_t));
-    file.write((const char*)disabledNumbers, (NUMBER_OF_ELEMENTS / 8) * sizeof(uint8_t));
-
-    file.close();
+void ModifiableIntegerFunction::serializeRaw(const char* filename) const {
+    const Table* current = materialize();
+    writeFile(filename, RAW, (const uint8_t*)current->results, NUMBER_OF_ELEMENTS * sizeof(int16_t),
+              current->disabled, NUMBER_OF_ELEMENTS / 8);
 }
 
 void ModifiableIntegerFunction::deserialize(const char* filename) {
+    INSTRUMENT_SCOPE(DESERIALIZE_CALLS, DESERIALIZE_LATENCY);
     std::ifstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         std::cout << "Error opening input file! " << std::endl;
         return;
     }
-    free(); // clear the memory 
-    resultsOfFunction = new int16_t[ModifiableIntegerFunction::NUMBER_OF_ELEMENTS];
-    disabledNumbers = new uint8_t[ModifiableIntegerFunction::NUMBER_OF_ELEMENTS / 8];
-
-    file.read((char*) resultsOfFunction, NUMBER_OF_ELEMENTS * sizeof(int16_t));
-    file.read((char*) disabledNumbers, (NUMBER_OF_ELEMENTS / 8) * sizeof(uint8_t));
 
+    const size_t rawSize = NUMBER_OF_ELEMENTS * sizeof(int16_t) + NUMBER_OF_ELEMENTS / 8;
+    FunctionFileHeader header;
+    bool swapped = false;
+    uint32_t encoding = RAW;
+    std::vector<uint8_t> payload;
+    if (file.read((char*) &header, sizeof(FunctionFileHeader)) &&
+        std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0) {
+        // A newer version or a damaged header is not read as the old layout
+        if (!readHeader(header, swapped, rawSize)) {
+            std::cout << "Corrupted/unsupported function file! " << std::endl;
+            return;
+        }
+        payload.resize(header.payloadSize);
+        if (!file.read((char*) payload.data(), payload.size()) ||
+            checksumOf(payload.data(), payload.size()) != header.checksum) {
+            std::cout << "Corrupted function file! " << std::endl;
+            return;
+        }
+        encoding = header.encoding;
+    }
+    else {
+        // Older files: the raw table and bitmap without a header
+        file.clear();
+        file.seekg(0);
+        payload.resize(rawSize);
+        if (!file.read((char*) payload.data(), payload.size())) {
+            std::cout << "Invalid function file! " << std::endl;
+            return;
+        }
+    }
+    INSTRUMENT_COUNT(BYTES_DESERIALIZED, (size_t) file.tellg());
     file.close();
+
+    // Only allocated once everything that can throw or fail to read is done
+    Table* loaded = createTable();
+    if (encoding == AFFINE) {
+        if (!FunctionEncoding::decodeAffine(payload.data(), payload.size(), loaded->results, loaded->disabled,
+                                            NUMBER_OF_ELEMENTS)) {
+            std::cout << "Corrupted function file! " << std::endl;
+            release(loaded);
+            return;
+        }
+    }
+    else {
+        std::memcpy(loaded->results, payload.data(), NUMBER_OF_ELEMENTS * sizeof(int16_t));
+        std::memcpy(loaded->disabled, payload.data() + NUMBER_OF_ELEMENTS * sizeof(int16_t), NUMBER_OF_ELEMENTS / 8);
+        if (swapped)
+            for (size_t i = 0; i < NUMBER_OF_ELEMENTS; i++)
+                loaded->results[i] = (int16_t)swapBytes((uint16_t)loaded->results[i]);
+    }
+
+    // The file replaces the whole function, base function included
+    free();
+    function = nullptr;
+    table.store(loaded, std::memory_order_relaxed);
+}
+
+void ModifiableIntegerFunction::map(const char* filename, bool verifyChecksum) {
+#ifdef FUNCTION_HAS_MMAP
+    int descriptor = open(filename, O_RDONLY);
+    if (descriptor < 0) {
+        std::cout << "Error opening input file! " << std::endl;
+        return;
+    }
+
+    const size_t rawSize = NUMBER_OF_ELEMENTS * sizeof(int16_t) + NUMBER_OF_ELEMENTS / 8;
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(descriptor, &info) == 0 && (size_t) info.st_size == sizeof(FunctionFileHeader) + rawSize)
+        mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor); // the mapping stays valid after closing
+
+    // Anything but a raw file in the host byte order needs decoding, so it is read instead
+    FunctionFileHeader header;
+    bool swapped = true;
+    if (mapping != MAP_FAILED) std::memcpy(&header, mapping, sizeof(FunctionFileHeader));
+    if (mapping == MAP_FAILED || !readHeader(header, swapped, rawSize) || swapped || header.encoding != RAW) {
+        if (mapping != MAP_FAILED) munmap(mapping, info.st_size);
+        deserialize(filename);
+        return;
+    }
+
+    uint8_t* payload = (uint8_t*) mapping + sizeof(FunctionFileHeader);
+    if (verifyChecksum && checksumOf(payload, rawSize) != header.checksum) {
+        std::cout << "Corrupted function file! " << std::endl;
+        munmap(mapping, info.st_size);
+        return;
+    }
+
+    // The bitmap follows the results, so the spare entry gathers read stays in the mapping
+    Table* mapped = new Table;
+    mapped->results = (int16_t*) payload;
+    mapped->disabled = payload + NUMBER_OF_ELEMENTS * sizeof(int16_t);
+    mapped->preimages = nullptr;
+    mapped->contentHash = 0;
+    mapped->hashed = false;
+    mapped->references = 1;
+    mapped->mapping = mapping;
+    mapped->mappedSize = info.st_size;
+    // Only counted here: every fallback above goes through deserialize
+    INSTRUMENT_COUNT(DESERIALIZE_CALLS, 1);
+    INSTRUMENT_COUNT(BYTES_DESERIALIZED, info.st_size);
+
+    free();
+    function = nullptr;
+    table.store(mapped, std::memory_order_relaxed);
+#else
+    // No mmap on this platform, fall back to a private copy
+    (void) verifyChecksum;
+    deserialize(filename);
+#endif
+}
+
+bool ModifiableIntegerFunction::isMapped() const {
+    const Table* current = table.load(std::memory_order_acquire);
+    return current && current->mapping;
 }
 
 ModifiableIntegerFunction::~ModifiableIntegerFunction(){
@@ -1,38 +1,129 @@
 #pragma once
 #include <iostream>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include "FunctionExpression.h"
 
-class ModifiableIntegerFunction
+// Starts out lazy: results of the base function are computed one page at a time on
+// first invoke, and setCustomResult/disable go to a small sorted override list.
+// The full table and disabled bitmap are only built (materialized) when an operation
+// over the whole domain needs them or the override list grows too long. Const calls may
+// materialize from several threads at once: the first finished table is published and
+// the lazy state it was built from stays readable until the next change.
+// Copies share the table and the page cache; the table is cloned on the first write
+// to a shared one.
+// +, - and * build a FunctionExpression, evaluated in one pass when it is assigned.
+// Passes over the whole domain are split into contiguous ranges across a worker pool.
+class ModifiableIntegerFunction : public FunctionExpression<ModifiableIntegerFunction>
 {
     static const size_t NUMBER_OF_ELEMENTS;
+    static const size_t PAGE_SIZE = 4096;
+    static const size_t PAGE_COUNT = 16; // NUMBER_OF_ELEMENTS / PAGE_SIZE
+
+    struct Override {
+        int16_t number;
+        int16_t result;
+        bool disabled;
+    };
+
+    // How many defined points lead to each result, kept up to date by setCustomResult
+    // and disable once built
+    struct Preimages {
+        uint32_t* counts; // indexed by result - INT16_MIN
+        size_t distinct; // results with a nonzero count
+        size_t defined; // points that are not disabled
+
+        void add(int16_t result);
+        void remove(int16_t result);
+    };
+
+    struct Table {
+        int16_t* results;
+        uint8_t* disabled;
+        std::atomic<Preimages*> preimages; // nullptr until a property query needs it
+        std::atomic<uint64_t> contentHash; // valid once hashed is set, then kept up to date
+        std::atomic<bool> hashed;
+        std::atomic<size_t> references;
+        void* mapping; // non-null when results and disabled point into a read-only mapped file
+        size_t mappedSize;
+    };
+
+    // Pages only ever hold results of the base function, so every copy can fill them
+    struct PageCache {
+        std::atomic<int16_t*> pages[PAGE_COUNT];
+        std::atomic<size_t> references;
+    };
+
     int16_t (*function)(int16_t);
-    int16_t* resultsOfFunction;
-    uint8_t* disabledNumbers;
+    // Filled from const member functions without changing what the function is
+    mutable std::atomic<Table*> table; // nullptr until materialized
+    PageCache* cache; // computed pages of the base function while lazy
+    std::vector<Override> overrides; // sorted by number, ignored once materialized
+
+    static Table* createTable();
+    static void release(Table* table);
+    static void release(PageCache* cache);
 
     void copyFrom(const ModifiableIntegerFunction& other);
+    void moveFrom(ModifiableIntegerFunction&& other);
     void free();
-    void initArray();
+    Table* materialize() const; // builds the table on first use and returns it
+    void detach(); // materializes, drops the lazy state and makes the table this object's own
+    bool isMaterialized() const;
+    const Preimages& preimages() const; // materializes and counts on first use
+    static uint64_t pointHash(size_t index, uint32_t value); // value 0x10000 for a disabled point
+    void rehashPoint(size_t index, uint32_t before, uint32_t after);
+    int16_t baseResult(int16_t number) const;
+    size_t overridePosition(int16_t number) const;
+    const Override* findOverride(int16_t number) const;
+    Override& overrideFor(int16_t number);
+    int16_t lazyAt(size_t index, bool& defined) const;
+
+    // Runs body(begin, end) over contiguous ranges of [0, words) on the configured threads,
+    // where word i covers results [64 * i, 64 * i + 64) and bitmap bytes [8 * i, 8 * i + 8)
+    static void forEachWordRange(size_t words, const std::function<void(size_t, size_t)>& body);
+
+    // Builds the table of an expression. A single + or - of two functions goes through
+    // FunctionKernels, anything else is fused into one loop over the domain.
+    template <typename E>
+    static Table* evaluate(const E& expression);
+    static Table* evaluate(const FunctionSum<ModifiableIntegerFunction, ModifiableIntegerFunction>& sum);
+    static Table* evaluate(const FunctionDifference<ModifiableIntegerFunction, ModifiableIntegerFunction>& difference);
 public:
     // Constructors
     ModifiableIntegerFunction();
     ModifiableIntegerFunction(int16_t (*_function)(int16_t));
     ModifiableIntegerFunction(const ModifiableIntegerFunction& other);
     ModifiableIntegerFunction& operator=(const ModifiableIntegerFunction& other);
+    ModifiableIntegerFunction(ModifiableIntegerFunction&& other) noexcept;
+    ModifiableIntegerFunction& operator=(ModifiableIntegerFunction&& other) noexcept;
+    template <typename E>
+    ModifiableIntegerFunction(const FunctionExpression<E>& expression);
+    template <typename E>
+    ModifiableIntegerFunction& operator=(const FunctionExpression<E>& expression);
     
     // Functions
     ModifiableIntegerFunction inverse() const;
-    void setCustomResult(size_t number, int16_t result) const;
+    void setCustomResult(int16_t number, int16_t result);
     void disable(int16_t number);
     int16_t invoke(int16_t number) const;
+    // Never throws: bit i of validMask ((n + 7) / 8 bytes) tells whether in[i] is defined,
+    // out[i] is 0 where it is not. Returns the number of defined points.
+    size_t invokeBatch(const int16_t* in, int16_t* out, uint8_t* validMask, size_t n) const;
+    // Same for any iterators, writing one bool per input to valid
+    template <typename InputIterator, typename OutputIterator, typename ValidIterator>
+    size_t invokeRange(InputIterator first, InputIterator last, OutputIterator out, ValidIterator valid) const;
     bool isDisabled(int16_t number) const;
     bool isInjective() const;
     bool isSurjective() const;
     bool isBijective() const;
     bool areParallel(const ModifiableIntegerFunction& other) const;
+    // Sum of a hash of every (point, result or disabled) pair. Computed on first use and
+    // updated in O(1) by setCustomResult and disable; equal functions have equal hashes.
+    uint64_t hash() const;
 
-    //Operators
-    ModifiableIntegerFunction operator+(const ModifiableIntegerFunction& other) const;
-    ModifiableIntegerFunction operator-(const ModifiableIntegerFunction& other) const;
-    ModifiableIntegerFunction operator*(const ModifiableIntegerFunction& other) const;
+    //Operators (+, - and * are in FunctionExpression.h)
     bool operator==(const ModifiableIntegerFunction& other) const;
     bool operator!=(const ModifiableIntegerFunction& other) const;
     bool operator<(const ModifiableIntegerFunction& other) const;
@@ -41,10 +132,154 @@ public:
     bool operator>=(const ModifiableIntegerFunction& other) const;
     ModifiableIntegerFunction operator^(size_t power) const;
 
+    // Threads that share whole-domain work, the calling one included. 0 (the default)
+    // means one per hardware thread. Results do not depend on the count.
+    static void setThreadCount(size_t threads);
+    static size_t threadCount();
+
     //Serializing/Deserializing
-    void serialize(const char* filename) const;
+    void serialize(const char* filename) const; // affine segments, or the raw table when smaller
+    void serializeRaw(const char* filename) const; // the table as is, for map
     void deserialize(const char* filename);
+    // Reads a raw file in place without copying it; the first change makes a private copy
+    void map(const char* filename, bool verifyChecksum = false);
+    bool isMapped() const;
     
     //Destructor
     ~ModifiableIntegerFunction();
-};
\ No newline at end of file
+
+    // Expression interface, see FunctionExpression.h
+    void prepare() const;
+    int16_t at(size_t index, bool& defined) const;
+};
+
+inline int16_t ModifiableIntegerFunction::at(size_t index, bool& defined) const {
+    const Table* current = table.load(std::memory_order_acquire);
+    if(!current) return lazyAt(index, defined);
+    if((current->disabled[index / 8] >> (index % 8)) & 1) defined = false;
+    return current->results[index];
+}
+
+template <typename E>
+ModifiableIntegerFunction::Table* ModifiableIntegerFunction::evaluate(const E& expression) {
+    Table* evaluated = createTable();
+    forEachWordRange(NUMBER_OF_ELEMENTS / 64, [&](size_t begin, size_t end) {
+        for (size_t word = begin; word < end; word++) {
+            uint64_t disabled = 0;
+            for (size_t bit = 0; bit < 64; bit++) {
+                const size_t index = word * 64 + bit;
+                bool defined = true;
+                const int16_t result = expression.at(index, defined);
+                evaluated->results[index] = defined ? result : 0;
+                disabled |= (uint64_t)!defined << bit;
+            }
+            for (size_t byte = 0; byte < 8; byte++)
+                evaluated->disabled[word * 8 + byte] = (uint8_t)(disabled >> (8 * byte));
+        }
+    });
+    return evaluated;
+}
+
+template <typename E>
+ModifiableIntegerFunction::ModifiableIntegerFunction(const FunctionExpression<E>& expression)
+        : function(nullptr), table(nullptr), cache(nullptr) {
+    expression.self().prepare();
+    table.store(evaluate(expression.self()), std::memory_order_relaxed);
+}
+
+// The expression may refer to this function, so it is evaluated before anything is freed
+template <typename E>
+ModifiableIntegerFunction& ModifiableIntegerFunction::operator=(const FunctionExpression<E>& expression) {
+    expression.self().prepare();
+    Table* evaluated = evaluate(expression.self());
+    free();
+    function = nullptr;
+    table.store(evaluated, std::memory_order_relaxed);
+    return *this;
+}
+
+// Comparisons with an expression on either side evaluate it first. Between two
+// functions the member operators are the better match, and a function on the left
+// takes the second overload so it does not compete with them.
+template <typename L, typename R>
+bool operator==(const FunctionExpression<L>& left, const FunctionExpression<R>& right) {
+    return ModifiableIntegerFunction(left.self()) == ModifiableIntegerFunction(right.self());
+}
+
+template <typename L, typename R>
+bool operator!=(const FunctionExpression<L>& left, const FunctionExpression<R>& right) {
+    return ModifiableIntegerFunction(left.self()) != ModifiableIntegerFunction(right.self());
+}
+
+template <typename L, typename R>
+bool operator<(const FunctionExpression<L>& left, const FunctionExpression<R>& right) {
+    return ModifiableIntegerFunction(left.self()) < ModifiableIntegerFunction(right.self());
+}
+
+template <typename L, typename R>
+bool operator<=(const FunctionExpression<L>& left, const FunctionExpression<R>& right) {
+    return ModifiableIntegerFunction(left.self()) <= ModifiableIntegerFunction(right.self());
+}
+
+template <typename L, typename R>
+bool operator>(const FunctionExpression<L>& left, const FunctionExpression<R>& right) {
+    return ModifiableIntegerFunction(left.self()) > ModifiableIntegerFunction(right.self());
+}
+
+template <typename L, typename R>
+bool operator>=(const FunctionExpression<L>& left, const FunctionExpression<R>& right) {
+    return ModifiableIntegerFunction(left.self()) >= ModifiableIntegerFunction(right.self());
+}
+
+template <typename R>
+bool operator==(const ModifiableIntegerFunction& left, const FunctionExpression<R>& right) {
+    return left == ModifiableIntegerFunction(right.self());
+}
+
+template <typename R>
+bool operator!=(const ModifiableIntegerFunction& left, const FunctionExpression<R>& right) {
+    return left != ModifiableIntegerFunction(right.self());
+}
+
+template <typename R>
+bool operator<(const ModifiableIntegerFunction& left, const FunctionExpression<R>& right) {
+    return left < ModifiableIntegerFunction(right.self());
+}
+
+template <typename R>
+bool operator<=(const ModifiableIntegerFunction& left, const FunctionExpression<R>& right) {
+    return left <= ModifiableIntegerFunction(right.self());
+}
+
+template <typename R>
+bool operator>(const ModifiableIntegerFunction& left, const FunctionExpression<R>& right) {
+    return left > ModifiableIntegerFunction(right.self());
+}
+
+template <typename R>
+bool operator>=(const ModifiableIntegerFunction& left, const FunctionExpression<R>& right) {
+    return left >= ModifiableIntegerFunction(right.self());
+}
+
+template <typename InputIterator, typename OutputIterator, typename ValidIterator>
+size_t ModifiableIntegerFunction::invokeRange(InputIterator first, InputIterator last,
+                                              OutputIterator out, ValidIterator valid) const {
+    const size_t BATCH_SIZE = 256;
+    int16_t inputs[BATCH_SIZE];
+    int16_t results[BATCH_SIZE];
+    uint8_t validMask[BATCH_SIZE / 8];
+
+    size_t defined = 0;
+    while (first != last) {
+        size_t count = 0;
+        while (count < BATCH_SIZE && first != last)
+            inputs[count++] = *first++;
+
+        defined += invokeBatch(inputs, results, validMask, count);
+        for (size_t i = 0; i < count; i++) {
+            *out++ = results[i];
+            *valid++ = (validMask[i / 8] >> (i % 8)) & 1;
+        }
+    }
+    return defined;
+}
\ No newline at end of file
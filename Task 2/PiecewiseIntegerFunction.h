@@ -0,0 +1,704 @@
+#pragma once
+#include <iostream>
+#include <map>
+#include <vector>
+#include <limits>
+#include <cstdlib>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <tuple>
+
+// A function over every value of a signed integer type too wide for a dense table
+// (int32_t would need 16 GB). The domain is split into pieces, each either disabled or
+// the line slope * x + offset, wrapping around like the int16 results do.
+// Pieces are kept in a map by their first point. setCustomResult and disable split the
+// piece they fall into, so overrides and disabled ranges live in the same interval map
+// as the base segments, and neighbouring pieces on the same line are merged again.
+// +, -, *, the comparisons, ^ and the injectivity checks walk the pieces, so they cost
+// O(pieces) (times log of the pieces for *) whatever the width of the domain. A line
+// that wraps around is an arithmetic progression modulo 2^bits: comparisons and
+// injectivity count its points in closed form with floor sums, and composition only
+// splits it into stretches between wraps while that is cheaper than solving for the
+// points it sends off the widest piece of the outer function.
+template <typename Int>
+class PiecewiseIntegerFunction {
+    static_assert(std::is_signed<Int>::value && sizeof(Int) <= 4, "Domains of up to 32 bits are supported");
+
+    typedef typename std::make_unsigned<Int>::type Unsigned;
+    typedef int64_t Wide; // slope * x + offset before it wraps
+
+    static constexpr Int LOWEST = std::numeric_limits<Int>::min();
+    static constexpr Int HIGHEST = std::numeric_limits<Int>::max();
+    static constexpr Wide MODULUS = (Wide)1 << (8 * sizeof(Int)); // values of Int
+    static constexpr Wide MAX_INVERSE_POINTS = (Wide)1 << 20; // set one at a time by inverse
+
+    struct Piece {
+        bool defined;
+        Int slope; // 0 while disabled
+        Int offset;
+
+        Int at(Int number) const { return wrap((Wide)slope * number + offset); }
+        bool sameAs(const Piece& other) const {
+            return defined == other.defined && slope == other.slope && offset == other.offset;
+        }
+    };
+
+    // The results of a stretch of one line, which do not wrap: low, low + stride, ... high
+    struct Progression {
+        Wide low;
+        Wide high;
+        Wide stride;
+    };
+
+    typedef std::map<Int, Piece> PieceMap;
+    typedef typename PieceMap::const_iterator PieceIterator;
+
+    PieceMap pieces; // by first point, the first one always at LOWEST
+
+    static Int wrap(Wide value) { return (Int)(Unsigned)value; }
+    static Piece disabledPiece() { return Piece{ false, 0, 0 }; }
+    static Piece composed(const Piece& outer, const Piece& inner);
+    static void append(PieceMap& built, Int first, const Piece& piece); // first past every piece in built
+    static bool intersect(const Progression& left, const Progression& right);
+    static Wide modularInverse(Wide value, Wide modulus); // value and modulus coprime
+    static uint64_t oddInverse(uint64_t value); // modulo 2^64
+    static unsigned trailingZeros(Unsigned value); // bits of Int for 0
+    static Wide floorDivide(Wide value, Wide divisor); // divisor > 0
+    // Sum of floor((slope * x + offset) / modulus) over [first, last], modulo 2^64, for
+    // |first|, |slope|, |offset|, modulus and the length up to 2^32
+    static uint64_t floorSum(Wide first, Wide last, Wide slope, Wide offset, Wide modulus);
+    static Wide wraps(Int first, Int last, const Piece& piece); // stretches forEachRun visits, minus 1
+    // Points of [first, last] where left is not below right, both defined
+    static uint64_t countNotBelow(Int first, Int last, const Piece& left, const Piece& right);
+    // Whether two defined pieces share a result
+    static bool meets(Int first, Int last, const Piece& piece, Int otherFirst, Int otherLast, const Piece& other);
+
+    PieceIterator pieceAt(Int number) const { return std::prev(pieces.upper_bound(number)); }
+    Int lastOf(PieceIterator piece) const;
+    void split(Int number); // makes a piece start at number
+    void replace(Int first, Int last, const Piece& piece);
+    // A piece on the line that covers the most points, counting every piece on it, and that
+    // count; with odd only lines with an odd slope, pieces.end() when there are none
+    PieceIterator widestLine(bool odd, Wide& covered) const;
+    // Appends this function after line over [first, last] to built, see operator*
+    void composeThrough(PieceMap& built, Int first, Int last, const Piece& line, const Piece& widest) const;
+
+    // Calls body(first, last, left piece, right piece) for every stretch where neither
+    // function changes piece, in order; stops early when body returns false
+    template <typename Body>
+    bool forEachCommonPiece(const PiecewiseIntegerFunction& other, Body body) const;
+    // Calls body(begin, end, result at begin) for the stretches of [first, last] where
+    // the defined piece does not wrap; stops early when body returns false
+    template <typename Body>
+    static bool forEachRun(Int first, Int last, const Piece& piece, Body body);
+public:
+    // Constructors
+    PiecewiseIntegerFunction(); // 0 everywhere, like ModifiableIntegerFunction()
+    PiecewiseIntegerFunction(Int slope, Int offset); // slope * x + offset everywhere
+
+    // Functions
+    PiecewiseIntegerFunction inverse() const;
+    void setCustomResult(Int number, Int result);
+    void disable(Int number);
+    // Defines every point of [first, last] again, as slope * x + offset
+    void setRange(Int first, Int last, Int slope, Int offset);
+    void disableRange(Int first, Int last);
+    Int invoke(Int number) const;
+    bool isDisabled(Int number) const;
+    bool isInjective() const;
+    bool isSurjective() const;
+    bool isBijective() const;
+    bool areParallel(const PiecewiseIntegerFunction& other) const;
+    size_t pieceCount() const;
+
+    // Operators, defined where both operands are like for ModifiableIntegerFunction
+    PiecewiseIntegerFunction operator+(const PiecewiseIntegerFunction& other) const;
+    PiecewiseIntegerFunction operator-(const PiecewiseIntegerFunction& other) const;
+    PiecewiseIntegerFunction operator*(const PiecewiseIntegerFunction& other) const; // (f * g)(x) = f(g(x))
+    bool operator==(const PiecewiseIntegerFunction& other) const;
+    bool operator!=(const PiecewiseIntegerFunction& other) const;
+    bool operator<(const PiecewiseIntegerFunction& other) const;
+    bool operator<=(const PiecewiseIntegerFunction& other) const;
+    bool operator>(const PiecewiseIntegerFunction& other) const;
+    bool operator>=(const PiecewiseIntegerFunction& other) const;
+    PiecewiseIntegerFunction operator^(size_t power) const;
+};
+
+template <typename Int>
+constexpr Int PiecewiseIntegerFunction<Int>::LOWEST;
+
+template <typename Int>
+constexpr Int PiecewiseIntegerFunction<Int>::HIGHEST;
+
+template <typename Int>
+constexpr typename PiecewiseIntegerFunction<Int>::Wide PiecewiseIntegerFunction<Int>::MODULUS;
+
+template <typename Int>
+constexpr typename PiecewiseIntegerFunction<Int>::Wide PiecewiseIntegerFunction<Int>::MAX_INVERSE_POINTS;
+
+template <typename Int>
+PiecewiseIntegerFunction<Int>::PiecewiseIntegerFunction() : PiecewiseIntegerFunction(0, 0) {}
+
+template <typename Int>
+PiecewiseIntegerFunction<Int>::PiecewiseIntegerFunction(Int slope, Int offset) {
+    pieces.emplace(LOWEST, Piece{ true, slope, offset });
+}
+
+// Composing two lines gives a line, a disabled piece stays disabled
+template <typename Int>
+typename PiecewiseIntegerFunction<Int>::Piece PiecewiseIntegerFunction<Int>::composed(const Piece& outer,
+                                                                                  const Piece& inner) {
+    if (!outer.defined || !inner.defined) return disabledPiece();
+    return Piece{ true, wrap((Wide)outer.slope * inner.slope), wrap((Wide)outer.slope * inner.offset + outer.offset) };
+}
+
+template <typename Int>
+void PiecewiseIntegerFunction<Int>::append(PieceMap& built, Int first, const Piece& piece) {
+    if (!built.empty() && built.rbegin()->second.sameAs(piece)) return;
+    built.emplace_hint(built.end(), first, piece);
+}
+
+template <typename Int>
+Int PiecewiseIntegerFunction<Int>::lastOf(PieceIterator piece) const {
+    const PieceIterator next = std::next(piece);
+    return next == pieces.end() ? HIGHEST : (Int)(next->first - 1);
+}
+
+template <typename Int>
+void PiecewiseIntegerFunction<Int>::split(Int number) {
+    const PieceIterator containing = pieceAt(number);
+    if (containing->first != number)
+        pieces.emplace_hint(std::next(containing), number, containing->second);
+}
+
+template <typename Int>
+void PiecewiseIntegerFunction<Int>::replace(Int first, Int last, const Piece& piece) {
+    split(first);
+    if (last != HIGHEST) split((Int)(last + 1));
+    const typename PieceMap::iterator begin = pieces.find(first);
+    begin->second = piece;
+    pieces.erase(std::next(begin), last == HIGHEST ? pieces.end() : pieces.find((Int)(last + 1)));
+
+    // Merge with the neighbours on the same line
+    typename PieceMap::iterator current = begin;
+    if (current != pieces.begin() && std::prev(current)->second.sameAs(piece))
+        current = std::prev(pieces.erase(current));
+    const typename PieceMap::iterator next = std::next(current);
+    if (next != pieces.end() && next->second.sameAs(current->second))
+        pieces.erase(next);
+}
+
+template <typename Int>
+template <typename Body>
+bool PiecewiseIntegerFunction<Int>::forEachCommonPiece(const PiecewiseIntegerFunction& other, Body body) const {
+    PieceIterator left = pieces.begin(), right = other.pieces.begin();
+    Int first = LOWEST;
+    while (true) {
+        const Int leftLast = lastOf(left), rightLast = other.lastOf(right);
+        const Int last = std::min(leftLast, rightLast);
+        if (!body(first, last, left->second, right->second)) return false;
+        if (last == HIGHEST) return true;
+        first = (Int)(last + 1);
+        if (leftLast == last) ++left;
+        if (rightLast == last) ++right;
+    }
+}
+
+template <typename Int>
+template <typename Body>
+bool PiecewiseIntegerFunction<Int>::forEachRun(Int first, Int last, const Piece& piece, Body body) {
+    Wide begin = first;
+    while (true) {
+        const Wide value = piece.at((Int)begin);
+        Wide end = last;
+        if (piece.slope > 0)
+            end = std::min(end, begin + (HIGHEST - value) / piece.slope);
+        else if (piece.slope < 0)
+            end = std::min(end, begin + (value - LOWEST) / -(Wide)piece.slope);
+        if (!body((Int)begin, (Int)end, value)) return false;
+        if (end == last) return true;
+        begin = end + 1;
+    }
+}
+
+// Two stretches meet when some value lies in both ranges and is low plus a multiple of
+// each stride: solved with the Chinese remainder theorem
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::intersect(const Progression& left, const Progression& right) {
+    const Wide low = std::max(left.low, right.low), high = std::min(left.high, right.high);
+    if (low > high) return false;
+
+    Wide a = left.stride, b = right.stride;
+    while (b) {
+        const Wide rest = a % b;
+        a = b;
+        b = rest;
+    }
+    const Wide gcd = a;
+    const Wide difference = right.low - left.low;
+    if (difference % gcd) return false;
+
+    // left.low + left.stride * t with left.stride * t = difference (mod right.stride)
+    const Wide modulus = right.stride / gcd;
+    const Wide wanted = (difference / gcd % modulus + modulus) % modulus;
+    const Wide t = wanted * modularInverse(left.stride / gcd % modulus, modulus) % modulus;
+    const Wide solution = left.low + left.stride * t;
+    const Wide step = left.stride * modulus;
+
+    Wide distance = (solution - low) % step;
+    if (distance < 0) distance += step;
+    return low + distance <= high;
+}
+
+template <typename Int>
+typename PiecewiseIntegerFunction<Int>::Wide PiecewiseIntegerFunction<Int>::modularInverse(Wide value, Wide modulus) {
+    if (modulus == 1) return 0;
+    Wide oldRemainder = value, remainder = modulus, oldCoefficient = 1, coefficient = 0;
+    while (remainder) {
+        const Wide quotient = oldRemainder / remainder;
+        Wide next = oldRemainder - quotient * remainder;
+        oldRemainder = remainder;
+        remainder = next;
+        next = oldCoefficient - quotient * coefficient;
+        oldCoefficient = coefficient;
+        coefficient = next;
+    }
+    return (oldCoefficient % modulus + modulus) % modulus;
+}
+
+// Newton's iteration doubles the correct low bits of the inverse of an odd number
+template <typename Int>
+uint64_t PiecewiseIntegerFunction<Int>::oddInverse(uint64_t value) {
+    uint64_t inverse = value;
+    for (int i = 0; i < 5; ++i)
+        inverse *= 2 - value * inverse;
+    return inverse;
+}
+
+template <typename Int>
+unsigned PiecewiseIntegerFunction<Int>::trailingZeros(Unsigned value) {
+    if (!value) return 8 * sizeof(Int);
+    unsigned zeros = 0;
+    for (; !(value & 1); value >>= 1)
+        zeros++;
+    return zeros;
+}
+
+template <typename Int>
+typename PiecewiseIntegerFunction<Int>::Wide PiecewiseIntegerFunction<Int>::floorDivide(Wide value, Wide divisor) {
+    return value / divisor - (value % divisor < 0);
+}
+
+// With slope and offset reduced below the modulus, what is left counts the lattice points
+// under a line, done by swapping the axes like Euclid's algorithm. Every product stays
+// below 2^64; the sums may wrap, which the callers undo by only using their differences.
+template <typename Int>
+uint64_t PiecewiseIntegerFunction<Int>::floorSum(Wide first, Wide last, Wide slope, Wide offset, Wide modulus) {
+    const uint64_t count = (uint64_t)(last - first + 1);
+    const Wide slopeQuotient = floorDivide(slope, modulus), offsetQuotient = floorDivide(offset, modulus);
+    slope -= slopeQuotient * modulus;
+    offset -= offsetQuotient * modulus;
+    const Wide start = slope * first + offset;
+    const Wide startQuotient = floorDivide(start, modulus);
+    uint64_t sum = (uint64_t)slopeQuotient * (count * (uint64_t)first + count * (count - 1) / 2) +
+                   count * (uint64_t)(offsetQuotient + startQuotient);
+
+    uint64_t n = count, m = (uint64_t)modulus, a = (uint64_t)slope, b = (uint64_t)(start - startQuotient * modulus);
+    while (true) {
+        if (a >= m) {
+            sum += n * (n - 1) / 2 * (a / m);
+            a %= m;
+        }
+        if (b >= m) {
+            sum += n * (b / m);
+            b %= m;
+        }
+        const uint64_t top = a * n + b;
+        if (top < m) return sum;
+        n = top / m;
+        b = top % m;
+        std::swap(m, a);
+    }
+}
+
+template <typename Int>
+typename PiecewiseIntegerFunction<Int>::Wide PiecewiseIntegerFunction<Int>::wraps(Int first, Int last, const Piece& piece) {
+    const Wide from = floorDivide((Wide)piece.slope * first + piece.offset - LOWEST, MODULUS);
+    const Wide to = floorDivide((Wide)piece.slope * last + piece.offset - LOWEST, MODULUS);
+    return std::abs(to - from);
+}
+
+// With both results shifted into [0, 2^bits), [a >= b] = 1 + floor((a - b) / 2^bits), and
+// each shifted result is its line minus 2^bits times the floor of the line over 2^bits
+template <typename Int>
+uint64_t PiecewiseIntegerFunction<Int>::countNotBelow(Int first, Int last, const Piece& left, const Piece& right) {
+    const uint64_t count = (uint64_t)((Wide)last - first + 1);
+    return count + floorSum(first, last, (Wide)left.slope - right.slope, (Wide)left.offset - right.offset, MODULUS)
+                 - floorSum(first, last, left.slope, (Wide)left.offset - LOWEST, MODULUS)
+                 + floorSum(first, last, right.slope, (Wide)right.offset - LOWEST, MODULUS);
+}
+
+// Point first + x of one piece and otherFirst + y of the other share a result when
+// otherSlope * y = slope * x - difference modulo 2^bits. That needs the right side to be
+// a multiple of 2^otherZeros, which fixes x modulo step; each such x then needs one y
+// modulo 2^(bits - otherZeros), a line in x, and the x whose y falls inside the other
+// piece are counted with floor sums.
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::meets(Int first, Int last, const Piece& piece,
+                                          Int otherFirst, Int otherLast, const Piece& other) {
+    const uint64_t count = (uint64_t)((Wide)last - first + 1), otherCount = (uint64_t)((Wide)otherLast - otherFirst + 1);
+    const uint64_t slope = (Unsigned)piece.slope, otherSlope = (Unsigned)other.slope;
+    const uint64_t difference = ((uint64_t)(Unsigned)other.at(otherFirst) - (Unsigned)piece.at(first)) & (MODULUS - 1);
+    const unsigned otherZeros = trailingZeros((Unsigned)other.slope);
+    const unsigned zeros = std::min(trailingZeros((Unsigned)piece.slope), otherZeros);
+    if (difference & (((uint64_t)1 << zeros) - 1)) return false;
+
+    const uint64_t step = (uint64_t)1 << (otherZeros - zeros);
+    const uint64_t x = step == 1 ? 0 : ((difference >> zeros) * oddInverse(slope >> zeros)) & (step - 1);
+    if (x >= count) return false;
+    const uint64_t modulus = (uint64_t)MODULUS >> otherZeros;
+    if (otherCount >= modulus) return true;
+
+    // y = (slope * (x + step * k) - difference) / 2^otherZeros / (odd part of otherSlope)
+    const uint64_t steps = (count - x + step - 1) / step;
+    const uint64_t inverse = oddInverse(otherSlope >> otherZeros);
+    const uint64_t stride = ((slope >> zeros) * inverse) & (modulus - 1);
+    const uint64_t start = (((slope * x - difference) >> otherZeros) * inverse) & (modulus - 1);
+    // [y < otherCount] = floor(y' / modulus) - floor((y' - otherCount) / modulus) for y' = start + stride * k
+    return floorSum(0, (Wide)steps - 1, (Wide)stride, (Wide)start, (Wide)modulus) !=
+           floorSum(0, (Wide)steps - 1, (Wide)stride, (Wide)start - (Wide)otherCount, (Wide)modulus);
+}
+
+template <typename Int>
+typename PiecewiseIntegerFunction<Int>::PieceIterator PiecewiseIntegerFunction<Int>::widestLine(bool odd, Wide& covered) const {
+    std::map<std::tuple<bool, Int, Int>, Wide> totals;
+    PieceIterator widest = pieces.end();
+    covered = 0;
+    for (PieceIterator piece = pieces.begin(); piece != pieces.end(); ++piece) {
+        if (odd && !(piece->second.defined && (piece->second.slope & 1))) continue;
+        Wide& total = totals[std::make_tuple(piece->second.defined, piece->second.slope, piece->second.offset)];
+        total += (Wide)lastOf(piece) - piece->first + 1;
+        if (total > covered) {
+            covered = total;
+            widest = piece;
+        }
+    }
+    return widest;
+}
+
+// A flat piece of more than one point is not injective, and a line repeats after
+// 2^(bits - trailing zeros of its slope) points. Lines that wrap less often than there
+// are pieces are split into stretches, swept by their lowest result and checked against
+// the ones still open, pairwise where their ranges overlap. Steeper ones are checked
+// against every other piece in closed form.
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::isInjective() const {
+    std::vector<PieceIterator> defined;
+    for (PieceIterator piece = pieces.begin(); piece != pieces.end(); ++piece) {
+        if (!piece->second.defined) continue;
+        if ((Wide)lastOf(piece) - piece->first >= MODULUS >> trailingZeros((Unsigned)piece->second.slope)) return false;
+        defined.push_back(piece);
+    }
+
+    const Wide steepness = std::max<Wide>(16, (Wide)defined.size());
+    std::vector<bool> steep(defined.size(), false);
+    std::vector<Progression> sorted;
+    for (size_t i = 0; i < defined.size(); ++i) {
+        const PieceIterator piece = defined[i];
+        steep[i] = wraps(piece->first, lastOf(piece), piece->second) >= steepness;
+        if (steep[i]) continue;
+        const Wide slope = piece->second.slope;
+        forEachRun(piece->first, lastOf(piece), piece->second, [&](Int begin, Int end, Wide value) {
+            const Wide other = value + slope * ((Wide)end - begin);
+            sorted.push_back(Progression{ std::min(value, other), std::max(value, other), slope ? std::abs(slope) : 1 });
+            return true;
+        });
+    }
+    for (size_t i = 0; i < defined.size(); ++i) {
+        if (!steep[i]) continue;
+        for (size_t j = 0; j < defined.size(); ++j)
+            if (j != i && (!steep[j] || j > i) &&
+                meets(defined[i]->first, lastOf(defined[i]), defined[i]->second,
+                      defined[j]->first, lastOf(defined[j]), defined[j]->second))
+                return false;
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](const Progression& left, const Progression& right) {
+        return left.low < right.low;
+    });
+    std::vector<Progression> open;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        for (size_t j = 0; j < open.size();) {
+            if (open[j].high < sorted[i].low) {
+                open[j] = open.back();
+                open.pop_back();
+                continue;
+            }
+            if (intersect(open[j], sorted[i])) return false;
+            ++j;
+        }
+        open.push_back(sorted[i]);
+    }
+    return true;
+}
+
+// As many points as values: every value is hit exactly when no point is disabled or shared
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::isSurjective() const {
+    for (PieceIterator piece = pieces.begin(); piece != pieces.end(); ++piece)
+        if (!piece->second.defined) return false;
+    return isInjective();
+}
+
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::isBijective() const {
+    return isSurjective();
+}
+
+// The line with an odd slope that covers the most points is inverted in the ring of Int
+// and gives the result everywhere. The results of every other piece are then set over
+// it: as lines where they step by 1 or -1, one point at a time otherwise, which stops at
+// MAX_INVERSE_POINTS as such an inverse has no piecewise form worth keeping.
+template <typename Int>
+PiecewiseIntegerFunction<Int> PiecewiseIntegerFunction<Int>::inverse() const {
+    if (!isBijective()) throw std::invalid_argument("Function is not reversible!");
+
+    Wide covered = 0, single = 0;
+    const PieceIterator widest = widestLine(true, covered);
+    PiecewiseIntegerFunction result; // every point is set below
+    if (widest != pieces.end()) {
+        const Int slope = (Int)(Unsigned)oddInverse((Unsigned)widest->second.slope);
+        result = PiecewiseIntegerFunction(slope, wrap(-(Wide)slope * widest->second.offset));
+    }
+    for (PieceIterator piece = pieces.begin(); piece != pieces.end(); ++piece) {
+        const Piece& line = piece->second;
+        if (widest != pieces.end() && line.sameAs(widest->second)) continue;
+        if (line.slope != 1 && line.slope != -1) {
+            single += (Wide)lastOf(piece) - piece->first + 1;
+            if (single > MAX_INVERSE_POINTS) throw std::domain_error("The inverse has no piecewise form!");
+            for (Wide x = piece->first; x <= lastOf(piece); ++x)
+                result.replace(line.at((Int)x), line.at((Int)x), Piece{ true, 0, (Int)x });
+            continue;
+        }
+        forEachRun(piece->first, lastOf(piece), line, [&](Int begin, Int end, Wide value) {
+            if (line.slope == 1)
+                result.replace((Int)value, (Int)(value + ((Wide)end - begin)), Piece{ true, 1, wrap(begin - value) });
+            else
+                result.replace((Int)(value - ((Wide)end - begin)), (Int)value, Piece{ true, -1, wrap(begin + value) });
+            return true;
+        });
+    }
+    return result;
+}
+
+template <typename Int>
+void PiecewiseIntegerFunction<Int>::setCustomResult(Int number, Int result) {
+    // A disabled point stays disabled
+    if (isDisabled(number)) return;
+    replace(number, number, Piece{ true, 0, result });
+}
+
+template <typename Int>
+void PiecewiseIntegerFunction<Int>::disable(Int number) {
+    replace(number, number, disabledPiece());
+}
+
+template <typename Int>
+void PiecewiseIntegerFunction<Int>::setRange(Int first, Int last, Int slope, Int offset) {
+    if (first > last) throw std::invalid_argument("Invalid range!");
+    replace(first, last, Piece{ true, slope, offset });
+}
+
+template <typename Int>
+void PiecewiseIntegerFunction<Int>::disableRange(Int first, Int last) {
+    if (first > last) throw std::invalid_argument("Invalid range!");
+    replace(first, last, disabledPiece());
+}
+
+template <typename Int>
+Int PiecewiseIntegerFunction<Int>::invoke(Int number) const {
+    const Piece& piece = pieceAt(number)->second;
+    if (!piece.defined) throw std::invalid_argument("The number is disabled!");
+    return piece.at(number);
+}
+
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::isDisabled(Int number) const {
+    return !pieceAt(number)->second.defined;
+}
+
+template <typename Int>
+size_t PiecewiseIntegerFunction<Int>::pieceCount() const {
+    return pieces.size();
+}
+
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::areParallel(const PiecewiseIntegerFunction& other) const {
+    return forEachCommonPiece(other, [](Int first, Int last, const Piece& left, const Piece& right) {
+        if (!left.defined || !right.defined) return true;
+        // Lines that agree on two neighbouring points are the same line
+        return first == last ? left.at(first) == right.at(first) : left.sameAs(right);
+    });
+}
+
+template <typename Int>
+PiecewiseIntegerFunction<Int> PiecewiseIntegerFunction<Int>::operator+(const PiecewiseIntegerFunction& other) const {
+    PiecewiseIntegerFunction result;
+    result.pieces.clear();
+    forEachCommonPiece(other, [&](Int first, Int, const Piece& left, const Piece& right) {
+        append(result.pieces, first, left.defined && right.defined
+                ? Piece{ true, wrap((Wide)left.slope + right.slope), wrap((Wide)left.offset + right.offset) }
+                : disabledPiece());
+        return true;
+    });
+    return result;
+}
+
+template <typename Int>
+PiecewiseIntegerFunction<Int> PiecewiseIntegerFunction<Int>::operator-(const PiecewiseIntegerFunction& other) const {
+    PiecewiseIntegerFunction result;
+    result.pieces.clear();
+    forEachCommonPiece(other, [&](Int first, Int, const Piece& left, const Piece& right) {
+        append(result.pieces, first, left.defined && right.defined
+                ? Piece{ true, wrap((Wide)left.slope - right.slope), wrap((Wide)left.offset - right.offset) }
+                : disabledPiece());
+        return true;
+    });
+    return result;
+}
+
+// The widest line of this function composed with the inner line, except where the inner
+// line lands on another piece. Those points are solved for one result at a time: when
+// the difference to the first result is a multiple of 2^zeros, slope * x = difference
+// modulo 2^bits has one solution in every 2^(bits - zeros) points.
+template <typename Int>
+void PiecewiseIntegerFunction<Int>::composeThrough(PieceMap& built, Int first, Int last, const Piece& line,
+                                                   const Piece& widest) const {
+    const unsigned zeros = trailingZeros((Unsigned)line.slope);
+    const uint64_t period = (uint64_t)MODULUS >> zeros;
+    const uint64_t inverse = oddInverse((uint64_t)(Unsigned)line.slope >> zeros);
+    const uint64_t start = (Unsigned)line.at(first);
+    const Wide length = (Wide)last - first + 1;
+
+    std::vector<std::pair<Int, Piece>> exceptions;
+    for (PieceIterator outer = pieces.begin(); outer != pieces.end(); ++outer) {
+        if (outer->second.sameAs(widest)) continue;
+        const Piece piece = composed(outer->second, line);
+        for (Wide result = outer->first; result <= lastOf(outer); ++result) {
+            const uint64_t difference = ((uint64_t)(Unsigned)(Int)result - start) & (MODULUS - 1);
+            if (difference & (((uint64_t)1 << zeros) - 1)) continue;
+            for (Wide x = (Wide)(((difference >> zeros) * inverse) & (period - 1)); x < length; x += period)
+                exceptions.push_back(std::make_pair((Int)(first + x), piece));
+        }
+    }
+    std::sort(exceptions.begin(), exceptions.end(), [](const std::pair<Int, Piece>& left, const std::pair<Int, Piece>& right) {
+        return left.first < right.first;
+    });
+
+    const Piece through = composed(widest, line);
+    Wide next = first;
+    for (size_t i = 0; i < exceptions.size(); ++i) {
+        if (exceptions[i].first > next) append(built, (Int)next, through);
+        append(built, exceptions[i].first, exceptions[i].second);
+        next = (Wide)exceptions[i].first + 1;
+    }
+    if (next <= last) append(built, (Int)next, through);
+}
+
+// Each stretch of an inner piece is a line that does not wrap, so the points it sends
+// into one outer piece form an interval, found by dividing by the slope. A single outer
+// line needs no stretches, which keeps powers of one line cheap, and an inner line that
+// wraps more often than there are points off the widest outer line goes through
+// composeThrough instead.
+template <typename Int>
+PiecewiseIntegerFunction<Int> PiecewiseIntegerFunction<Int>::operator*(const PiecewiseIntegerFunction& other) const {
+    Wide covered = MODULUS;
+    const PieceIterator widest = pieces.size() == 1 ? pieces.begin() : widestLine(false, covered);
+    PiecewiseIntegerFunction result;
+    result.pieces.clear();
+    for (PieceIterator inner = other.pieces.begin(); inner != other.pieces.end(); ++inner) {
+        const Piece& line = inner->second;
+        if (!line.defined || pieces.size() == 1) {
+            append(result.pieces, inner->first, composed(pieces.begin()->second, line));
+            continue;
+        }
+        if (wraps(inner->first, other.lastOf(inner), line) > MODULUS - covered) {
+            composeThrough(result.pieces, inner->first, other.lastOf(inner), line, widest->second);
+            continue;
+        }
+        forEachRun(inner->first, other.lastOf(inner), line, [&](Int begin, Int end, Wide value) {
+            const Wide step = line.slope;
+            const Wide lastValue = value + step * ((Wide)end - begin);
+            if (!step || begin == end) {
+                append(result.pieces, begin, composed(pieceAt((Int)value)->second, line));
+                return true;
+            }
+            for (PieceIterator outer = pieceAt((Int)value);; step > 0 ? ++outer : --outer) {
+                const Wide low = std::max<Wide>(outer->first, std::min(value, lastValue));
+                const Wide high = std::min<Wide>(lastOf(outer), std::max(value, lastValue));
+                const Wide distance = step > 0 ? low - value : value - high; // to the first point in the piece
+                const Wide span = step > 0 ? high - value : value - low; // to the last one
+                const Wide stride = std::abs(step);
+                const Wide from = begin + (distance + stride - 1) / stride, to = begin + span / stride;
+                if (from <= to) append(result.pieces, (Int)from, composed(outer->second, line));
+                if (step > 0 ? lastOf(outer) >= lastValue : outer->first <= lastValue) break;
+            }
+            return true;
+        });
+    }
+    return result;
+}
+
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::operator==(const PiecewiseIntegerFunction& other) const {
+    return forEachCommonPiece(other, [](Int first, Int last, const Piece& left, const Piece& right) {
+        if (left.defined != right.defined) return false;
+        if (!left.defined) return true;
+        return first == last ? left.at(first) == right.at(first) : left.sameAs(right);
+    });
+}
+
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::operator!=(const PiecewiseIntegerFunction& other) const {
+    return !(*this == other);
+}
+
+// A disabled point counts as lower than any result
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::operator<(const PiecewiseIntegerFunction& other) const {
+    return forEachCommonPiece(other, [](Int first, Int last, const Piece& left, const Piece& right) {
+        if (!right.defined) return false;
+        if (!left.defined) return true;
+        return countNotBelow(first, last, left, right) == 0;
+    });
+}
+
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::operator<=(const PiecewiseIntegerFunction& other) const {
+    return (*this < other) || (*this == other);
+}
+
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::operator>(const PiecewiseIntegerFunction& other) const {
+    return !(*this <= other);
+}
+
+template <typename Int>
+bool PiecewiseIntegerFunction<Int>::operator>=(const PiecewiseIntegerFunction& other) const {
+    return !(*this < other);
+}
+
+// f^power by repeated squaring, f^0 is the identity
+template <typename Int>
+PiecewiseIntegerFunction<Int> PiecewiseIntegerFunction<Int>::operator^(size_t power) const {
+    PiecewiseIntegerFunction result(1, 0);
+    PiecewiseIntegerFunction square(*this);
+    while (power) {
+        if (power & 1) result = square * result;
+        power >>= 1;
+        if (power) square = square * square;
+    }
+    return result;
+}
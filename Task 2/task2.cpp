@@ -1,4 +1,6 @@
 #include "ModifiableIntegerFunction.h"
+#include "IterationIndex.h"
+#include "PiecewiseIntegerFunction.h"
 
 void runTest(const char* testName, bool condition) {
     std::cout << testName << ": " << (condition ? "PASS" : "FAIL") << std::endl;
@@ -51,6 +53,17 @@ int main() {
     ModifiableIntegerFunction power(doubleFunction);
     ModifiableIntegerFunction power2 = power ^ 2;
     runTest("Test Power Operator", power2.invoke(5) == 20);
+
+    // Test iterating far without building f^k
+    IterationIndex index(power);
+    runTest("Test Iteration Index", index.invoke(5, 2) == 20 && index.invoke(1, 1000000000000) == 0);
+
+    // Test a function over int32_t stored as lines
+    PiecewiseIntegerFunction<int32_t> line(3, 7);
+    line.setRange(-100, 100, 1, 0);
+    runTest("Test Piecewise Function", line.invoke(50) == 50 && line.invoke(1000) == 3007 && line.pieceCount() == 3);
+    PiecewiseIntegerFunction<int32_t> odd(3, 7);
+    runTest("Test Piecewise Inverse", odd.inverse().invoke(odd.invoke(123456789)) == 123456789);
     std::cout << "All tests completed." << std::endl;
 
     return 0;
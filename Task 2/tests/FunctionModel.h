@@ -0,0 +1,114 @@
+#pragma once
+#include "ModifiableIntegerFunction.h"
+#include <vector>
+#include <random>
+#include <fstream>
+
+// The ModifiableIntegerFunction tests check every function against a plain table of
+// results, index = x - INT16_MIN
+
+static const size_t DOMAIN_SIZE = 1 << 16;
+
+struct Reference {
+    std::vector<int16_t> results;
+    std::vector<bool> defined;
+
+    Reference() : results(DOMAIN_SIZE, 0), defined(DOMAIN_SIZE, true) {}
+};
+
+inline int16_t pointAt(size_t index) {
+    return (int16_t)(index + INT16_MIN);
+}
+
+inline size_t indexOf(int16_t number) {
+    return (size_t)(number - INT16_MIN);
+}
+
+inline ModifiableIntegerFunction build(const Reference& reference) {
+    ModifiableIntegerFunction function;
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i) {
+        if (reference.defined[i]) function.setCustomResult(pointAt(i), reference.results[i]);
+        else function.disable(pointAt(i));
+    }
+    return function;
+}
+
+inline bool matches(const ModifiableIntegerFunction& function, const Reference& reference) {
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i) {
+        if (function.isDisabled(pointAt(i)) == reference.defined[i]) return false;
+        if (reference.defined[i] && function.invoke(pointAt(i)) != reference.results[i]) return false;
+    }
+    return true;
+}
+
+// Affine stretches with exceptions and disabled runs, the shape the compact format is made for
+inline Reference randomSegments(std::mt19937& random) {
+    Reference reference;
+    size_t index = 0;
+    while (index < DOMAIN_SIZE) {
+        const size_t length = 1 + random() % 5000;
+        const int16_t slope = (int16_t)(random() % 9 - 4), offset = (int16_t)random();
+        const bool disabled = random() % 5 == 0;
+        for (size_t i = index; i < index + length && i < DOMAIN_SIZE; ++i) {
+            reference.defined[i] = !disabled;
+            reference.results[i] = disabled ? 0 : (int16_t)(offset + slope * (int)(i - index));
+        }
+        index += length;
+    }
+    for (int i = 0; i < 200; ++i) {
+        const size_t point = random() % DOMAIN_SIZE;
+        if (reference.defined[point]) reference.results[point] = (int16_t)random();
+    }
+    return reference;
+}
+
+inline Reference randomTable(unsigned int disabledOneIn, std::mt19937& random) {
+    Reference reference;
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i) {
+        reference.results[i] = (int16_t)random();
+        reference.defined[i] = random() % disabledOneIn != 0;
+        if (!reference.defined[i]) reference.results[i] = 0;
+    }
+    return reference;
+}
+
+inline Reference randomPermutation(std::mt19937& random) {
+    Reference reference;
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i)
+        reference.results[i] = pointAt(i);
+    for (size_t i = DOMAIN_SIZE - 1; i > 0; --i)
+        std::swap(reference.results[i], reference.results[random() % (i + 1)]);
+    return reference;
+}
+
+inline bool isInjective(const Reference& reference) {
+    std::vector<bool> seen(DOMAIN_SIZE, false);
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i) {
+        if (!reference.defined[i]) continue;
+        if (seen[indexOf(reference.results[i])]) return false;
+        seen[indexOf(reference.results[i])] = true;
+    }
+    return true;
+}
+
+inline bool isSurjective(const Reference& reference) {
+    std::vector<bool> seen(DOMAIN_SIZE, false);
+    size_t hit = 0;
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i) {
+        if (reference.defined[i] && !seen[indexOf(reference.results[i])]) {
+            seen[indexOf(reference.results[i])] = true;
+            ++hit;
+        }
+    }
+    return hit == DOMAIN_SIZE;
+}
+
+inline std::vector<uint8_t> readFile(const char* fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+inline void writeFile(const char* fileName, const std::vector<uint8_t>& data) {
+    std::ofstream file(fileName, std::ios::binary);
+    file.write((const char*) data.data(), data.size());
+}
@@ -0,0 +1,78 @@
+#include "TestSuite.h"
+#include "FunctionModel.h"
+#include <thread>
+
+static int16_t slowBase(int16_t x) {
+    return (int16_t)(x * 3 + 1);
+}
+
+// Copies share tables and page caches; every thread changes its own copy while the
+// others read theirs, and the shared original has to stay as it was
+static void testCopyOnWriteRaces() {
+    const size_t threads = 8;
+    std::mt19937 baseRandom(20);
+    const Reference base = randomTable(20, baseRandom);
+    const ModifiableIntegerFunction original = build(base);
+    CHECK(original.isInjective() == isInjective(base)); // builds the shared preimage counts
+    const uint64_t originalHash = original.hash();
+
+    std::vector<int> failures(threads, 0);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937 random((unsigned int)t);
+            for (int round = 0; round < 3; ++round) {
+                ModifiableIntegerFunction copy(original);
+                Reference expected = base;
+                for (int change = 0; change < 300; ++change) {
+                    const size_t point = random() % DOMAIN_SIZE;
+                    if (random() % 4 == 0) {
+                        copy.disable(pointAt(point));
+                        expected.defined[point] = false;
+                        expected.results[point] = 0;
+                    }
+                    else {
+                        const int16_t result = (int16_t)random();
+                        copy.setCustomResult(pointAt(point), result);
+                        if (expected.defined[point]) expected.results[point] = result;
+                    }
+                }
+                failures[t] += !matches(copy, expected);
+                failures[t] += copy.isInjective() != isInjective(expected);
+                failures[t] += copy.isSurjective() != isSurjective(expected);
+                failures[t] += copy.hash() != build(expected).hash();
+
+                ModifiableIntegerFunction shared = original;
+                failures[t] += !(shared == original);
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    for (size_t t = 0; t < threads; ++t)
+        CHECK(failures[t] == 0);
+    CHECK(matches(original, base));
+    CHECK(original.hash() == originalHash);
+
+    // Lazy copies fill the shared page cache from different threads
+    const ModifiableIntegerFunction lazy(slowBase);
+    std::vector<int> lazyFailures(threads, 0);
+    workers.clear();
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            const ModifiableIntegerFunction copy(lazy);
+            for (size_t i = t; i < DOMAIN_SIZE; i += 3)
+                lazyFailures[t] += copy.invoke(pointAt(i)) != slowBase(pointAt(i));
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    for (size_t t = 0; t < threads; ++t)
+        CHECK(lazyFailures[t] == 0);
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("ModifiableIntegerFunction copy-on-write races", testCopyOnWriteRaces);
+    return suite.report();
+}
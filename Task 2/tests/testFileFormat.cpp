@@ -0,0 +1,155 @@
+#include "TestSuite.h"
+#include "FunctionModel.h"
+#include "FunctionEncoding.h"
+#include <cstdio>
+#include <cstring>
+
+static const char* const FILE_NAME = "test_function.bin";
+static const char* const OTHER_FILE_NAME = "test_function_other.bin";
+static const size_t HEADER_SIZE = 64;
+
+static void testFileFormats() {
+    std::mt19937 random(21);
+    std::vector<Reference> references;
+    references.push_back(randomSegments(random));
+    references.push_back(randomTable(7, random));
+    references.push_back(Reference());
+    Reference none;
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i) none.defined[i] = false;
+    references.push_back(none);
+
+    const Reference untouched = randomSegments(random);
+    for (const Reference& reference : references) {
+        const ModifiableIntegerFunction function = build(reference);
+        for (int raw = 0; raw < 2; ++raw) {
+            if (raw) function.serializeRaw(FILE_NAME);
+            else function.serialize(FILE_NAME);
+            ModifiableIntegerFunction loaded;
+            loaded.deserialize(FILE_NAME);
+            CHECK(matches(loaded, reference));
+
+            // Every changed payload byte is caught by the checksum
+            const std::vector<uint8_t> data = readFile(FILE_NAME);
+            for (int flip = 0; flip < 4; ++flip) {
+                std::vector<uint8_t> broken = data;
+                broken[HEADER_SIZE + random() % (broken.size() - HEADER_SIZE)] ^= (uint8_t)(1 + random() % 255);
+                writeFile(OTHER_FILE_NAME, broken);
+                ModifiableIntegerFunction target = build(untouched);
+                target.deserialize(OTHER_FILE_NAME);
+                CHECK(matches(target, untouched));
+                target.map(OTHER_FILE_NAME, true);
+                CHECK(!target.isMapped() && matches(target, untouched));
+            }
+            std::vector<uint8_t> truncated(data.begin(), data.end() - 1);
+            writeFile(OTHER_FILE_NAME, truncated);
+            ModifiableIntegerFunction target = build(untouched);
+            target.deserialize(OTHER_FILE_NAME);
+            CHECK(matches(target, untouched));
+        }
+
+        // A mapped table is shared until the first change
+        function.serializeRaw(FILE_NAME);
+        ModifiableIntegerFunction mapped;
+        mapped.map(FILE_NAME, true);
+        CHECK(matches(mapped, reference));
+        ModifiableIntegerFunction copy(mapped);
+        Reference changed = reference;
+        copy.setCustomResult(7, 7);
+        if (changed.defined[indexOf(7)]) changed.results[indexOf(7)] = 7;
+        CHECK(matches(copy, changed));
+        CHECK(matches(mapped, reference));
+    }
+
+    // Files from before the header: the raw table, then the disabled bitmap
+    const Reference reference = randomTable(9, random);
+    std::vector<uint8_t> legacy(DOMAIN_SIZE * 2 + DOMAIN_SIZE / 8, 0);
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i) {
+        std::memcpy(legacy.data() + 2 * i, &reference.results[i], 2);
+        if (!reference.defined[i]) legacy[2 * DOMAIN_SIZE + i / 8] |= (uint8_t)(1 << (i % 8));
+    }
+    writeFile(FILE_NAME, legacy);
+    ModifiableIntegerFunction loaded;
+    loaded.deserialize(FILE_NAME);
+    CHECK(matches(loaded, reference));
+}
+
+// A header claiming a huge compact payload is rejected before anything is allocated for it
+static void testHugePayloadSize() {
+    std::mt19937 random(23);
+    const Reference reference = randomSegments(random), untouched = randomTable(5, random);
+    build(reference).serialize(FILE_NAME);
+    const std::vector<uint8_t> data = readFile(FILE_NAME);
+    CHECK(data.size() < HEADER_SIZE + DOMAIN_SIZE * 2);
+
+    for (uint64_t payloadSize : { (uint64_t)1 << 62, (uint64_t)DOMAIN_SIZE * 2 + DOMAIN_SIZE / 8, ~(uint64_t)0 }) {
+        std::vector<uint8_t> broken = data;
+        std::memcpy(broken.data() + 16, &payloadSize, sizeof(payloadSize));
+        writeFile(OTHER_FILE_NAME, broken);
+        ModifiableIntegerFunction target = build(untouched);
+        bool threw = false;
+        try { target.deserialize(OTHER_FILE_NAME); } catch (...) { threw = true; }
+        CHECK(!threw && matches(target, untouched));
+        try { target.map(OTHER_FILE_NAME); } catch (...) { threw = true; }
+        CHECK(!threw && matches(target, untouched));
+    }
+}
+
+// A file with the magic but a version, header size or encoding this reader does not know
+// is rejected instead of being read as the headerless layout
+static void testUnsupportedHeaders() {
+    std::mt19937 random(24);
+    const Reference reference = randomTable(5, random), untouched = randomSegments(random);
+    build(reference).serializeRaw(FILE_NAME);
+    const std::vector<uint8_t> data = readFile(FILE_NAME);
+
+    const size_t offsets[] = { 4, 6, 12 }; // version, headerSize, encoding
+    for (size_t offset : offsets) {
+        std::vector<uint8_t> broken = data;
+        broken[offset] ^= 0x40;
+        writeFile(OTHER_FILE_NAME, broken);
+        ModifiableIntegerFunction target = build(untouched);
+        target.deserialize(OTHER_FILE_NAME);
+        CHECK(matches(target, untouched));
+        target.map(OTHER_FILE_NAME);
+        CHECK(!target.isMapped() && matches(target, untouched));
+    }
+}
+
+// Decoding garbage may fail but must stay inside the payload
+static void testCorruptEncodings() {
+    std::mt19937 random(22);
+    const Reference reference = randomSegments(random);
+    std::vector<int16_t> results(reference.results.begin(), reference.results.end());
+    std::vector<uint8_t> disabled(DOMAIN_SIZE / 8, 0);
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i)
+        if (!reference.defined[i]) disabled[i / 8] |= (uint8_t)(1 << (i % 8));
+
+    std::vector<uint8_t> encoded;
+    FunctionEncoding::encodeAffine(results.data(), disabled.data(), DOMAIN_SIZE, encoded);
+    std::vector<int16_t> decodedResults(DOMAIN_SIZE + 1);
+    std::vector<uint8_t> decodedDisabled(DOMAIN_SIZE / 8);
+    CHECK(FunctionEncoding::decodeAffine(encoded.data(), encoded.size(), decodedResults.data(),
+                                         decodedDisabled.data(), DOMAIN_SIZE));
+    CHECK(decodedDisabled == disabled);
+
+    size_t rejected = 0;
+    for (int round = 0; round < 2000; ++round) {
+        std::vector<uint8_t> broken(encoded.begin(), encoded.begin() + random() % (encoded.size() + 1));
+        for (int flip = round % 4; flip > 0 && !broken.empty(); --flip)
+            broken[random() % broken.size()] = (uint8_t)random();
+        rejected += !FunctionEncoding::decodeAffine(broken.data(), broken.size(), decodedResults.data(),
+                                                    decodedDisabled.data(), DOMAIN_SIZE);
+    }
+    CHECK(rejected > 1000);
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("ModifiableIntegerFunction file formats", testFileFormats);
+    suite.run("ModifiableIntegerFunction huge payload sizes", testHugePayloadSize);
+    suite.run("ModifiableIntegerFunction unsupported headers", testUnsupportedHeaders);
+    suite.run("FunctionEncoding corrupt payloads", testCorruptEncodings);
+    std::remove(FILE_NAME);
+    std::remove(OTHER_FILE_NAME);
+    return suite.report();
+}
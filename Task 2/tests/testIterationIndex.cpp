@@ -0,0 +1,91 @@
+#include "TestSuite.h"
+#include "FunctionModel.h"
+#include "IterationIndex.h"
+#include <stdexcept>
+
+// f^power at one point by walking, false where a step hits a disabled point
+static bool iterate(const Reference& reference, int16_t number, uint64_t power, int16_t& result) {
+    for (uint64_t step = 0; step < power; ++step) {
+        if (!reference.defined[indexOf(number)]) return false;
+        number = reference.results[indexOf(number)];
+    }
+    result = number;
+    return true;
+}
+
+// Same for huge powers: walks until the path repeats, then skips whole cycles
+static bool iterateFar(const Reference& reference, int16_t number, uint64_t power, int16_t& result) {
+    std::vector<int64_t> seenAt(DOMAIN_SIZE, -1);
+    std::vector<int16_t> path;
+    for (uint64_t step = 0; step < power; ++step) {
+        if (seenAt[indexOf(number)] >= 0) {
+            const uint64_t start = (uint64_t)seenAt[indexOf(number)], length = step - start;
+            result = path[start + (power - start) % length];
+            return true;
+        }
+        seenAt[indexOf(number)] = (int64_t)step;
+        path.push_back(number);
+        if (!reference.defined[indexOf(number)]) return false;
+        number = reference.results[indexOf(number)];
+    }
+    result = number;
+    return true;
+}
+
+static void testIterationIndex() {
+    std::mt19937 generator(16);
+    std::vector<Reference> functions;
+    functions.push_back(randomPermutation(generator));
+    functions.push_back(randomTable(1000, generator));
+    functions.push_back(randomTable(3, generator));
+    // One long tail into a single disabled point, and one long path into a cycle
+    Reference tail, lasso;
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i) {
+        tail.results[i] = pointAt(i + 1 < DOMAIN_SIZE ? i + 1 : i);
+        lasso.results[i] = pointAt(i + 1 < DOMAIN_SIZE ? i + 1 : DOMAIN_SIZE - 1000);
+    }
+    tail.defined[DOMAIN_SIZE - 1] = false;
+    tail.results[DOMAIN_SIZE - 1] = 0;
+    functions.push_back(tail);
+    functions.push_back(lasso);
+
+    for (const Reference& reference : functions) {
+        const ModifiableIntegerFunction function = build(reference);
+        const IterationIndex index(function);
+        bool same = true;
+        for (int query = 0; query < 3000; ++query) {
+            const int16_t x = (int16_t)generator();
+            const uint64_t power = generator() % 70;
+            int16_t expected = 0;
+            const bool defined = iterate(reference, x, power, expected);
+            same = same && index.isDefined(x, power) == defined && (!defined || index.invoke(x, power) == expected);
+        }
+        for (int query = 0; query < 100; ++query) {
+            const int16_t x = (int16_t)generator();
+            const uint64_t power = ((uint64_t)generator() << 20) + generator();
+            int16_t expected = 0;
+            const bool defined = iterateFar(reference, x, power, expected);
+            same = same && index.isDefined(x, power) == defined && (!defined || index.invoke(x, power) == expected);
+        }
+        CHECK(same);
+
+        int16_t disabledPoint = 0;
+        bool found = false;
+        for (size_t i = 0; i < DOMAIN_SIZE && !found; ++i)
+            if (!reference.defined[i]) {
+                disabledPoint = pointAt(i);
+                found = true;
+            }
+        if (found) {
+            bool threw = false;
+            try { index.invoke(disabledPoint, 1); } catch (const std::invalid_argument&) { threw = true; }
+            CHECK(threw);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("IterationIndex", testIterationIndex);
+    return suite.report();
+}
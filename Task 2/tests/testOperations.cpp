@@ -0,0 +1,168 @@
+#include "TestSuite.h"
+#include "FunctionModel.h"
+#include <stdexcept>
+#include <thread>
+
+// f^power at one point by walking, false where a step hits a disabled point
+static bool iterate(const Reference& reference, int16_t number, uint64_t power, int16_t& result) {
+    for (uint64_t step = 0; step < power; ++step) {
+        if (!reference.defined[indexOf(number)]) return false;
+        number = reference.results[indexOf(number)];
+    }
+    result = number;
+    return true;
+}
+
+static void testOperations() {
+    std::mt19937 random(16);
+    for (int round = 0; round < 6; ++round) {
+        const Reference a = round % 2 ? randomSegments(random) : randomTable(50, random);
+        const Reference b = randomTable(round + 2, random);
+        const ModifiableIntegerFunction f = build(a), g = build(b);
+        CHECK(matches(f, a));
+
+        Reference sum, difference, composition;
+        bool less = true, equal = true, parallel = true;
+        for (size_t i = 0; i < DOMAIN_SIZE; ++i) {
+            const bool both = a.defined[i] && b.defined[i];
+            sum.defined[i] = difference.defined[i] = both;
+            sum.results[i] = both ? (int16_t)(a.results[i] + b.results[i]) : 0;
+            difference.results[i] = both ? (int16_t)(a.results[i] - b.results[i]) : 0;
+            composition.defined[i] = b.defined[i] && a.defined[indexOf(b.results[i])];
+            composition.results[i] = composition.defined[i] ? a.results[indexOf(b.results[i])] : 0;
+            if (a.defined[i] != b.defined[i] || (both && a.results[i] != b.results[i])) equal = false;
+            if (!b.defined[i] || (a.defined[i] && a.results[i] >= b.results[i])) less = false;
+            if (both && a.results[i] != b.results[i]) parallel = false;
+        }
+        CHECK(matches(ModifiableIntegerFunction(f + g), sum));
+        CHECK(matches(ModifiableIntegerFunction(f - g), difference));
+        CHECK(matches(ModifiableIntegerFunction(f * g), composition));
+        CHECK((f == g) == equal);
+        CHECK((f < g) == less);
+        CHECK(f.areParallel(g) == parallel);
+        CHECK(f == build(a));
+        CHECK(f.hash() == build(a).hash());
+        CHECK(f.isInjective() == isInjective(a));
+        CHECK(f.isSurjective() == isSurjective(a));
+
+        for (uint64_t power : { 0u, 1u, 2u, 5u }) {
+            Reference iterated;
+            for (size_t i = 0; i < DOMAIN_SIZE; ++i) {
+                iterated.defined[i] = iterate(a, pointAt(i), power, iterated.results[i]);
+                if (!iterated.defined[i]) iterated.results[i] = 0;
+            }
+            CHECK(matches(f ^ power, iterated));
+        }
+    }
+
+    const Reference permutation = randomPermutation(random);
+    const ModifiableIntegerFunction bijection = build(permutation);
+    CHECK(bijection.isBijective());
+    Reference inverse;
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i)
+        inverse.results[indexOf(permutation.results[i])] = pointAt(i);
+    CHECK(matches(bijection.inverse(), inverse));
+    bool threw = false;
+    try { build(randomTable(2, random)).inverse(); } catch (const std::invalid_argument&) { threw = true; }
+    CHECK(threw);
+}
+
+static int16_t tripled(int16_t x) {
+    return (int16_t)(x * 3 + 1);
+}
+
+// A lazy function answers from its pages and overrides without building the table,
+// and gives the same answers once something whole-domain materializes it
+static void testLazyOverrides() {
+    std::mt19937 random(13);
+    ModifiableIntegerFunction function(tripled);
+    Reference expected;
+    for (size_t i = 0; i < DOMAIN_SIZE; ++i)
+        expected.results[i] = tripled(pointAt(i));
+    for (int change = 0; change < 5000; ++change) {
+        const size_t point = random() % DOMAIN_SIZE;
+        if (random() % 3 == 0) {
+            function.disable(pointAt(point));
+            expected.defined[point] = false;
+            expected.results[point] = 0;
+        }
+        else {
+            const int16_t result = (int16_t)random();
+            function.setCustomResult(pointAt(point), result);
+            if (expected.defined[point]) expected.results[point] = result;
+        }
+        if (change % 1000 == 0) CHECK(matches(function, expected));
+    }
+    CHECK(matches(function, expected));
+    CHECK(function == build(expected));
+    CHECK(matches(function, expected));
+
+    bool threw = false;
+    for (size_t i = 0; i < DOMAIN_SIZE && !threw; ++i)
+        if (!expected.defined[i]) {
+            try { function.invoke(pointAt(i)); } catch (const std::invalid_argument&) { threw = true; }
+        }
+    CHECK(threw);
+}
+
+// Const calls on one lazy function materialize it from several threads at once; every
+// thread has to see the same table and the lazy state has to stay readable meanwhile
+static void testConcurrentMaterialize() {
+    const size_t threads = 8;
+    std::mt19937 random(14);
+    for (int round = 0; round < 4; ++round) {
+        ModifiableIntegerFunction function(tripled);
+        Reference expected;
+        for (size_t i = 0; i < DOMAIN_SIZE; ++i)
+            expected.results[i] = tripled(pointAt(i));
+        for (int change = 0; change < 100; ++change) {
+            const size_t point = random() % DOMAIN_SIZE;
+            const int16_t result = (int16_t)random();
+            function.setCustomResult(pointAt(point), result);
+            expected.results[point] = result;
+        }
+        const ModifiableIntegerFunction copy = build(expected);
+        const uint64_t expectedHash = copy.hash();
+        const bool surjective = isSurjective(expected);
+
+        const ModifiableIntegerFunction& shared = function;
+        std::vector<int> failures(threads, 0);
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::vector<int16_t> in(DOMAIN_SIZE / 8), out(in.size());
+                std::vector<uint8_t> valid(in.size() / 8);
+                for (size_t i = 0; i < in.size(); ++i) in[i] = pointAt(i * 8 + t);
+                switch (t % 4) {
+                    case 0: failures[t] += !(shared == copy); break;
+                    case 1: failures[t] += shared.hash() != expectedHash; break;
+                    case 2: failures[t] += shared.isSurjective() != surjective; break;
+                    default:
+                        failures[t] += shared.invokeBatch(in.data(), out.data(), valid.data(), in.size()) != in.size();
+                        for (size_t i = 0; i < in.size(); ++i)
+                            failures[t] += out[i] != expected.results[indexOf(in[i])];
+                }
+                for (size_t i = t; i < DOMAIN_SIZE; i += 97)
+                    failures[t] += shared.invoke(pointAt(i)) != expected.results[i];
+            });
+        }
+        for (std::thread& worker : workers)
+            worker.join();
+        for (size_t t = 0; t < threads; ++t)
+            CHECK(failures[t] == 0);
+        CHECK(matches(function, expected));
+
+        // The first change after that drops the lazy state and keeps the published table
+        function.setCustomResult(1, 2);
+        expected.results[indexOf(1)] = 2;
+        CHECK(matches(function, expected));
+    }
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("ModifiableIntegerFunction operations", testOperations);
+    suite.run("ModifiableIntegerFunction lazy overrides", testLazyOverrides);
+    suite.run("ModifiableIntegerFunction concurrent materialize", testConcurrentMaterialize);
+    return suite.report();
+}
@@ -0,0 +1,60 @@
+#include "TestSuite.h"
+#include "FunctionModel.h"
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+
+static int16_t squared(int16_t x) {
+    return (int16_t)(x * x - 5);
+}
+
+static int16_t throwingBase(int16_t x) {
+    if (x == 30000) throw std::runtime_error("base function failed");
+    return x;
+}
+
+// Every whole-domain pass gives the same answer on any number of threads
+static void testThreadCounts() {
+    std::mt19937 random(20);
+    const Reference a = randomSegments(random), b = randomTable(9, random);
+    ModifiableIntegerFunction::setThreadCount(1);
+    const ModifiableIntegerFunction f = build(a), g = build(b);
+    const ModifiableIntegerFunction sum = f + g, composition = f * g, lazy(squared);
+    const uint64_t hash = f.hash();
+    const bool equal = lazy == ModifiableIntegerFunction(squared) * f;
+    for (size_t threads : { 1u, 2u, 3u, 7u, 0u }) {
+        ModifiableIntegerFunction::setThreadCount(threads);
+        CHECK(ModifiableIntegerFunction::threadCount() == (threads ? threads : std::max(1u, std::thread::hardware_concurrency())));
+        CHECK(ModifiableIntegerFunction(f + g) == sum);
+        CHECK(ModifiableIntegerFunction(f * g) == composition);
+        CHECK(build(a).hash() == hash);
+        CHECK((ModifiableIntegerFunction(squared) == ModifiableIntegerFunction(squared) * f) == equal);
+        CHECK(f.isInjective() == isInjective(a) && f.isSurjective() == isSurjective(a));
+    }
+}
+
+// A throwing base function surfaces from the parallel table build on the calling thread
+static void testThrowingBaseFunction() {
+    ModifiableIntegerFunction function(throwingBase);
+    function.setCustomResult(1, 5);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool threw = false;
+        try { (void)(function == ModifiableIntegerFunction()); } catch (const std::runtime_error&) { threw = true; }
+        CHECK(threw);
+        CHECK(function.invoke(1) == 5 && function.invoke(2) == 2);
+    }
+    // The page holding the failing point is never kept half computed
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool threw = false;
+        try { function.invoke(30001); } catch (const std::runtime_error&) { threw = true; }
+        CHECK(threw);
+    }
+    CHECK(function.invoke(-7) == -7);
+}
+
+int main(int argc, char** argv) {
+    TestSuite suite(argc, argv);
+    suite.run("ModifiableIntegerFunction thread counts", testThreadCounts);
+    suite.run("ModifiableIntegerFunction throwing base function", testThrowingBaseFunction);
+    return suite.report();
+}
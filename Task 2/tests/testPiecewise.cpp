@@ -0,0 +1,343 @@
+#include "TestSuite.h"
+#include "PiecewiseIntegerFunction.h"
+#include "IntegerFunction.h"
+#include <vector>
+#include <random>
+#include <set>
+#include <limits>
+#include <type_traits>
+
+// PiecewiseIntegerFunction against a dense table of the same function. int8_t and
+// int16_t are checked over the whole domain, int32_t over a window outside of which
+// every point is disabled, so injectivity and composition stay brute-forceable.
+
+static std::mt19937 generator(24);
+
+template <typename Int>
+static Int wrapped(int64_t value) {
+    return (Int)(typename std::make_unsigned<Int>::type)(uint64_t)value;
+}
+
+// Results over [first, first + size), everything else disabled
+template <typename Int>
+struct Dense {
+    int64_t first;
+    std::vector<Int> results;
+    std::vector<bool> defined;
+
+    Dense(int64_t first, size_t size) : first(first), results(size, 0), defined(size, false) {}
+
+    size_t size() const { return results.size(); }
+    int64_t point(size_t index) const { return first + (int64_t)index; }
+    bool has(int64_t number) const { return number >= first && number < first + (int64_t)size(); }
+    bool isDefined(int64_t number) const { return has(number) && defined[number - first]; }
+    Int at(int64_t number) const { return results[number - first]; }
+
+    void set(int64_t number, Int result) {
+        results[number - first] = result;
+        defined[number - first] = true;
+    }
+    void disable(int64_t number) {
+        results[number - first] = 0;
+        defined[number - first] = false;
+    }
+};
+
+template <typename Int>
+static Dense<Int> wholeDomain() {
+    const int64_t lowest = std::numeric_limits<Int>::min(), highest = std::numeric_limits<Int>::max();
+    return Dense<Int>(lowest, (size_t)(highest - lowest + 1));
+}
+
+// A random line, then random ranges, overrides and disabled points inside [low, high]
+template <typename Int>
+static void randomize(PiecewiseIntegerFunction<Int>& function, Dense<Int>& dense, int64_t low, int64_t high) {
+    const Int slope = generator() % 4 == 0 ? (Int)generator() : (Int)(generator() % 7 - 3);
+    const Int offset = (Int)generator();
+    function = PiecewiseIntegerFunction<Int>(slope, offset);
+    const int64_t lowest = std::numeric_limits<Int>::min(), highest = std::numeric_limits<Int>::max();
+    if (low > lowest) function.disableRange((Int)lowest, (Int)(low - 1));
+    if (high < highest) function.disableRange((Int)(high + 1), (Int)highest);
+    for (size_t i = 0; i < dense.size(); ++i)
+        dense.set(dense.point(i), wrapped<Int>((int64_t)slope * dense.point(i) + offset));
+
+    const int changes = generator() % 8;
+    for (int change = 0; change < changes; ++change) {
+        int64_t a = low + generator() % (high - low + 1), b = low + generator() % (high - low + 1);
+        if (a > b) std::swap(a, b);
+        switch (generator() % 4) {
+            case 0: {
+                const Int rangeSlope = generator() % 3 == 0 ? (Int)generator() : (Int)(generator() % 5 - 2);
+                const Int rangeOffset = (Int)generator();
+                function.setRange((Int)a, (Int)b, rangeSlope, rangeOffset);
+                for (int64_t x = a; x <= b; ++x)
+                    dense.set(x, wrapped<Int>((int64_t)rangeSlope * x + rangeOffset));
+                break;
+            }
+            case 1:
+                function.disableRange((Int)a, (Int)b);
+                for (int64_t x = a; x <= b; ++x)
+                    dense.disable(x);
+                break;
+            case 2: {
+                const Int result = (Int)generator();
+                function.setCustomResult((Int)a, result);
+                if (dense.isDefined(a)) dense.set(a, result);
+                break;
+            }
+            default:
+                function.disable((Int)a);
+                dense.disable(a);
+        }
+    }
+}
+
+template <typename Int>
+static bool matches(const PiecewiseIntegerFunction<Int>& function, const Dense<Int>& dense) {
+    for (size_t i = 0; i < dense.size(); ++i) {
+        const Int x = (Int)dense.point(i);
+        if (function.isDisabled(x) == dense.defined[i]) return false;
+        if (dense.defined[i] && function.invoke(x) != dense.results[i]) return false;
+    }
+    return true;
+}
+
+template <typename Int>
+static bool isInjective(const Dense<Int>& dense) {
+    std::set<Int> seen;
+    for (size_t i = 0; i < dense.size(); ++i)
+        if (dense.defined[i] && !seen.insert(dense.results[i]).second) return false;
+    return true;
+}
+
+// f * g over g's window, f given by its dense table
+template <typename Int>
+static Dense<Int> composition(const Dense<Int>& f, const Dense<Int>& g) {
+    Dense<Int> result(g.first, g.size());
+    for (size_t i = 0; i < g.size(); ++i)
+        if (g.defined[i] && f.isDefined(g.results[i])) result.set(g.point(i), f.at(g.results[i]));
+    return result;
+}
+
+template <typename Int>
+static void testWholeDomain(int rounds) {
+    const int64_t lowest = std::numeric_limits<Int>::min(), highest = std::numeric_limits<Int>::max();
+    int bijections = 0;
+    for (int round = 0; round < rounds; ++round) {
+        PiecewiseIntegerFunction<Int> f, g;
+        Dense<Int> denseF = wholeDomain<Int>(), denseG = wholeDomain<Int>();
+        randomize(f, denseF, lowest, highest);
+        randomize(g, denseG, lowest, highest);
+        if (round == 0) {
+            // One odd-slope line over the whole domain, so inverse runs at least once
+            const Int offset = (Int)generator();
+            f.setRange((Int)lowest, (Int)highest, (Int)3, offset);
+            for (size_t i = 0; i < denseF.size(); ++i)
+                denseF.set(denseF.point(i), wrapped<Int>(3 * denseF.point(i) + offset));
+        }
+        if (generator() % 3 == 0) {
+            // Equal, or off by one result, so the comparisons see both outcomes
+            g = f;
+            denseG = denseF;
+            if (generator() % 2) {
+                const int64_t x = lowest + generator() % (highest - lowest + 1);
+                g.setCustomResult((Int)x, (Int)(denseG.at(x) + 1));
+                if (denseG.isDefined(x)) denseG.set(x, (Int)(denseG.at(x) + 1));
+            }
+        }
+        CHECK(matches(f, denseF));
+        CHECK(matches(g, denseG));
+
+        Dense<Int> sum = wholeDomain<Int>(), difference = wholeDomain<Int>();
+        bool equal = true, less = true, parallel = true;
+        for (size_t i = 0; i < denseF.size(); ++i) {
+            const bool both = denseF.defined[i] && denseG.defined[i];
+            if (both) {
+                sum.set(sum.point(i), (Int)(denseF.results[i] + denseG.results[i]));
+                difference.set(difference.point(i), (Int)(denseF.results[i] - denseG.results[i]));
+            }
+            if (denseF.defined[i] != denseG.defined[i] || (both && denseF.results[i] != denseG.results[i])) equal = false;
+            if (!denseG.defined[i] || (denseF.defined[i] && denseF.results[i] >= denseG.results[i])) less = false;
+            if (both && denseF.results[i] != denseG.results[i]) parallel = false;
+        }
+        CHECK(matches(f + g, sum));
+        CHECK(matches(f - g, difference));
+        CHECK(matches(f * g, composition(denseF, denseG)));
+        CHECK((f == g) == equal);
+        CHECK((f < g) == less);
+        CHECK((f <= g) == (less || equal));
+        CHECK(f.areParallel(g) == parallel);
+
+        const bool injective = isInjective(denseF);
+        bool complete = true;
+        for (size_t i = 0; i < denseF.size(); ++i) complete = complete && denseF.defined[i];
+        CHECK(f.isInjective() == injective);
+        CHECK(f.isSurjective() == (injective && complete));
+        if (injective && complete) {
+            ++bijections;
+            Dense<Int> inverse = wholeDomain<Int>();
+            for (size_t i = 0; i < denseF.size(); ++i)
+                inverse.set(denseF.results[i], (Int)denseF.point(i));
+            CHECK(matches(f.inverse(), inverse));
+        }
+
+        const size_t power = generator() % 6;
+        Dense<Int> iterated = wholeDomain<Int>();
+        for (size_t i = 0; i < denseF.size(); ++i) {
+            int64_t x = denseF.point(i);
+            bool defined = true;
+            for (size_t step = 0; step < power && defined; ++step) {
+                defined = denseF.isDefined(x);
+                if (defined) x = denseF.at(x);
+            }
+            if (defined) iterated.set(iterated.point(i), (Int)x);
+        }
+        CHECK(matches(f ^ power, iterated));
+    }
+    CHECK(bijections > 0);
+}
+
+// int32_t lines checked over two windows, the second one far away
+static void testRestrictedInt32() {
+    int collisions = 0;
+    for (int round = 0; round < 400; ++round) {
+        const int64_t size = 1 + generator() % 3000;
+        const int64_t first = (int64_t)(int32_t)generator() / 4, second = first + (int64_t)(generator() % 1000000000) + size;
+        PiecewiseIntegerFunction<int32_t> f;
+        Dense<int32_t> denseF(first, (size_t)size);
+        randomize(f, denseF, first, first + size - 1);
+        CHECK(matches(f, denseF));
+        CHECK(f.isInjective() == isInjective(denseF));
+
+        // A second line over the far window, through a result of the first one half of the time
+        const int32_t slope = generator() % 2 ? (int32_t)generator() : (int32_t)(generator() % 9 - 4);
+        int32_t offset = (int32_t)generator();
+        const int64_t hitPoint = first + generator() % size, hitBy = second + generator() % size;
+        if (generator() % 2 && denseF.isDefined(hitPoint))
+            offset = wrapped<int32_t>((int64_t)denseF.at(hitPoint) - (int64_t)slope * hitBy);
+        PiecewiseIntegerFunction<int32_t> line(slope, offset);
+        line.disableRange(INT32_MIN, (int32_t)(second - 1));
+        line.disableRange((int32_t)(second + size), INT32_MAX);
+
+        PiecewiseIntegerFunction<int32_t> both = f;
+        both.setRange((int32_t)second, (int32_t)(second + size - 1), slope, offset);
+        std::set<int32_t> seen;
+        bool injective = true;
+        for (size_t i = 0; i < denseF.size() && injective; ++i)
+            if (denseF.defined[i] && !seen.insert(denseF.results[i]).second) injective = false;
+        for (int64_t x = second; x < second + size && injective; ++x)
+            if (!seen.insert(wrapped<int32_t>((int64_t)slope * x + offset)).second) injective = false;
+        CHECK(both.isInjective() == injective);
+        collisions += isInjective(denseF) && !injective;
+
+        // Composition through the far window and back
+        Dense<int32_t> denseLine(second, (size_t)size);
+        for (int64_t x = second; x < second + size; ++x)
+            denseLine.set(x, wrapped<int32_t>((int64_t)slope * x + offset));
+        CHECK(matches(f * line, composition(denseF, denseLine)));
+    }
+    CHECK(collisions > 0);
+}
+
+// Lines with an odd slope are bijections of int32_t, inverted with Newton's iteration
+static void testInverseOfLines() {
+    for (int round = 0; round < 1000; ++round) {
+        const int32_t slope = (int32_t)(generator() | 1), offset = (int32_t)generator();
+        const PiecewiseIntegerFunction<int32_t> line(slope, offset);
+        CHECK(line.isBijective());
+        const PiecewiseIntegerFunction<int32_t> inverse = line.inverse();
+        CHECK(inverse * line == PiecewiseIntegerFunction<int32_t>(1, 0));
+        CHECK(line * inverse == PiecewiseIntegerFunction<int32_t>(1, 0));
+        const int32_t x = (int32_t)generator();
+        CHECK(inverse.invoke(line.invoke(x)) == x);
+
+        const PiecewiseIntegerFunction<int32_t> even(wrapped<int32_t>(2 * (int64_t)slope), offset);
+        CHECK(!even.isInjective());
+        bool threw = false;
+        try { even.inverse(); } catch (const std::invalid_argument&) { threw = true; }
+        CHECK(threw);
+    }
+
+    // A high power of one line stays a single piece
+    const PiecewiseIntegerFunction<int32_t> power = PiecewiseIntegerFunction<int32_t>(5, 1) ^ 1000000;
+    CHECK(power.pieceCount() == 1);
+    int32_t x = 12345;
+    for (int i = 0; i < 1000000; ++i) x = wrapped<int32_t>(5 * (int64_t)x + 1);
+    CHECK(power.invoke(12345) == x);
+}
+
+// Lines with a slope near 2^30 wrap around hundreds of millions of times over the domain
+static void testSteepLines() {
+    const int32_t steep = (1 << 30) + 1;
+    CHECK(PiecewiseIntegerFunction<int32_t>(1 << 30, 0) < PiecewiseIntegerFunction<int32_t>(1 << 30, 1));
+    CHECK(!(PiecewiseIntegerFunction<int32_t>(steep, 0) < PiecewiseIntegerFunction<int32_t>(steep - 2, 0)));
+    CHECK(PiecewiseIntegerFunction<int32_t>(steep, 0).isBijective());
+    CHECK(!PiecewiseIntegerFunction<int32_t>(1 << 30, 5).isInjective());
+
+    // Two steep halves that miss each other, then one point moved onto the other half
+    PiecewiseIntegerFunction<int32_t> halves(steep, 0);
+    halves.setRange(0, INT32_MAX, steep, 7);
+    CHECK(!halves.isInjective());
+    PiecewiseIntegerFunction<int32_t> apart(steep, 0);
+    apart.setRange(0, INT32_MAX, steep, 0);
+    apart.setCustomResult(12345, (int32_t)(-steep));
+    CHECK(!apart.isInjective());
+    apart.setCustomResult(12345, wrapped<int32_t>((int64_t)steep * 12345));
+    CHECK(apart.isInjective());
+
+    // A steep line through 3x with a few swapped points
+    PiecewiseIntegerFunction<int32_t> outer(3, 1);
+    for (int32_t x = 0; x < 20; x += 2) {
+        outer.setCustomResult(x, 3 * (x + 1) + 1);
+        outer.setCustomResult(x + 1, 3 * x + 1);
+    }
+    const PiecewiseIntegerFunction<int32_t> inner(steep, -5);
+    const PiecewiseIntegerFunction<int32_t> composed = outer * inner;
+    for (int round = 0; round < 10000; ++round) {
+        const int32_t x = round < 5000 ? (int32_t)generator() : wrapped<int32_t>((int64_t)(generator() % 16) * (1 << 28) + generator() % 64);
+        CHECK(composed.invoke(x) == outer.invoke(inner.invoke(x)));
+    }
+    for (int32_t y = 0; y < 20; ++y) {
+        // Solve steep * x - 5 = y with the inverse of the line
+        const int32_t x = PiecewiseIntegerFunction<int32_t>(steep, -5).inverse().invoke(y);
+        CHECK(composed.invoke(x) == outer.invoke(y));
+    }
+}
+
+// 3x with swapped points has no line stepping by 1, so most points invert through 3x
+static void testInverseOfSwappedPoints() {
+    PiecewiseIntegerFunction<int32_t> f(3, 0);
+    f.setCustomResult(10, 3 * 20);
+    f.setCustomResult(20, 3 * 10);
+    f.setCustomResult(-7, 3 * 1000000);
+    f.setCustomResult(1000000, 3 * -7);
+    CHECK(f.isBijective());
+    const PiecewiseIntegerFunction<int32_t> inverse = f.inverse();
+    CHECK(inverse * f == PiecewiseIntegerFunction<int32_t>(1, 0));
+    CHECK(f * inverse == PiecewiseIntegerFunction<int32_t>(1, 0));
+    for (int round = 0; round < 1000; ++round) {
+        const int32_t x = (int32_t)generator();
+        CHECK(inverse.invoke(f.invoke(x)) == x);
+    }
+
+    // A stretch of 3x reversed in place
+    PiecewiseIntegerFunction<int32_t> g(3, 0);
+    for (int32_t x = 0; x < 100; ++x)
+        g.setCustomResult(x, 3 * (99 - x));
+    CHECK(g.isBijective());
+    CHECK(g.inverse() * g == PiecewiseIntegerFunction<int32_t>(1, 0));
+}
+
+int main(int argc, char** argv) {
+    static_assert(std::is_same<IntegerFunction<int16_t>, ModifiableIntegerFunction>::value, "dense for int16_t");
+    static_assert(std::is_same<IntegerFunction<int32_t>, PiecewiseIntegerFunction<int32_t>>::value, "pieces beyond");
+
+    TestSuite suite(argc, argv);
+    suite.run("PiecewiseIntegerFunction<int8_t> against a dense table", [] { testWholeDomain<int8_t>(3000); });
+    suite.run("PiecewiseIntegerFunction<int16_t> against a dense table", [] { testWholeDomain<int16_t>(3); });
+    suite.run("PiecewiseIntegerFunction<int32_t> over restricted ranges", testRestrictedInt32);
+    suite.run("PiecewiseIntegerFunction<int32_t> inverse of lines", testInverseOfLines);
+    suite.run("PiecewiseIntegerFunction<int32_t> steep lines", testSteepLines);
+    suite.run("PiecewiseIntegerFunction<int32_t> inverse of swapped points", testInverseOfSwappedPoints);
+    return suite.report();
+}